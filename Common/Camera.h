@@ -74,6 +74,10 @@ public:
 	// After modifying camera position/orientation, call to rebuild the view matrix.
 	void UpdateViewMatrix();
 
+	// Changes whenever the view or projection matrix does, so data derived from them
+	// can be cached until it moves.
+	UINT64 GetRevision()const;
+
 private:
 
 	// Camera coordinate system with coordinates relative to world space.
@@ -91,6 +95,7 @@ private:
 	float mFarWindowHeight = 0.0f;
 
 	bool mViewDirty = true;
+	UINT64 mRevision = 1;
 
 	// Cache View/Proj matrices.
 	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
@@ -1283,6 +1283,11 @@ static HRESULT CreateD3DResources12(
 			texture = nullptr;
 			return hr;
 		}
+		else if (cmdList == nullptr)
+		{
+			// The caller uploads the data itself.
+			return hr;
+		}
 		else
 		{
 			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
@@ -1678,7 +1683,8 @@ static HRESULT CreateTextureFromDDS12(
 	_In_ size_t maxsize,
 	_In_ bool forceSRGB,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	_Out_opt_ std::vector<D3D12_SUBRESOURCE_DATA>* subresources = nullptr)
 {
 	HRESULT hr = S_OK;
 
@@ -1870,6 +1876,11 @@ static HRESULT CreateTextureFromDDS12(
 			textureUploadHeap);
 	}
 
+	if (SUCCEEDED(hr) && subresources)
+	{
+		subresources->assign(initData.get(), initData.get() + (mipCount - skipMip) * arraySize);
+	}
+
 	return hr;
 }
 
@@ -1918,6 +1929,112 @@ HRESULT DirectX::CreateDDSTextureFromMemory( ID3D11Device* d3dDevice,
 }
 
 _Use_decl_annotations_
+//--------------------------------------------------------------------------------------
+static HRESULT GetDDSHeaderFromMemory12(
+	_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+	_In_ size_t ddsDataSize,
+	_Out_ const DDS_HEADER*& header,
+	_Out_ ptrdiff_t& offset
+	)
+{
+	header = nullptr;
+	offset = 0;
+
+	// Must be long enough for the magic value and header
+	if (ddsDataSize < (sizeof(uint32_t) + sizeof(DDS_HEADER)))
+	{
+		return E_FAIL;
+	}
+
+	uint32_t dwMagicNumber = *(const uint32_t*)(ddsData);
+	if (dwMagicNumber != DDS_MAGIC)
+	{
+		return E_FAIL;
+	}
+
+	header = reinterpret_cast<const DDS_HEADER*>(ddsData + sizeof(uint32_t));
+
+	// Verify header to validate DDS file
+	if (header->size != sizeof(DDS_HEADER) ||
+		header->ddspf.size != sizeof(DDS_PIXELFORMAT))
+	{
+		return E_FAIL;
+	}
+
+	// Check for DX10 extension
+	bool bDXT10Header = false;
+	if ((header->ddspf.flags & DDS_FOURCC) &&
+		(MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
+	{
+		// Must be long enough for both headers and magic value
+		if (ddsDataSize < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
+		{
+			return E_FAIL;
+		}
+
+		bDXT10Header = true;
+	}
+
+	offset = sizeof(uint32_t)
+		+ sizeof(DDS_HEADER)
+		+ (bDXT10Header ? sizeof(DDS_HEADER_DXT10) : 0);
+
+	return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::LoadDDSTextureFromMemory12(
+	ID3D12Device* device,
+	_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+	_In_ size_t ddsDataSize,
+	ComPtr<ID3D12Resource>& texture,
+	std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode
+	)
+{
+	if (alphaMode)
+		(*alphaMode) = DDS_ALPHA_MODE_UNKNOWN;
+
+	subresources.clear();
+
+	if (!device || !ddsData || !ddsDataSize)
+	{
+		return E_INVALIDARG;
+	}
+
+	const DDS_HEADER* header = nullptr;
+	ptrdiff_t offset = 0;
+	HRESULT hr = GetDDSHeaderFromMemory12(ddsData, ddsDataSize, header, offset);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	ComPtr<ID3D12Resource> noUploadHeap;
+	hr = CreateTextureFromDDS12(
+		device,
+		nullptr,
+		header,
+		ddsData + offset,
+		ddsDataSize - offset,
+		maxsize,
+		false,
+		texture,
+		noUploadHeap,
+		&subresources
+		);
+
+	if (SUCCEEDED(hr))
+	{
+		if (alphaMode)
+			(*alphaMode) = GetAlphaMode(header);
+	}
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
 HRESULT DirectX::CreateDDSTextureFromMemory12(
 	ID3D12Device* device,
 	_In_ ID3D12GraphicsCommandList* cmdList,
@@ -29,6 +29,7 @@
 #pragma warning(push)
 #pragma warning(disable : 4005)
 #include <stdint.h>
+#include <vector>
 
 #pragma warning(pop)
 
@@ -75,6 +76,18 @@ namespace DirectX
 		                                 _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                                 );
 
+	// Creates the texture in D3D12_RESOURCE_STATE_COMMON without recording any commands.
+	// subresources point into ddsData; uploading them (e.g. on a copy queue) is up to
+	// the caller.
+	HRESULT LoadDDSTextureFromMemory12(_In_ ID3D12Device* device,
+		                               _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+		                               _In_ size_t ddsDataSize,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                               _Out_ std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+		                               _In_ size_t maxsize = 0,
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               );
+
     HRESULT CreateDDSTextureFromFile( _In_ ID3D11Device* d3dDevice,
                                       _In_z_ const wchar_t* szFileName,
                                       _Outptr_opt_ ID3D11Resource** texture,
@@ -6,7 +6,7 @@
 #include "GameTimer.h"
 
 GameTimer::GameTimer()
-: mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
+: mSecondsPerCount(0.0), mDeltaTime(-1.0), mFixedTimeStep(0.0), mFixedTotalTime(0.0), mBaseTime(0), 
   mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
 {
 	__int64 countsPerSec;
@@ -18,6 +18,12 @@ GameTimer::GameTimer()
 // time when the clock is stopped.
 float GameTimer::TotalTime()const
 {
+	// A fixed step counts only the steps taken, which already leave out paused time.
+	if( mFixedTimeStep > 0.0 )
+	{
+		return (float)mFixedTotalTime;
+	}
+
 	// If we are stopped, do not count the time that has passed since we stopped.
 	// Moreover, if we previously already had a pause, the distance 
 	// mStopTime - mBaseTime includes paused time, which we do not want to count.
@@ -62,6 +68,7 @@ void GameTimer::Reset()
 	mPrevTime = currTime;
 	mStopTime = 0;
 	mStopped  = false;
+	mFixedTotalTime = 0.0;
 }
 
 void GameTimer::Start()
@@ -110,6 +117,14 @@ void GameTimer::Tick()
 	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
 	mCurrTime = currTime;
 
+	if( mFixedTimeStep > 0.0 )
+	{
+		mDeltaTime = mFixedTimeStep;
+		mFixedTotalTime += mFixedTimeStep;
+		mPrevTime = mCurrTime;
+		return;
+	}
+
 	// Time difference between this frame and the previous.
 	mDeltaTime = (mCurrTime - mPrevTime)*mSecondsPerCount;
 
@@ -125,6 +140,11 @@ void GameTimer::Tick()
 	}
 }
 
+void GameTimer::SetFixedTimeStep(double seconds)
+{
+	mFixedTimeStep = (seconds > 0.0) ? seconds : 0.0;
+}
+
 
 
 
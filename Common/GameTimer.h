@@ -18,9 +18,16 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// With a step above zero, every Tick advances the clock by exactly that many
+	// seconds whatever the wall clock did, so a run is repeatable; zero restores real
+	// time.  Call before Reset().
+	void SetFixedTimeStep(double seconds);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
+	double mFixedTimeStep;
+	double mFixedTotalTime;
 
 	__int64 mBaseTime;
 	__int64 mPausedTime;
@@ -4,6 +4,9 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -660,4 +663,194 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float radius, uint32 sliceCount, uint32 stackCount)
 {
 	return CreateSphere(radius, sliceCount, stackCount);
-}
\ No newline at end of file
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+
+	// Below 6 slices and 4 stacks the sphere no longer reads as round.
+	uint32 slices = sliceCount;
+	uint32 stacks = stackCount;
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateSphere(radius, slices, stacks));
+
+		uint32 nextSlices = std::max<uint32>(slices / 2, std::min<uint32>(slices, 6u));
+		uint32 nextStacks = std::max<uint32>(stacks / 2, std::min<uint32>(stacks, 4u));
+		if(nextSlices == slices && nextStacks == stacks)
+			break;
+
+		slices = nextSlices;
+		stacks = nextStacks;
+	}
+
+	return lods;
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateGeosphereLods(float radius, uint32 numSubdivisions, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+
+	// Each subdivision quadruples the triangles, so each level down has a quarter.
+	uint32 subdivisions = std::min<uint32>(numSubdivisions, 6u);
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateGeosphere(radius, subdivisions));
+		if(subdivisions == 0)
+			break;
+
+		--subdivisions;
+	}
+
+	return lods;
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateCylinderLods(float bottomRadius, float topRadius, float height,
+	uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+	std::vector<MeshData> lods;
+
+	// The sides are straight, so one stack keeps the silhouette; below 6 slices the
+	// cylinder no longer reads as round.
+	uint32 slices = sliceCount;
+	uint32 stacks = stackCount;
+	for(uint32 i = 0; i < lodCount; ++i)
+	{
+		lods.push_back(CreateCylinder(bottomRadius, topRadius, height, slices, stacks));
+
+		uint32 nextSlices = std::max<uint32>(slices / 2, std::min<uint32>(slices, 6u));
+		uint32 nextStacks = std::max<uint32>(stacks / 2, 1u);
+		if(nextSlices == slices && nextStacks == stacks)
+			break;
+
+		slices = nextSlices;
+		stacks = nextStacks;
+	}
+
+	return lods;
+}
+
+GeometryGenerator::MeshletData GeometryGenerator::CreateMeshlets(const MeshData& meshData, uint32 maxVertices, uint32 maxPrimitives)
+{
+	assert(maxVertices >= 3 && maxVertices <= 256);
+	assert(maxPrimitives >= 1 && maxPrimitives <= 256);
+
+	MeshletData result;
+
+	// Each mesh vertex's index in the open meshlet, or ~0 while it is not in it.
+	std::vector<uint32> localIndex(meshData.Vertices.size(), ~0u);
+
+	Meshlet meshlet;
+	auto closeMeshlet = [&]()
+	{
+		if(meshlet.PrimitiveCount == 0)
+			return;
+
+		for(uint32 v = 0; v < meshlet.VertexCount; ++v)
+			localIndex[result.VertexIndices[meshlet.VertexOffset + v]] = ~0u;
+
+		XMVECTOR vMin = XMVectorReplicate(+FLT_MAX);
+		XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+		for(uint32 v = 0; v < meshlet.VertexCount; ++v)
+		{
+			XMVECTOR P = XMLoadFloat3(&meshData.Vertices[result.VertexIndices[meshlet.VertexOffset + v]].Position);
+			vMin = XMVectorMin(vMin, P);
+			vMax = XMVectorMax(vMax, P);
+		}
+
+		XMVECTOR center = 0.5f*(vMin + vMax);
+		float radius = 0.0f;
+		for(uint32 v = 0; v < meshlet.VertexCount; ++v)
+		{
+			XMVECTOR P = XMLoadFloat3(&meshData.Vertices[result.VertexIndices[meshlet.VertexOffset + v]].Position);
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(P - center)));
+		}
+
+		// The cone axis averages the face normals; its spread is the widest of them.
+		std::vector<XMVECTOR> normals;
+		normals.reserve(meshlet.PrimitiveCount);
+		XMVECTOR axis = XMVectorZero();
+		for(uint32 p = 0; p < meshlet.PrimitiveCount; ++p)
+		{
+			uint32 packed = result.PrimitiveIndices[meshlet.PrimitiveOffset + p];
+			XMVECTOR P[3];
+			for(uint32 c = 0; c < 3; ++c)
+			{
+				uint32 v = result.VertexIndices[meshlet.VertexOffset + ((packed >> (10 * c)) & 0x3ff)];
+				P[c] = XMLoadFloat3(&meshData.Vertices[v].Position);
+			}
+
+			XMVECTOR N = XMVector3Cross(P[1] - P[0], P[2] - P[0]);
+			if(XMVectorGetX(XMVector3LengthSq(N)) <= 0.0f)
+				continue;
+
+			N = XMVector3Normalize(N);
+			normals.push_back(N);
+			axis += N;
+		}
+
+		float minDot = -1.0f;
+		if(!normals.empty() && XMVectorGetX(XMVector3LengthSq(axis)) > 0.0f)
+		{
+			axis = XMVector3Normalize(axis);
+			minDot = 1.0f;
+			for(const XMVECTOR& N : normals)
+				minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(N, axis)));
+		}
+		else
+		{
+			axis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		}
+
+		XMStoreFloat3(&meshlet.Center, center);
+		meshlet.Radius = radius;
+		XMStoreFloat3(&meshlet.ConeAxis, axis);
+
+		// Back-facing once the view direction is within 90 degrees less the cone's
+		// half-angle of its axis.
+		meshlet.ConeCutoff = (minDot > 0.0f) ? sqrtf(1.0f - minDot*minDot) : 1.0f;
+
+		result.Meshlets.push_back(meshlet);
+
+		meshlet = Meshlet();
+		meshlet.VertexOffset = (uint32)result.VertexIndices.size();
+		meshlet.PrimitiveOffset = (uint32)result.PrimitiveIndices.size();
+	};
+
+	// DirectXMesh and meshoptimizer do better, reordering for locality; index order
+	// already keeps grids and the generated shapes in compact strips.
+	for(size_t i = 0; i + 2 < meshData.Indices32.size(); i += 3)
+	{
+		const uint32* tri = &meshData.Indices32[i];
+
+		uint32 newVertices = 0;
+		for(uint32 c = 0; c < 3; ++c)
+		{
+			if(localIndex[tri[c]] == ~0u && (c < 1 || tri[c] != tri[0]) && (c < 2 || tri[c] != tri[1]))
+				++newVertices;
+		}
+
+		if(meshlet.VertexCount + newVertices > maxVertices || meshlet.PrimitiveCount + 1 > maxPrimitives)
+			closeMeshlet();
+
+		uint32 packed = 0;
+		for(uint32 c = 0; c < 3; ++c)
+		{
+			if(localIndex[tri[c]] == ~0u)
+			{
+				localIndex[tri[c]] = meshlet.VertexCount++;
+				result.VertexIndices.push_back(tri[c]);
+			}
+
+			packed |= localIndex[tri[c]] << (10 * c);
+		}
+
+		result.PrimitiveIndices.push_back(packed);
+		++meshlet.PrimitiveCount;
+	}
+
+	closeMeshlet();
+
+	return result;
+}
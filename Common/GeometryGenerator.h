@@ -58,6 +58,7 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+        // Only lossless while the mesh has at most 64K vertices.
         std::vector<uint16>& GetIndices16()
         {
 			if(mIndices16.empty())
@@ -74,6 +75,53 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	// A cluster of up to a few hundred triangles with its own small vertex list, as a
+	// mesh shader or a cluster culler consumes it.  Its vertices are the entries
+	// [VertexOffset, VertexOffset + VertexCount) of MeshletData::VertexIndices, and its
+	// triangles the entries [PrimitiveOffset, PrimitiveOffset + PrimitiveCount) of
+	// MeshletData::PrimitiveIndices.
+	struct Meshlet
+	{
+		uint32 VertexOffset = 0;
+		uint32 VertexCount = 0;
+		uint32 PrimitiveOffset = 0;
+		uint32 PrimitiveCount = 0;
+
+		// Bounding sphere, in the mesh's space.
+		DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+
+		// Normal cone: ConeCutoff is the sine of the half-angle of the cone of face
+		// normals around ConeAxis.  A test from Center alone is not conservative, as
+		// triangles away from it can face an eye the centre does not, so BackFacing
+		// widens it by the bounding sphere.  A cutoff of 1 never passes, for meshlets
+		// whose normals spread past a hemisphere.
+		DirectX::XMFLOAT3 ConeAxis = { 0.0f, 1.0f, 0.0f };
+		float ConeCutoff = 1.0f;
+
+		// True if every triangle faces away from eye, given in the mesh's space:
+		// dot(Center - eye, ConeAxis) >= ConeCutoff * length(Center - eye) + Radius.
+		bool BackFacing(const DirectX::XMFLOAT3& eye)const
+		{
+			DirectX::XMVECTOR toCenter = DirectX::XMVectorSubtract(
+				DirectX::XMLoadFloat3(&Center), DirectX::XMLoadFloat3(&eye));
+			float d = DirectX::XMVectorGetX(DirectX::XMVector3Dot(toCenter, DirectX::XMLoadFloat3(&ConeAxis)));
+			return d >= ConeCutoff * DirectX::XMVectorGetX(DirectX::XMVector3Length(toCenter)) + Radius;
+		}
+	};
+
+	struct MeshletData
+	{
+		std::vector<Meshlet> Meshlets;
+
+		// Indices into MeshData::Vertices.
+		std::vector<uint32> VertexIndices;
+
+		// Three 10-bit indices into the meshlet's vertices per triangle, first in the
+		// low bits.
+		std::vector<uint32> PrimitiveIndices;
+	};
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -114,6 +162,25 @@ public:
 	/// Creates a diamond centered at the origin with the given dimensions
 	///</summary>
 	MeshData CreateDiamond(float radius, uint32 sliceCount, uint32 stackCount);
+
+	///<summary>
+	/// Level-of-detail chains of the sphere, geosphere and cylinder.  Element 0 is the
+	/// tessellation asked for; each further level halves the slices and stacks (or
+	/// drops a subdivision).  The chain stops early once the shape is as coarse as it
+	/// can get, so it may hold fewer than lodCount meshes.
+	///</summary>
+	std::vector<MeshData> CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+	std::vector<MeshData> CreateGeosphereLods(float radius, uint32 numSubdivisions, uint32 lodCount);
+	std::vector<MeshData> CreateCylinderLods(float bottomRadius, float topRadius, float height,
+		uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+
+	///<summary>
+	/// Splits a triangle list into meshlets in index order, starting a new one whenever
+	/// the next triangle would take it past maxVertices (at most 256) or maxPrimitives
+	/// (at most 256).  64 and 126 suit most mesh shader hardware.
+	///</summary>
+	MeshletData CreateMeshlets(const MeshData& meshData, uint32 maxVertices, uint32 maxPrimitives);
+
 	void Subdivide(MeshData& meshData);
 private:
 	
@@ -53,6 +53,25 @@ public:
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
+        gUploadBytes += sizeof(T);
+    }
+
+    // Copies count consecutive elements with a single memcpy.  Elements of a constant
+    // buffer are padded, so this is only for tightly packed buffers.
+    void CopyData(int firstElementIndex, const T* data, UINT count)
+    {
+        assert(!mIsConstantBuffer);
+        memcpy(&mMappedData[firstElementIndex*mElementByteSize], data, count*sizeof(T));
+        gUploadBytes += count*sizeof(T);
+    }
+
+    // The mapped elements, for writers that produce their data in place.  Upload heap
+    // memory is write-combined: write it sequentially and never read it back.  Such
+    // writers add what they wrote to gUploadBytes themselves.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
     }
 
 private:
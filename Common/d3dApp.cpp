@@ -35,6 +35,11 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitable != nullptr)
+		CloseHandle(mFrameLatencyWaitable);
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -90,6 +95,10 @@ int D3DApp::Run()
 
 			if( !mAppPaused )
 			{
+				// Wait until the swap chain can take another frame before sampling input.
+				if(mFrameLatencyWaitable != nullptr)
+					WaitForSingleObjectEx(mFrameLatencyWaitable, 1000, true);
+
 				CalculateFrameStats();
 				Update(mTimer);	
                 Draw(mTimer);
@@ -159,7 +168,7 @@ void D3DApp::OnResize()
 		SwapChainBufferCount, 
 		mClientWidth, mClientHeight, 
 		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		SwapChainFlags()));
 
 	mCurrBackBuffer = 0;
  
@@ -242,7 +251,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	//! We pause the game when the window is deactivated and unpause it 
 	//! when it becomes active.  
 	case WM_ACTIVATE:
-		if( LOWORD(wParam) == WA_INACTIVE )
+		if( LOWORD(wParam) == WA_INACTIVE && !mRunWhenInactive )
 		{
 			mAppPaused = true;
 			mTimer.Stop();
@@ -364,6 +373,8 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         }
         else if((int)wParam == VK_F2)
             Set4xMsaaState(!m4xMsaaState);
+        else
+            OnKeyUp(wParam);
 
         return 0;
 	}
@@ -433,6 +444,18 @@ bool D3DApp::InitDirect3D()
      //! (resolution, refresh rate, and such); it also defines the various supported surface formats(DXGI_FORMAT).
 	ThrowIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&mdxgiFactory)));
 
+	//! Tearing needs a DXGI 1.5 factory and a driver/OS that supports it.
+	ComPtr<IDXGIFactory5> factory5;
+	if(SUCCEEDED(mdxgiFactory.As(&factory5)))
+	{
+		BOOL allowTearing = FALSE;
+		if(SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+			&allowTearing, sizeof(allowTearing))))
+		{
+			mTearingSupported = (allowTearing == TRUE);
+		}
+	}
+
 	UINT i = 0;
 	IDXGIAdapter* adapter = nullptr;
 	//! I added this code to take advantage of your "stronger" GPU. 
@@ -465,6 +488,11 @@ bool D3DApp::InitDirect3D()
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
 
+	//! One event for every fence wait, instead of one per wait.
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 	mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -527,6 +555,11 @@ void D3DApp::CreateSwapChain()
 {
     //! Release the previous swapchain we will be recreating.
     mSwapChain.Reset();
+	if(mFrameLatencyWaitable != nullptr)
+	{
+		CloseHandle(mFrameLatencyWaitable);
+		mFrameLatencyWaitable = nullptr;
+	}
 
     DXGI_SWAP_CHAIN_DESC sd;
     sd.BufferDesc.Width = mClientWidth;
@@ -543,13 +576,47 @@ void D3DApp::CreateSwapChain()
     sd.OutputWindow = mhMainWnd;
     sd.Windowed = true;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.Flags = SwapChainFlags();
 
 	// Note: Swap chain uses queue to perform flush.
     ThrowIfFailed(mdxgiFactory->CreateSwapChain(
 		mCommandQueue.Get(),
 		&sd, 
 		mSwapChain.GetAddressOf()));
+
+	//! The latency waitable object lives on the DXGI 1.3 interface.
+	ComPtr<IDXGISwapChain2> swapChain2;
+	ThrowIfFailed(mSwapChain.As(&swapChain2));
+	ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+	mFrameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+}
+
+UINT D3DApp::SwapChainFlags()const
+{
+	//! ResizeBuffers must be given the same waitable/tearing flags as creation.
+	UINT flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH | DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if(mTearingSupported)
+		flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+	return flags;
+}
+
+void D3DApp::SetMaxFrameLatency(UINT latency)
+{
+	mMaxFrameLatency = latency;
+
+	ComPtr<IDXGISwapChain2> swapChain2;
+	ThrowIfFailed(mSwapChain.As(&swapChain2));
+	ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+}
+
+void D3DApp::PresentFrame()
+{
+	//! Tearing is only legal with sync interval 0 and never in exclusive fullscreen.
+	UINT presentFlags = 0;
+	if(mTearingSupported && mTearingEnabled && mSyncInterval == 0 && !mFullscreenState)
+		presentFlags |= DXGI_PRESENT_ALLOW_TEARING;
+
+	ThrowIfFailed(mSwapChain->Present(mSyncInterval, presentFlags));
 }
 
 void D3DApp::FlushCommandQueue()
@@ -563,17 +630,19 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	//! Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
-	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+	WaitForFence(mCurrentFence);
+}
 
-        //! Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+void D3DApp::WaitForFence(UINT64 value)
+{
+    if(mFence->GetCompletedValue() >= value)
+		return;
 
-        //! Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-	}
+    //! Fire event when GPU hits the fence value.
+    ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent));
+
+    //! Wait until the event is fired.
+	WaitForSingleObject(mFenceEvent, INFINITE);
 }
 
 
@@ -613,14 +682,11 @@ void D3DApp::CalculateFrameStats()
 		float fps = (float)frameCnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
 
-        wstring fpsStr = to_wstring(fps);
-        wstring mspfStr = to_wstring(mspf);
-
-        wstring windowText = mMainWndCaption +
-            L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+        // Formatted in place, so the frame loop stays free of heap allocations.
+        wchar_t windowText[256];
+        swprintf_s(windowText, L"%s    fps: %f   mspf: %f", mMainWndCaption.c_str(), fps, mspf);
 
-        SetWindowText(mhMainWnd, windowText.c_str());
+        SetWindowText(mhMainWnd, windowText);
 		
 		// Reset for next average.
 		frameCnt = 0;
@@ -9,6 +9,7 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include <dxgi1_5.h>
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -51,6 +52,9 @@ protected:
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)  { }
 	virtual void OnMouseMove(WPARAM btnState, int x, int y){ }
 
+	// Convenience override for toggles bound to a key release.
+	virtual void OnKeyUp(WPARAM key){ }
+
 protected:
 
 	bool InitMainWindow();
@@ -60,6 +64,16 @@ protected:
 
 	void FlushCommandQueue();
 
+	// Blocks until the fence reaches value, reusing mFenceEvent.  Returns at once if
+	// the GPU is already there.
+	void WaitForFence(UINT64 value);
+
+	// Presents with the current sync interval, allowing tearing when it is enabled and
+	// supported.  Changing the latency takes effect from the next frame.
+	void PresentFrame();
+	void SetMaxFrameLatency(UINT latency);
+	UINT SwapChainFlags()const;
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
@@ -80,6 +94,7 @@ protected:
 	bool      mMinimized = false;  // is the application minimized?
 	bool      mMaximized = false;  // is the application maximized?
 	bool      mResizing = false;   // are the resize bars being dragged?
+	bool      mRunWhenInactive = false; // keep running without focus (unattended runs)
     bool      mFullscreenState = false;// fullscreen enabled
 
 	// Set true to use 4X MSAA.  The default is false.
@@ -95,6 +110,17 @@ protected:
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+	HANDLE mFenceEvent = nullptr;
+
+	// Frame pacing.  Run waits on the swap chain's frame-latency object before each
+	// Update, so the CPU never queues more than mMaxFrameLatency frames and input is
+	// read as late as possible.  Tearing (for variable refresh displays) needs a sync
+	// interval of 0 and a windowed swap chain.
+	HANDLE mFrameLatencyWaitable = nullptr;
+	UINT mMaxFrameLatency = 2;
+	UINT mSyncInterval = 0;
+	bool mTearingSupported = false;
+	bool mTearingEnabled = false;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
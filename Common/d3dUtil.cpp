@@ -2,9 +2,50 @@
 #include "d3dUtil.h"
 #include <comdef.h>
 #include <fstream>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
 
 using Microsoft::WRL::ComPtr;
 
+std::atomic<UINT64> gUploadBytes{ 0 };
+std::atomic<UINT64> gHeapAllocations{ 0 };
+
+// The array, nothrow and sized forms of the CRT forward to these two, or to the aligned
+// pair below for types aligned past __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+void* operator new(std::size_t size)
+{
+    gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* p = std::malloc(size != 0 ? size : 1);
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+// Memory from _aligned_malloc must go back through _aligned_free, never free.
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* p = _aligned_malloc(size != 0 ? size : 1, static_cast<std::size_t>(alignment));
+    if(p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    _aligned_free(p);
+}
+#endif
+
 DxException::DxException(HRESULT hr, const std::wstring& functionName, const std::wstring& filename, int lineNumber) :
     ErrorCode(hr),
     FunctionName(functionName),
@@ -35,6 +76,31 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
     return blob;
 }
 
+ComPtr<ID3DBlob> d3dUtil::PackIndices(const std::uint32_t* indices, size_t count, DXGI_FORMAT format)
+{
+    assert(format == DXGI_FORMAT_R16_UINT || format == DXGI_FORMAT_R32_UINT);
+
+    const size_t indexSize = (format == DXGI_FORMAT_R16_UINT) ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+
+    ComPtr<ID3DBlob> blob;
+    ThrowIfFailed(D3DCreateBlob(count * indexSize, &blob));
+
+    if(format == DXGI_FORMAT_R32_UINT)
+    {
+        CopyMemory(blob->GetBufferPointer(), indices, count * indexSize);
+        return blob;
+    }
+
+    auto indices16 = reinterpret_cast<std::uint16_t*>(blob->GetBufferPointer());
+    for(size_t i = 0; i < count; ++i)
+    {
+        assert(indices[i] <= 0xffff);
+        indices16[i] = static_cast<std::uint16_t>(indices[i]);
+    }
+
+    return blob;
+}
+
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     ID3D12Device* device,
     ID3D12GraphicsCommandList* cmdList,
@@ -78,6 +144,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
 	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
 		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+	gUploadBytes += byteSize;
 
     // Note: uploadBuffer has to be kept alive after the above function calls because
     // the command list has not been executed yet that performs the actual copy.
@@ -21,11 +21,21 @@
 #include <fstream>
 #include <sstream>
 #include <cassert>
+#include <atomic>
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
 
-extern const int gNumFrameResources;
+extern int gNumFrameResources;
+
+// Bytes the CPU has written into upload heaps, summed by UploadBuffer and the texture
+// streamer for frame statistics.  Atomic, since textures are staged on worker threads.
+extern std::atomic<UINT64> gUploadBytes;
+
+// Calls to the global operator new, plain and aligned, which d3dUtil.cpp replaces for
+// the whole program so the frame loop can be checked for heap allocations.
+// Memory the D3D runtime and drivers allocate for themselves is not seen.
+extern std::atomic<UINT64> gHeapAllocations;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -110,6 +120,15 @@ public:
 
 	static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
+	// 16-bit indices while every index a mesh holds fits in them, 32-bit past 64K vertices.
+	static DXGI_FORMAT IndexFormatFor(UINT64 vertexCount)
+	{
+		return (vertexCount <= 0x10000) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	}
+
+	// Narrows indices to format (R16_UINT or R32_UINT) in a new blob.
+	static Microsoft::WRL::ComPtr<ID3DBlob> PackIndices(const std::uint32_t* indices, size_t count, DXGI_FORMAT format);
+
 	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
 		ID3D12Device* device,
 		ID3D12GraphicsCommandList* cmdList,
@@ -193,6 +212,14 @@ struct MeshGeometry
 
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
+	// Index i of the CPU copy, whichever width it was packed at.
+	UINT Index(UINT i)const
+	{
+		if(IndexFormat == DXGI_FORMAT_R32_UINT)
+			return reinterpret_cast<const std::uint32_t*>(IndexBufferCPU->GetBufferPointer())[i];
+		return reinterpret_cast<const std::uint16_t*>(IndexBufferCPU->GetBufferPointer())[i];
+	}
+
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 
 	{
@@ -0,0 +1,171 @@
+//***************************************************************************************
+// Benchmark.cpp
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+	// Nearest-rank percentile of sorted values.
+	double Percentile(const std::vector<double>& sorted, double p)
+	{
+		if(sorted.empty())
+			return 0.0;
+
+		size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.5);
+		rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+		return sorted[rank - 1];
+	}
+}
+
+bool Benchmark::ParseCommandLine(const char* cmdLine, BenchmarkDesc& desc)
+{
+	std::istringstream in(cmdLine != nullptr ? cmdLine : "");
+	bool enabled = false;
+
+	std::string arg;
+	while(in >> arg)
+	{
+		if(arg == "-benchmark")
+		{
+			enabled = true;
+
+			// An optional frame count follows.
+			std::streampos mark = in.tellg();
+			std::string count;
+			if(in >> count && !count.empty() && count[0] != '-')
+				desc.FrameCount = std::max(1, std::atoi(count.c_str()));
+			else
+			{
+				in.clear();
+				in.seekg(mark);
+			}
+		}
+		else if(arg == "-camerapath" && in >> arg)
+		{
+			desc.CameraPath = std::wstring(arg.begin(), arg.end());
+		}
+	}
+
+	return enabled;
+}
+
+Benchmark::Benchmark(const BenchmarkDesc& desc)
+	: mDesc(desc)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mFrequency = frequency.QuadPart;
+
+	mSamples.reserve(mDesc.FrameCount);
+}
+
+const BenchmarkDesc& Benchmark::Desc()const
+{
+	return mDesc;
+}
+
+void Benchmark::SetConfiguration(const std::string& text)
+{
+	mConfiguration = text;
+}
+
+bool Benchmark::EndFrame(UINT drawCalls, UINT64 uploadBytes, UINT64 heapAllocations)
+{
+	if(Done())
+		return false;
+
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+
+	// The first frame has nothing before it to be timed against.
+	bool timed = mFramesSeen++ > mDesc.WarmupFrames;
+	if(timed)
+	{
+		FrameSample s;
+		s.FrameMs = (double)(ticks.QuadPart - mLastTicks) * 1000.0 / (double)mFrequency;
+		s.DrawCalls = drawCalls;
+		s.UploadBytes = uploadBytes;
+		s.HeapAllocations = heapAllocations;
+		mSamples.push_back(s);
+	}
+	mLastTicks = ticks.QuadPart;
+
+	return Done();
+}
+
+bool Benchmark::Done()const
+{
+	return mSamples.size() >= mDesc.FrameCount;
+}
+
+bool Benchmark::WriteReport()const
+{
+	CreateDirectoryW(mDesc.OutputDir.c_str(), nullptr);
+
+	std::string summary = Summary();
+	OutputDebugStringA(summary.c_str());
+
+	std::ofstream report(mDesc.OutputDir + L"\\Report.txt");
+	report << summary;
+
+	std::ofstream frames(mDesc.OutputDir + L"\\Frames.csv");
+	frames << "frame,frame_ms,draw_calls,upload_bytes,heap_allocs\n";
+	frames << std::fixed << std::setprecision(4);
+	for(size_t i = 0; i < mSamples.size(); ++i)
+	{
+		const FrameSample& s = mSamples[i];
+		frames << i << ',' << s.FrameMs << ',' << s.DrawCalls << ',' << s.UploadBytes << ','
+			<< s.HeapAllocations << '\n';
+	}
+
+	return report.good() && frames.good();
+}
+
+std::string Benchmark::Summary()const
+{
+	std::vector<double> frameMs;
+	frameMs.reserve(mSamples.size());
+
+	double totalMs = 0.0;
+	UINT64 totalDrawCalls = 0;
+	UINT64 totalUploadBytes = 0;
+	UINT64 totalHeapAllocations = 0;
+	UINT64 maxHeapAllocations = 0;
+	for(const FrameSample& s : mSamples)
+	{
+		frameMs.push_back(s.FrameMs);
+		totalMs += s.FrameMs;
+		totalDrawCalls += s.DrawCalls;
+		totalUploadBytes += s.UploadBytes;
+		totalHeapAllocations += s.HeapAllocations;
+		maxHeapAllocations = std::max<UINT64>(maxHeapAllocations, s.HeapAllocations);
+	}
+	std::sort(frameMs.begin(), frameMs.end());
+
+	const double n = (double)std::max<size_t>(mSamples.size(), 1);
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	out << "Benchmark: " << mSamples.size() << " frames after " << mDesc.WarmupFrames
+		<< " warm-up, step " << mDesc.TimeStep * 1000.0 << " ms, seed " << mDesc.Seed << "\n";
+	if(!mConfiguration.empty())
+		out << "Settings: " << mConfiguration << "\n";
+	out << "Frame ms: avg " << totalMs / n << "  p50 " << Percentile(frameMs, 50.0)
+		<< "  p99 " << Percentile(frameMs, 99.0)
+		<< "  min " << (frameMs.empty() ? 0.0 : frameMs.front())
+		<< "  max " << (frameMs.empty() ? 0.0 : frameMs.back()) << "\n";
+	out << std::setprecision(1);
+	out << "Draw calls per frame: avg " << totalDrawCalls / n << "\n";
+	out << "Upload bytes per frame: avg " << totalUploadBytes / n
+		<< "  total " << totalUploadBytes << "\n";
+	out << "Heap allocations per frame: avg " << totalHeapAllocations / n
+		<< "  max " << maxHeapAllocations << "\n";
+
+	return out.str();
+}
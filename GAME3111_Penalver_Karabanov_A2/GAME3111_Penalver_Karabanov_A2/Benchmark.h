@@ -0,0 +1,83 @@
+//***************************************************************************************
+// Benchmark.h
+//
+// Unattended, repeatable runs for comparing builds.  The app replays a camera path with
+// a fixed timestep and seeded wave disturbances, so every run renders the same frames;
+// this class times them and counts their draw calls, upload bytes and heap allocations,
+// then reports the average, median and 99th percentile frame times.  Only the
+// wall-clock frame times (and texture streaming, which finishes before the timed
+// frames) vary between runs.
+//
+// Started with "-benchmark [frames] [-camerapath file]" on the command line.
+//***************************************************************************************
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+struct BenchmarkDesc
+{
+	// Timed frames, after the untimed warm-up ones (pipelines, first maze chunks).
+	// Zero runs the camera path once.
+	UINT FrameCount = 0;
+	UINT WarmupFrames = 120;
+
+	double TimeStep = 1.0 / 60.0;
+	std::uint32_t Seed = 3111;
+
+	// The built-in path replaces a missing camera path file.
+	std::wstring CameraPath = L"Benchmark\\CameraPath.txt";
+	std::wstring OutputDir = L"Benchmark";
+};
+
+class Benchmark
+{
+public:
+	// True if cmdLine asks for a benchmark; desc takes its options.
+	static bool ParseCommandLine(const char* cmdLine, BenchmarkDesc& desc);
+
+	explicit Benchmark(const BenchmarkDesc& desc);
+	Benchmark(const Benchmark& rhs) = delete;
+	Benchmark& operator=(const Benchmark& rhs) = delete;
+
+	const BenchmarkDesc& Desc()const;
+
+	// Text for the report's header, e.g. the renderer settings the run used.
+	void SetConfiguration(const std::string& text);
+
+	// Call once per frame, after it is presented.  Returns true on the frame that
+	// completes the run.
+	bool EndFrame(UINT drawCalls, UINT64 uploadBytes, UINT64 heapAllocations);
+	bool Done()const;
+
+	// "Report.txt" with the summary and "Frames.csv" with every timed frame, in the
+	// output directory.  The summary also goes to the debugger output.
+	bool WriteReport()const;
+
+private:
+	struct FrameSample
+	{
+		double FrameMs = 0.0;
+		UINT DrawCalls = 0;
+		UINT64 UploadBytes = 0;
+		UINT64 HeapAllocations = 0;
+	};
+
+	std::string Summary()const;
+
+private:
+	BenchmarkDesc mDesc;
+	std::string mConfiguration;
+
+	LONGLONG mFrequency = 1;
+	LONGLONG mLastTicks = 0;
+	UINT mFramesSeen = 0;
+
+	std::vector<FrameSample> mSamples;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// CameraPath.cpp
+//***************************************************************************************
+
+#include "CameraPath.h"
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <algorithm>
+
+using namespace DirectX;
+
+bool CameraPath::Load(const std::wstring& filename)
+{
+	std::ifstream fin(filename);
+	if(!fin)
+		return false;
+
+	std::vector<CameraKey> keys;
+	std::string line;
+	while(std::getline(fin, line))
+	{
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream in(line);
+		CameraKey k;
+		if(!(in >> k.Time >> k.Position.x >> k.Position.y >> k.Position.z >> k.Look.x >> k.Look.y >> k.Look.z))
+			return false;
+
+		if(!keys.empty() && k.Time <= keys.back().Time)
+			return false;
+
+		keys.push_back(k);
+	}
+
+	if(keys.empty())
+		return false;
+
+	mKeys = std::move(keys);
+	return true;
+}
+
+bool CameraPath::Save(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		return false;
+
+	fout << "# time px py pz lx ly lz\n";
+	for(const CameraKey& k : mKeys)
+	{
+		fout << k.Time << ' ' << k.Position.x << ' ' << k.Position.y << ' ' << k.Position.z << ' '
+			<< k.Look.x << ' ' << k.Look.y << ' ' << k.Look.z << '\n';
+	}
+
+	return fout.good();
+}
+
+void CameraPath::Clear()
+{
+	mKeys.clear();
+}
+
+void CameraPath::AddKey(const CameraKey& key)
+{
+	assert(mKeys.empty() || key.Time > mKeys.back().Time);
+	mKeys.push_back(key);
+}
+
+void CameraPath::SetKeys(const CameraKey* keys, size_t count)
+{
+	mKeys.assign(keys, keys + count);
+}
+
+size_t CameraPath::KeyCount()const
+{
+	return mKeys.size();
+}
+
+float CameraPath::Duration()const
+{
+	return mKeys.empty() ? 0.0f : mKeys.back().Time;
+}
+
+void CameraPath::Sample(float t, XMFLOAT3& position, XMFLOAT3& look)const
+{
+	assert(!mKeys.empty());
+
+	// The first key after t; the segment runs from the key before it.
+	auto next = std::upper_bound(mKeys.begin(), mKeys.end(), t,
+		[](float time, const CameraKey& k) { return time < k.Time; });
+
+	if(next == mKeys.begin() || next == mKeys.end())
+	{
+		const CameraKey& k = (next == mKeys.begin()) ? mKeys.front() : mKeys.back();
+		position = k.Position;
+		look = k.Look;
+		return;
+	}
+
+	size_t i1 = (next - mKeys.begin()) - 1;
+	size_t i2 = i1 + 1;
+	size_t i0 = (i1 > 0) ? i1 - 1 : i1;
+	size_t i3 = (i2 + 1 < mKeys.size()) ? i2 + 1 : i2;
+
+	float s = (t - mKeys[i1].Time) / (mKeys[i2].Time - mKeys[i1].Time);
+
+	XMVECTOR p = XMVectorCatmullRom(XMLoadFloat3(&mKeys[i0].Position), XMLoadFloat3(&mKeys[i1].Position),
+		XMLoadFloat3(&mKeys[i2].Position), XMLoadFloat3(&mKeys[i3].Position), s);
+	XMVECTOR l = XMVector3Normalize(XMVectorLerp(XMLoadFloat3(&mKeys[i1].Look), XMLoadFloat3(&mKeys[i2].Look), s));
+
+	XMStoreFloat3(&position, p);
+	XMStoreFloat3(&look, l);
+}
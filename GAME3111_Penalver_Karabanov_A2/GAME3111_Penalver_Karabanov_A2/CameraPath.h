@@ -0,0 +1,50 @@
+//***************************************************************************************
+// CameraPath.h
+//
+// Timed camera keys, recorded from the free camera or loaded from a text file, and
+// replayed by sampling at a time: Catmull-Rom through the positions, and the normalized
+// blend of the two nearest look directions.
+//
+// The file has one key per line, "time px py pz lx ly lz", in seconds and world units;
+// lines starting with '#' are comments.  Keys must be in increasing time.
+//***************************************************************************************
+
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <vector>
+#include <string>
+#include <DirectXMath.h>
+
+struct CameraKey
+{
+	float Time = 0.0f;
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Look = { 0.0f, 0.0f, 1.0f };
+};
+
+class CameraPath
+{
+public:
+	CameraPath() = default;
+	CameraPath(const CameraPath& rhs) = delete;
+	CameraPath& operator=(const CameraPath& rhs) = delete;
+
+	bool Load(const std::wstring& filename);
+	bool Save(const std::wstring& filename)const;
+
+	void Clear();
+	void AddKey(const CameraKey& key);
+	void SetKeys(const CameraKey* keys, size_t count);
+
+	size_t KeyCount()const;
+	float Duration()const;
+
+	// The camera at time t, clamped to the path.  Needs at least one key.
+	void Sample(float t, DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& look)const;
+
+private:
+	std::vector<CameraKey> mKeys;
+};
+
+#endif // CAMERAPATH_H
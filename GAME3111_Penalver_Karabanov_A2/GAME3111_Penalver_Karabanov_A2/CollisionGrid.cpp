@@ -0,0 +1,180 @@
+//***************************************************************************************
+// CollisionGrid.cpp
+//***************************************************************************************
+
+#include "CollisionGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+void CollisionGrid::Build(const std::vector<BoundingBox>& boxes, float cellSize, std::uint32_t maxCellsPerBox)
+{
+	mBoxes = boxes;
+	mCellSize = cellSize;
+	mLargeItems.clear();
+	mQueryStamp.assign(mBoxes.size(), 0);
+	mQueryId = 0;
+
+	// The grid starts at the corner of the boxes that could fit in maxCellsPerBox cells
+	// however they were aligned; the ones that plainly cannot are left out of it.
+	float minX = FLT_MAX, minZ = FLT_MAX;
+	for(const BoundingBox& b : mBoxes)
+	{
+		float cols = ceilf(2.0f * b.Extents.x / cellSize);
+		float rows = ceilf(2.0f * b.Extents.z / cellSize);
+		if(std::max(cols, 1.0f) * std::max(rows, 1.0f) > (float)maxCellsPerBox)
+			continue;
+
+		minX = std::min(minX, b.Center.x - b.Extents.x);
+		minZ = std::min(minZ, b.Center.z - b.Extents.z);
+	}
+
+	if(minX == FLT_MAX)
+		minX = minZ = 0.0f;
+
+	mMinX = minX;
+	mMinZ = minZ;
+
+	// Now that cells are counted from the grid's corner, split off the boxes that are
+	// too large to bin and find the XZ extent of the rest.
+	std::vector<bool> binned(mBoxes.size(), false);
+	float maxX = minX, maxZ = minZ;
+	for(std::uint32_t i = 0; i < (std::uint32_t)mBoxes.size(); ++i)
+	{
+		const BoundingBox& b = mBoxes[i];
+		float x0 = b.Center.x - b.Extents.x, x1 = b.Center.x + b.Extents.x;
+		float z0 = b.Center.z - b.Extents.z, z1 = b.Center.z + b.Extents.z;
+
+		float cols = floorf((x1 - mMinX) / cellSize) - floorf((x0 - mMinX) / cellSize) + 1.0f;
+		float rows = floorf((z1 - mMinZ) / cellSize) - floorf((z0 - mMinZ) / cellSize) + 1.0f;
+		if(x0 < mMinX || z0 < mMinZ || cols * rows > (float)maxCellsPerBox)
+		{
+			mLargeItems.push_back(i);
+			continue;
+		}
+
+		binned[i] = true;
+		maxX = std::max(maxX, x1);
+		maxZ = std::max(maxZ, z1);
+	}
+
+	// A box ending exactly on a cell boundary still lands in the cell past it.
+	mNumCols = (int)floorf((maxX - minX) / cellSize) + 1;
+	mNumRows = (int)floorf((maxZ - minZ) / cellSize) + 1;
+
+	// Two passes: count the boxes per cell, then scatter them into one flat array.
+	const int cellCount = mNumCols * mNumRows;
+	mCellStart.assign(cellCount + 1, 0);
+
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<std::uint32_t> cursor;
+		if(pass == 1)
+		{
+			for(int c = 0; c < cellCount; ++c)
+				mCellStart[c + 1] += mCellStart[c];
+
+			mCellItems.resize(mCellStart[cellCount]);
+			cursor.assign(mCellStart.begin(), mCellStart.end() - 1);
+		}
+
+		for(std::uint32_t i = 0; i < (std::uint32_t)mBoxes.size(); ++i)
+		{
+			if(!binned[i])
+				continue;
+
+			const BoundingBox& b = mBoxes[i];
+			int col0, row0, col1, row1;
+			if(!CellRange(b.Center.x - b.Extents.x, b.Center.z - b.Extents.z,
+				b.Center.x + b.Extents.x, b.Center.z + b.Extents.z,
+				col0, row0, col1, row1))
+				continue;
+
+			for(int r = row0; r <= row1; ++r)
+			{
+				for(int c = col0; c <= col1; ++c)
+				{
+					int cell = r * mNumCols + c;
+					if(pass == 0)
+						mCellStart[cell + 1]++;
+					else
+						mCellItems[cursor[cell]++] = i;
+				}
+			}
+		}
+	}
+}
+
+void CollisionGrid::Query(FXMVECTOR center, float radius, std::vector<std::uint32_t>& out)
+{
+	// Restart the stamps when the counter wraps.
+	if(++mQueryId == 0)
+	{
+		std::fill(mQueryStamp.begin(), mQueryStamp.end(), 0);
+		mQueryId = 1;
+	}
+
+	for(std::uint32_t i : mLargeItems)
+		out.push_back(i);
+
+	if(mCellItems.empty())
+		return;
+
+	float x = XMVectorGetX(center);
+	float z = XMVectorGetZ(center);
+
+	int col0, row0, col1, row1;
+	if(!CellRange(x - radius, z - radius, x + radius, z + radius, col0, row0, col1, row1))
+		return;
+
+	for(int r = row0; r <= row1; ++r)
+	{
+		for(int c = col0; c <= col1; ++c)
+		{
+			int cell = r * mNumCols + c;
+			for(std::uint32_t k = mCellStart[cell]; k < mCellStart[cell + 1]; ++k)
+			{
+				std::uint32_t i = mCellItems[k];
+				if(mQueryStamp[i] != mQueryId)
+				{
+					mQueryStamp[i] = mQueryId;
+					out.push_back(i);
+				}
+			}
+		}
+	}
+}
+
+std::uint32_t CollisionGrid::BoxCount()const
+{
+	return (std::uint32_t)mBoxes.size();
+}
+
+const BoundingBox& CollisionGrid::Box(std::uint32_t i)const
+{
+	return mBoxes[i];
+}
+
+bool CollisionGrid::CellRange(float minX, float minZ, float maxX, float maxZ,
+	int& col0, int& row0, int& col1, int& row1)const
+{
+	// Cells are counted from the grid's corner, so the ranges do not depend on where it
+	// sits relative to the world origin.
+	float c0 = floorf((minX - mMinX) / mCellSize);
+	float r0 = floorf((minZ - mMinZ) / mCellSize);
+	float c1 = floorf((maxX - mMinX) / mCellSize);
+	float r1 = floorf((maxZ - mMinZ) / mCellSize);
+
+	if(c1 < 0.0f || r1 < 0.0f || c0 >= (float)mNumCols || r0 >= (float)mNumRows)
+		return false;
+
+	// Every binned box lies inside the grid, so the part of a region outside it can
+	// simply be clipped away.
+	col0 = std::max((int)c0, 0);
+	row0 = std::max((int)r0, 0);
+	col1 = std::min((int)c1, mNumCols - 1);
+	row1 = std::min((int)r1, mNumRows - 1);
+	return true;
+}
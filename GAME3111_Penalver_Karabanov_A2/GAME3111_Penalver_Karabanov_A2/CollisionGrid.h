@@ -0,0 +1,63 @@
+//***************************************************************************************
+// CollisionGrid.h
+//
+// Uniform grid over the XZ plane that accelerates camera-vs-wall queries.  The static
+// boxes are binned into cells once at load time; a query then only visits the cells
+// its region overlaps, so the per-frame cost does not grow with the size of the maze.
+//***************************************************************************************
+
+#ifndef COLLISIONGRID_H
+#define COLLISIONGRID_H
+
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class CollisionGrid
+{
+public:
+	CollisionGrid() = default;
+	CollisionGrid(const CollisionGrid& rhs) = delete;
+	CollisionGrid& operator=(const CollisionGrid& rhs) = delete;
+
+	// Bins the boxes into square cells of cellSize units.  Boxes that would cover more
+	// than maxCellsPerBox cells (floors, ceilings) are kept in a separate list that
+	// every query reports.
+	void Build(const std::vector<DirectX::BoundingBox>& boxes, float cellSize, std::uint32_t maxCellsPerBox = 64);
+
+	// Appends to out the indices of the boxes binned into any cell overlapped by the XZ
+	// square [center - radius, center + radius].  Each box is reported at most once.
+	void Query(DirectX::FXMVECTOR center, float radius, std::vector<std::uint32_t>& out);
+
+	std::uint32_t BoxCount()const;
+	const DirectX::BoundingBox& Box(std::uint32_t i)const;
+
+private:
+	// Returns false if the XZ rectangle misses the grid; otherwise clips it to the grid.
+	bool CellRange(float minX, float minZ, float maxX, float maxZ,
+		int& col0, int& row0, int& col1, int& row1)const;
+
+private:
+	std::vector<DirectX::BoundingBox> mBoxes;
+
+	float mMinX = 0.0f;
+	float mMinZ = 0.0f;
+	float mCellSize = 1.0f;
+	int mNumCols = 1;
+	int mNumRows = 1;
+
+	// Cell i owns mCellItems[mCellStart[i]] .. mCellItems[mCellStart[i+1] - 1].
+	std::vector<std::uint32_t> mCellStart;
+	std::vector<std::uint32_t> mCellItems;
+
+	// Boxes too large to bin; tested by every query.
+	std::vector<std::uint32_t> mLargeItems;
+
+	// Per-box stamp of the last query that reported it, so boxes spanning several
+	// cells are only returned once.
+	std::vector<std::uint32_t> mQueryStamp;
+	std::uint32_t mQueryId = 0;
+};
+
+#endif // COLLISIONGRID_H
@@ -0,0 +1,189 @@
+//***************************************************************************************
+// DepthPyramid.cpp
+//***************************************************************************************
+
+#include "DepthPyramid.h"
+#include <cassert>
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+DepthPyramid::DepthPyramid(ID3D12Device* device, UINT width, UINT height)
+{
+	md3dDevice = device;
+
+	mWidth = width;
+	mHeight = height;
+
+	BuildResource();
+}
+
+UINT DepthPyramid::MipCount()const
+{
+	return mMipCount;
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE DepthPyramid::Srv()const
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mGpuDescriptor, 1, mDescriptorSize);
+}
+
+UINT DepthPyramid::DescriptorCount()const
+{
+	return 2 + 2 * MaxMipCount;
+}
+
+void DepthPyramid::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize,
+	ID3D12Resource* depthBuffer)
+{
+	// Save references to the descriptors, so they can be rewritten on resize.
+	mCpuDescriptor = hCpuDescriptor;
+	mGpuDescriptor = hGpuDescriptor;
+	mDescriptorSize = descriptorSize;
+
+	BuildDescriptors(depthBuffer);
+}
+
+void DepthPyramid::OnResize(UINT width, UINT height, ID3D12Resource* depthBuffer)
+{
+	if((mWidth != width) || (mHeight != height))
+	{
+		mWidth = width;
+		mHeight = height;
+
+		BuildResource();
+	}
+
+	BuildDescriptors(depthBuffer);
+}
+
+void DepthPyramid::BuildDescriptors(ID3D12Resource* depthBuffer)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC depthSrvDesc = {};
+	depthSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	depthSrvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	depthSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	depthSrvDesc.Texture2D.MostDetailedMip = 0;
+	depthSrvDesc.Texture2D.MipLevels = 1;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = mMipCount;
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor = mCpuDescriptor;
+	md3dDevice->CreateShaderResourceView(depthBuffer, &depthSrvDesc, hDescriptor);
+	md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc, hDescriptor.Offset(1, mDescriptorSize));
+
+	// Each reduction reads the mip before it through its own single-mip SRV.
+	srvDesc.Texture2D.MipLevels = 1;
+	for(UINT i = 0; i < mMipCount; ++i)
+	{
+		srvDesc.Texture2D.MostDetailedMip = i;
+		uavDesc.Texture2D.MipSlice = i;
+
+		md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc, hDescriptor.Offset(1, mDescriptorSize));
+		md3dDevice->CreateUnorderedAccessView(mPyramid.Get(), nullptr, &uavDesc, hDescriptor.Offset(1, mDescriptorSize));
+	}
+}
+
+void DepthPyramid::Execute(
+	ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	ID3D12Resource* depthBuffer)
+{
+	D3D12_RESOURCE_BARRIER toRead[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(depthBuffer,
+			D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+	};
+	cmdList->ResourceBarrier(_countof(toRead), toRead);
+
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetPipelineState(pso);
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE src = mGpuDescriptor;
+	UINT srcSize[2] = { mWidth, mHeight };
+
+	// Mip 0 rounds the depth buffer's size up; below that D3D12 sizes mip i as
+	// max(1, size0 >> i), which the shaders must agree with.
+	const UINT size0[2] = { (mWidth + 1) / 2, (mHeight + 1) / 2 };
+
+	for(UINT i = 0; i < mMipCount; ++i)
+	{
+		CD3DX12_GPU_DESCRIPTOR_HANDLE srv(mGpuDescriptor, 2 + 2 * i, mDescriptorSize);
+		CD3DX12_GPU_DESCRIPTOR_HANDLE uav(mGpuDescriptor, 3 + 2 * i, mDescriptorSize);
+
+		// Must match cbPyramid in DepthPyramid.hlsl.
+		UINT sizes[4] = { srcSize[0], srcSize[1], std::max<UINT>(size0[0] >> i, 1), std::max<UINT>(size0[1] >> i, 1) };
+		cmdList->SetComputeRoot32BitConstants(0, 4, sizes, 0);
+
+		cmdList->SetComputeRootDescriptorTable(1, src);
+		cmdList->SetComputeRootDescriptorTable(2, uav);
+
+		// 8x8 texels per group.
+		cmdList->Dispatch((sizes[2] + 7) / 8, (sizes[3] + 7) / 8, 1);
+
+		// The next level reads this one.
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, i));
+
+		src = srv;
+		srcSize[0] = sizes[2];
+		srcSize[1] = sizes[3];
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(depthBuffer,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+}
+
+void DepthPyramid::BuildResource()
+{
+	// Mip 0 is half the depth buffer, rounded up; the full chain below it then has
+	// floor(log2(max(w, h))) + 1 levels, as D3D12 halves rounding down.
+	const UINT width0 = (mWidth + 1) / 2;
+	const UINT height0 = (mHeight + 1) / 2;
+
+	mMipCount = 1;
+	for(UINT w = width0, h = height0; (w | h) > 1; ++mMipCount)
+	{
+		w = std::max<UINT>(w / 2, 1);
+		h = std::max<UINT>(h / 2, 1);
+	}
+	assert(mMipCount <= MaxMipCount);
+
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = width0;
+	texDesc.Height = height0;
+	texDesc.DepthOrArraySize = 1;
+	texDesc.MipLevels = (UINT16)mMipCount;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+	// Nothing reads it before the first Execute writes every mip.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		IID_PPV_ARGS(&mPyramid)));
+}
@@ -0,0 +1,77 @@
+//***************************************************************************************
+// DepthPyramid.h
+//
+// A hierarchical-Z buffer: a mip chain of R32_FLOAT textures in which every texel holds
+// the farthest depth of the 2x2 texels under it, built from the depth buffer by the
+// compute shader in DepthPyramid.hlsl.  Mip 0 is half the depth buffer's size, rounded
+// up, so texel (x, y) of mip m covers pixels [x, x+1) * 2^(m+1) of the depth buffer;
+// the mips below halve rounding down, and their last row and column cover the rest.
+//
+// A box whose nearest depth is behind the farthest depth over its screen rectangle is
+// hidden; a couple of texels of the right mip answer that for any size of rectangle.
+// The depth buffer must be single-sampled and created typeless, as D3DApp does.
+//***************************************************************************************
+
+#ifndef DEPTHPYRAMID_H
+#define DEPTHPYRAMID_H
+
+#include "../../Common/d3dUtil.h"
+
+class DepthPyramid
+{
+public:
+	// width and height are the depth buffer's.
+	DepthPyramid(ID3D12Device* device, UINT width, UINT height);
+	DepthPyramid(const DepthPyramid& rhs) = delete;
+	DepthPyramid& operator=(const DepthPyramid& rhs) = delete;
+	~DepthPyramid() = default;
+
+	// Enough levels for a 64K x 64K depth buffer.
+	static const UINT MaxMipCount = 16;
+
+	UINT MipCount()const;
+
+	// SRV of the whole chain, for the occlusion test.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv()const;
+
+	// An SRV of the depth buffer, an SRV of the chain, then an SRV and a UAV per mip
+	// for MaxMipCount mips, so a resize never needs more.
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize,
+		ID3D12Resource* depthBuffer);
+
+	// The depth buffer is recreated on every resize, so its SRV is always rewritten.
+	void OnResize(UINT width, UINT height, ID3D12Resource* depthBuffer);
+
+	// Records the pyramid's build from the depth buffer, which must be in DEPTH_WRITE
+	// and is left there.  The pyramid rests in NON_PIXEL_SHADER_RESOURCE.  The caller
+	// must have set the heap that holds the descriptors.
+	void Execute(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		ID3D12Resource* depthBuffer);
+
+private:
+	void BuildResource();
+	void BuildDescriptors(ID3D12Resource* depthBuffer);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	UINT mMipCount = 0;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mCpuDescriptor;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mGpuDescriptor;
+	UINT mDescriptorSize = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPyramid = nullptr;
+};
+
+#endif // DEPTHPYRAMID_H
@@ -1,30 +1,41 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT materialCount, UINT waveVertCount, UINT instanceCount, UINT commandCount,
+    UINT layerCmdListCount, UINT lightCount, UINT treeCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-  //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_COMPUTE,
+		IID_PPV_ARGS(ComputeCmdListAlloc.GetAddressOf())));
 
-    WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
-}
+    LayerCmdListAllocs.resize(layerCmdListCount);
+    LayerCmdLists.resize(layerCmdListCount);
+    for(UINT i = 0; i < layerCmdListCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(LayerCmdListAllocs[i].GetAddressOf())));
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
-{
-	ThrowIfFailed(device->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+        ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+            LayerCmdListAllocs[i].Get(), nullptr, IID_PPV_ARGS(LayerCmdLists[i].GetAddressOf())));
 
-	//  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+        // Closed until the frame that records it resets it.
+        ThrowIfFailed(LayerCmdLists[i]->Close());
+    }
 
+    ConstantAllocator = std::make_unique<UploadAllocator>(device);
+    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
+    MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
+    VisibleInstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, std::max<UINT>(instanceCount, 1), false);
+    IndirectCommands = std::make_unique<UploadBuffer<IndirectCommand>>(device, std::max<UINT>(commandCount, 1), false);
+    LightBuffer = std::make_unique<UploadBuffer<Light>>(device, std::max<UINT>(lightCount, 1), false);
+    TreeInstanceBuffer = std::make_unique<UploadBuffer<TreeInstance>>(device, std::max<UINT>(treeCount, 1), false);
+    OverlayGlyphs = std::make_unique<UploadBuffer<OverlayGlyph>>(device, MaxOverlayGlyphs, false);
+
+    WavesVB = std::make_unique<UploadBuffer<WaveVertex>>(device, waveVertCount, false);
 }
 
 FrameResource::~FrameResource()
@@ -3,11 +3,129 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "Waves.h"
+#include "TextOverlay.h"
+#include "UploadAllocator.h"
+
+// Light clustering, mirrored in LightingUtil.hlsl.  The view frustum is cut into
+// ClusterGridX x ClusterGridY screen tiles and ClusterGridZ depth slices, spaced
+// exponentially between the near and far planes, and each cluster lists up to
+// MaxLightsPerCluster of the point and spot lights that reach it.  A cluster takes
+// ClusterStride uints of the cluster buffer: its light count and then the indices.
+#define MaxDirLights 3
+#define ClusterGridX 16
+#define ClusterGridY 9
+#define ClusterGridZ 24
+#define ClusterCount (ClusterGridX * ClusterGridY * ClusterGridZ)
+#define MaxLightsPerCluster 63
+#define ClusterStride (MaxLightsPerCluster + 1)
+
+// Levels in a mesh's LOD chain, finest first, mirrored in FrustumCull.hlsl.
+#define MaxMeshLods 3
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+    // Only used by the displacement-mapped wave grid.
+    float GridSpatialStep = 1.0f;
+    float ObjPad0 = 0.0f;
+    float ObjPad1 = 0.0f;
+    float ObjPad2 = 0.0f;
+};
+
+// Per-instance data for the instanced draw path.  Batches index it with
+// SV_InstanceID instead of binding one ObjectCB per draw.  The world-space
+// bounds and command index are only read by the GPU frustum cull.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+    DirectX::XMFLOAT3 BoundsCenter = { 0.0f, 0.0f, 0.0f };
+    UINT MaterialIndex = 0;
+    DirectX::XMFLOAT3 BoundsExtents = { 0.0f, 0.0f, 0.0f };
+    UINT CommandIndex = 0;
+};
+
+// Material constants for the bindless path, all in one structured buffer indexed by
+// MatCBIndex.  DiffuseMapIndex is the texture's slot in the descriptor heap.
+struct MaterialData
+{
+    DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+    DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+    float Roughness = 0.5f;
+    DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+    UINT DiffuseMapIndex = 0;
+    UINT MatPad0 = 0;
+    UINT MatPad1 = 0;
+    UINT MatPad2 = 0;
+};
+
+// One ExecuteIndirect command per LOD of each instance batch: rebinds the instance SRV
+// and material CBV, then draws.  InstanceCount is filled in by the cull shader.
+// FirstInstance and the batch's LodCount sit in the stride padding; the command
+// signature skips them.
+struct IndirectCommand
+{
+    D3D12_GPU_VIRTUAL_ADDRESS InstanceSrv = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS MaterialCbv = 0;
+    D3D12_DRAW_INDEXED_ARGUMENTS DrawArgs = {};
+    UINT FirstInstance = 0;
+    UINT LodCount = 1;
+};
+
+struct CullConstants
+{
+    // World-space planes, normals pointing into the frustum.
+    DirectX::XMFLOAT4 FrustumPlanes[6];
+    UINT InstanceCount = 0;
+    UINT CommandStride = 0;
+    UINT InstanceCountOffset = 0;
+    UINT FirstInstanceOffset = 0;
+
+    // An instance's screen size is its bounding radius times LodScale (Proj(1,1)) over
+    // its distance from the eye: its diameter as a fraction of the screen height.  It
+    // drops to LOD i+1 below LodScreenSizes[i].
+    DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+    float LodScale = 1.0f;
+    float LodScreenSizes[MaxMeshLods - 1] = {};
+    UINT LodCountOffset = 0;
+    UINT CullPad0 = 0;
+
+    // The depth pyramid is built from the previous frame, so its boxes are projected
+    // with that frame's view-projection.  OcclusionEnabled is 0 when no pyramid was.
+    DirectX::XMFLOAT4X4 OcclusionViewProj = MathHelper::Identity4x4();
+    INT DepthWidth = 0;
+    INT DepthHeight = 0;
+    UINT PyramidMipCount = 0;
+    UINT OcclusionEnabled = 0;
+};
+
+// One billboard tree, expanded from the shared quad by SV_InstanceID.  Fade drops
+// from 1 to 0 over the LOD fade band and dithers the tree out.
+struct TreeInstance
+{
+    DirectX::XMFLOAT3 Pos = { 0.0f, 0.0f, 0.0f };
+    float Fade = 1.0f;
+    DirectX::XMFLOAT2 Size = { 1.0f, 1.0f };
+    UINT Slice = 0;
+    UINT TreePad0 = 0;
+};
+
+struct ClusterConstants
+{
+    DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
+
+    // Proj(0,0) and Proj(1,1): view-space x/z and y/z at the edges of the screen.
+    float ProjScaleX = 1.0f;
+    float ProjScaleY = 1.0f;
+    float NearZ = 1.0f;
+    float FarZ = 1000.0f;
+    UINT LightCount = 0;
+    UINT ClusterPad0 = 0;
+    UINT ClusterPad1 = 0;
+    UINT ClusterPad2 = 0;
 };
 
 struct PassConstants
@@ -34,11 +152,15 @@ struct PassConstants
 	float gFogRange = 150.0f;
 	DirectX::XMFLOAT2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light Lights[MaxLights];
+    // FrameResource::LightBuffer holds the point lights and then the spot lights.
+    // A view-space depth z is in cluster slice log(z)*ClusterSliceScale + ClusterSliceBias.
+    UINT PointLightCount = 0;
+    UINT SpotLightCount = 0;
+    float ClusterSliceScale = 0.0f;
+    float ClusterSliceBias = 0.0f;
+
+    // Directional lights reach everything, so they skip the clusters.
+    Light DirLights[MaxDirLights];
 };
 
 struct Vertex
@@ -54,8 +176,8 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT materialCount, UINT waveVertCount, UINT instanceCount, UINT commandCount,
+        UINT layerCmdListCount, UINT lightCount, UINT treeCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -64,16 +186,55 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // For the frame's work on the compute queue.  The frame's draws wait for it, so it
+    // is done once the frame's fence has passed.
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> ComputeCmdListAlloc;
+
+    // One allocator and list per recording thread for the scene layers.  The lists
+    // are created closed; each is reset by the thread that records it.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> LayerCmdListAllocs;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> LayerCmdLists;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-   // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+    // that reference it.  So each frame needs their own cbuffers.  The pass, cull and
+    // cluster constants, and the object constants of the items drawn one by one, are
+    // sub-allocated here every frame, as is the staging for changed instances; it is
+    // reset after the frame's fence wait.
+    std::unique_ptr<UploadAllocator> ConstantAllocator = nullptr;
+
+    // Kept per material and rewritten only when one changes: the ExecuteIndirect
+    // commands hold their addresses.
     std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+
+    // The same materials as MaterialCB, read through a root SRV by the bindless PSOs.
+    std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
+
+    // Instances that passed the CPU frustum cull, compacted per batch.
+    std::unique_ptr<UploadBuffer<InstanceData>> VisibleInstanceBuffer = nullptr;
+
+    // ExecuteIndirect commands with InstanceCount = 0, copied into the GPU
+    // argument buffer before each cull dispatch.  Written once at load time.
+    std::unique_ptr<UploadBuffer<IndirectCommand>> IndirectCommands = nullptr;
+
+    // The GPU cull's outputs, in default heaps created with the command templates.  One
+    // copy per frame resource, so a cull on the compute queue never writes what the
+    // previous frame's draws are still reading.  Both rest in the COMMON state.
+    Microsoft::WRL::ComPtr<ID3D12Resource> CulledInstanceBuffer = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> IndirectCommandBuffer = nullptr;
+
+    // Point and spot lights, binned into the clusters by the light cull and indexed
+    // through them by the lit pixel shaders.
+    std::unique_ptr<UploadBuffer<Light>> LightBuffer = nullptr;
+
+    // Trees within the fade distance that passed the frustum test, rewritten every frame.
+    std::unique_ptr<UploadBuffer<TreeInstance>> TreeInstanceBuffer = nullptr;
+
+    // Quads of the text overlay, laid out anew every frame.
+    std::unique_ptr<UploadBuffer<OverlayGlyph>> OverlayGlyphs = nullptr;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    std::unique_ptr<UploadBuffer<WaveVertex>> WavesVB = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
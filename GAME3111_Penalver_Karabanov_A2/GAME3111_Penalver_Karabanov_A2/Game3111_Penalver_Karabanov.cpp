@@ -9,6 +9,23 @@
 #include "../../Common/Camera.h"
 #include "FrameResource.h"
 #include "Waves.h"
+#include "GpuWaves.h"
+#include "Terrain.h"
+#include "DepthPyramid.h"
+#include "CollisionGrid.h"
+#include "SphereSweep.h"
+#include "SceneFile.h"
+#include "MazeGenerator.h"
+#include "GeometryRegistry.h"
+#include "TextureStreamer.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "TextOverlay.h"
+#include "CameraPath.h"
+#include "Benchmark.h"
+#include <ppl.h>
+#include <cstring>
+#include <random>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,7 +34,97 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
+// Frame resources in the ring.  All gMaxFrameResources are allocated up front and R
+// changes how many are cycled, trading input latency against CPU/GPU overlap.
+int gNumFrameResources = 3;
+const int gMaxFrameResources = 4;
+
+// Command lists each frame resource owns for recording the scene layers in parallel.
+const int gNumLayerCmdLists = 4;
+
+// Baked level.  When it is missing or stale it is rebuilt from the hand-placed builders.
+// Bump gSceneBuilderRevision with any change to what the BuildRender* builders place;
+// it is hashed with the geometry and materials they draw from (SceneSourceHash).
+const wchar_t* const gSceneFile = L"Scenes\\Castle.scene";
+const std::uint32_t gSceneBuilderRevision = 1;
+
+// Billboard trees: the hand-placed ones around the castle, then the rings scattered
+// about it.  Every tree stands on the ground at y = 0.5 and cycles through the three
+// slices of the tree texture array in placement order.
+const XMFLOAT2 gTreePositions[] =
+{
+	{ -140.0f, -140.0f }, { 140.0f, -140.0f }, { 140.0f, 140.0f }, { -140.0f, 140.0f }, { -140.0f, 30.0f },
+	{ 140.0f, 30.0f }, { -140.0f, -60.0f }, { 140.0f, -60.0f }, { 20.0f, 110.0f }, { -20.0f, 120.0f },
+	{ 40.0f, 120.0f }, { -40.0f, 110.0f }, { 60.0f, 100.0f }, { -60.0f, 120.0f }, { 40.0f, 90.0f },
+	{ 20.0f, 80.0f }, { 50.0f, 80.0f }, { -60.0f, 70.0f }, { -40.0f, 70.0f }, { -10.0f, 85.0f },
+	{ -80.0f, 35.0f }, { -85.0f, 5.0f }, { -70.0f, 40.0f }, { -95.0f, 15.0f }, { -75.0f, -10.0f },
+	{ -80.0f, -36.0f }, { 80.0f, 35.0f }, { 105.0f, 5.0f }, { 70.0f, 40.0f }, { 95.0f, 15.0f },
+	{ 75.0f, -10.0f }, { 120.0f, -36.0f }, { 110.0f, 35.0f }, { 135.0f, 15.0f }, { 150.0f, 40.0f },
+	{ 125.0f, 15.0f }, { 105.0f, -10.0f }, { -100.0f, -106.0f }, { -75.0f, -90.0f }, { -120.0f, -66.0f },
+	{ -110.0f, -35.0f }, { 135.0f, -75.0f }, { 150.0f, -80.0f }, { -125.0f, -85.0f }, { -105.0f, -80.0f },
+	{ -120.0f, -66.0f }, { 85.0f, -125.0f }, { 90.0f, -90.0f }, { -125.0f, -85.0f }, { -105.0f, -80.0f },
+	{ 120.0f, -126.0f }
+};
+
+// Benchmark flight when no recorded path is found: round the castle, then south low
+// over the wall tops of the maze.
+const CameraKey gBenchmarkPath[] =
+{
+	{ 0.0f, { 0.0f, 20.0f, -400.0f }, { 0.0f, 0.0f, 1.0f } },
+	{ 8.0f, { 0.0f, 35.0f, -180.0f }, { 0.0f, -0.15f, 1.0f } },
+	{ 14.0f, { 80.0f, 30.0f, -300.0f }, { 0.3f, -0.1f, -1.0f } },
+	{ 22.0f, { 0.0f, 20.0f, -500.0f }, { 0.0f, -0.2f, -1.0f } },
+	{ 34.0f, { -220.0f, 18.0f, -780.0f }, { -0.6f, -0.15f, -0.8f } },
+	{ 46.0f, { -120.0f, 18.0f, -1150.0f }, { 0.3f, -0.15f, -1.0f } },
+	{ 58.0f, { 280.0f, 18.0f, -1450.0f }, { 0.8f, -0.15f, -0.6f } },
+	{ 70.0f, { 520.0f, 45.0f, -1900.0f }, { 0.2f, -0.35f, -1.0f } }
+};
+const XMFLOAT2 gTreeSize = { 20.0f, 20.0f };
+
+// Count trees at random points of the ring between InnerRadius and OuterRadius, each
+// as wide as it is tall, with the size picked between MinSize and MaxSize.
+struct TreeScatter
+{
+	float InnerRadius;
+	float OuterRadius;
+	UINT Count;
+	float MinSize;
+	float MaxSize;
+};
+const TreeScatter gTreeScatters[] =
+{
+	// Bushes between the castle walls and the hand-placed trees.
+	{ 65.0f, 155.0f, 600, 6.0f, 10.0f },
+	// Palms out to the shore.
+	{ 160.0f, 235.0f, 1800, 16.0f, 26.0f }
+};
+const std::uint32_t gTreeScatterSeed = 3111;
+
+// Trees fade out (dithered) between gTreeFadeStart and gTreeFadeEnd from the eye,
+// a little before the fog hides them, and are not drawn past it.
+const float gTreeFadeStart = 300.0f;
+const float gTreeFadeEnd = 400.0f;
+
+// Screen sizes (bounding diameter over screen height) below which a mesh with a LOD
+// chain drops to its next level; see CullConstants.
+const float gLodScreenSizes[MaxMeshLods - 1] = { 0.2f, 0.07f };
+
+// Room above and below the flat GPU waves grid for the displacement, when its meshlets
+// are culled; well past what the disturbances build up.
+const float gGpuWavesMaxHeight = 10.0f;
+
+// A range of a submesh's indices, relative to its StartIndexLocation.
+struct IndexRun
+{
+	UINT StartIndex = 0;
+	UINT IndexCount = 0;
+};
+
+// A LOD chain's coarser levels sit next to its submesh in DrawArgs as "<name>_LOD<n>".
+std::string LodSubmeshName(const std::string& submesh, UINT lod)
+{
+	return (lod == 0) ? submesh : submesh + "_LOD" + std::to_string(lod);
+}
 float rotAngle = 1;
 
 struct RenderItem
@@ -25,21 +132,126 @@ struct RenderItem
 	RenderItem() = default;
     XMFLOAT4X4 World = MathHelper::Identity4x4();
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-	int NumFramesDirty = gNumFrameResources;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Queued in mDirtyRitems for its instance data to be copied to the GPU (MarkRitemDirty).
+	bool InstanceDirty = false;
+
+	// Stable index of the item, as saved in the scene file.  Its object constants are
+	// allocated afresh each frame it is drawn on its own (UploadObjectConstants).
 	UINT ObjCBIndex = -1;
+
+	// Index into the per-frame instance buffer, if the item is drawn through an InstanceBatch,
+	// and the slot of that batch's ExecuteIndirect command.
+	UINT InstanceIndex = -1;
+	UINT CommandIndex = 0;
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 	BoundingBox Bounds;
+
+	// Local-space box of the submesh and its world-space box for frustum culling.
+	// Items without CPU-side geometry (the dynamic waves) are never culled; the tree
+	// sprites are culled tree by tree into their instance buffer instead.
+	BoundingBox LocalBounds;
+	BoundingBox CullBounds;
+	bool Cullable = false;
+
+	// False for streamed maze walls whose chunk is not loaded.  They are skipped by the
+	// cull and collision, and parked with a zero-scale World and an unreachable
+	// CullBounds for the instanced paths that draw whole batches.
+	bool Active = true;
+
+	// Distance between grid vertices, for the displacement-mapped wave normals.
+	float GridSpatialStep = 1.0f;
+
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
+	UINT InstanceCount = 1;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
-	
+
+	// The submesh's LOD chain, finest first, when it has more than one level.  The cull
+	// picks Lod each frame by screen size and copies it into the parameters above; it
+	// is MaxMeshLods while the item is culled from an instance batch.
+	SubmeshGeometry Lods[MaxMeshLods];
+	UINT LodCount = 1;
+	UINT Lod = 0;
+
+	// Drawn instead of the whole submesh when set: the runs of a clustered mesh that
+	// passed the cull this frame (the GPU waves' meshlets).
+	const std::vector<IndexRun>* Clusters = nullptr;
+};
+
+// Per-frame motion of an animated render item: a spin about +y at AngularSpeed degrees
+// per second, plus an optional eased slide of SlideDistance along SlideAxis.
+// AnimateRenderItems rebuilds World and moves the collision Bounds with the slide.
+struct RenderItemAnimation
+{
+	RenderItem* Ritem = nullptr;
+	XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+	XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	float StartAngle = 0.0f;
+	float AngularSpeed = 0.0f;
+
+	// Bounds.Center at rest; only used by a slide.
+	XMFLOAT3 BoundsCenter = { 0.0f, 0.0f, 0.0f };
+
+	XMFLOAT3 SlideAxis = { 0.0f, 0.0f, 0.0f };
+	float SlideDistance = 0.0f;
+	float SlidePeriod = 0.0f;
+};
+
+// Render items of one layer that share geometry, submesh and material, drawn with a
+// single DrawIndexedInstanced.  Their InstanceData is contiguous in the per-frame
+// instance buffer, starting at FirstInstance.
+struct InstanceBatch
+{
+	MeshGeometry* Geo = nullptr;
+	Material* Mat = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	UINT FirstInstance = 0;
+	std::vector<RenderItem*> Instances;
+
+	// The items' LOD chain; Lods[0] is the submesh above.  Each LOD is a draw of its own.
+	SubmeshGeometry Lods[MaxMeshLods];
+	UINT LodCount = 1;
+
+	// Slot of the batch's first command in the ExecuteIndirect argument buffer; its
+	// other LODs' commands follow.  Each command appends to its own batch-sized range
+	// of the culled instance buffer, the first starting at CulledFirstInstance.
+	UINT CommandIndex = 0;
+	UINT CulledFirstInstance = 0;
+
+	// Instances that survived the CPU cull this frame, in all and per LOD; the visible
+	// instances are compacted LOD by LOD.
+	UINT VisibleCount = 0;
+	UINT LodVisibleCounts[MaxMeshLods] = {};
+};
+
+// Where render items are tested against the camera frustum.
+enum class CullMode : int
+{
+	None = 0,
+	// Every item is tested on the CPU; batches draw only their visible instances.
+	Cpu,
+	// Instance batches are culled by a compute shader feeding ExecuteIndirect; the
+	// remaining layers are still tested on the CPU.
+	Gpu
+};
+
+// How camera movement is checked against the walls.
+enum class CollisionMode : int
+{
+	// Six kHitDist rays along look/right/up block whole movement keys.
+	Rays = 0,
+	// The camera is a sphere swept along its full movement and slides along walls.
+	SweptSphere
 };
 
 enum class RenderLayer : int
@@ -48,13 +260,87 @@ enum class RenderLayer : int
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	Waves,
+	GpuWaves,
+	Terrain,
 	Count
 };
 
+// Profiler scope names of each layer's draws and of its depth pre-pass.
+const char* const gLayerScopeNames[(int)RenderLayer::Count] =
+{
+	"Opaque", "Transparent", "Alpha tested", "Tree sprites", "Waves", "GPU waves", "Terrain"
+};
+const char* const gPrePassScopeNames[(int)RenderLayer::Count] =
+{
+	"Opaque depth", "Transparent depth", "Alpha tested depth", "Tree sprites depth", "Waves depth", "GPU waves depth", "Terrain depth"
+};
+
+// A contiguous range of one layer's draws (render items, or instance batches for the
+// instanced layers), recorded into the layer command list List.
+struct DrawChunk
+{
+	RenderLayer Layer = RenderLayer::Opaque;
+	bool PrePass = false;
+	UINT List = 0;
+	UINT Begin = 0;
+	UINT End = 0;
+
+	// The last chunk of the opaque layers builds the depth pyramid after its draws.
+	bool BuildsDepthPyramid = false;
+};
+
+// The PSO each layer draws with for one combination of the layer toggles; PrePass is
+// only filled for the layers the depth pre-pass covers.
+struct LayerPipelines
+{
+	ID3D12PipelineState* Layers[(int)RenderLayer::Count] = {};
+	ID3D12PipelineState* PrePass[(int)RenderLayer::Count] = {};
+};
+
+// Position of a visible render item in its layer's draw order; see SortVisibleRitems.
+struct DrawSortEntry
+{
+	std::uint64_t Key = 0;
+	RenderItem* Ritem = nullptr;
+};
+
+// A fixed range of maze wall items, mMazeWallItems[FirstItem, FirstItem +
+// MaxWallsPerChunk), that holds one loaded chunk at a time.
+struct MazeChunkSlot
+{
+	int ChunkX = 0;
+	int ChunkZ = 0;
+	bool Loaded = false;
+	UINT FirstItem = 0;
+	UINT WallCount = 0;
+
+	// Point lights on the walls of the loaded chunk.
+	std::vector<Light> Torches;
+};
+
+// A texture of the SRV heap, which holds them in LoadTextures order; a material's
+// DiffuseSrvHeapIndex is its texture's position.  StreamId is its TextureStreamer entry.
+struct TextureSlot
+{
+	std::string Name;
+	bool IsArray = false;
+	UINT StreamId = 0;
+};
+
+// Where the wave simulation runs.
+enum class WaveMode : int
+{
+	// Waves solves on the CPU and every vertex is uploaded each frame.
+	Cpu = 0,
+	// GpuWaves solves in compute and a static grid is displaced in the vertex shader.
+	Gpu
+};
+
 class FinalApp : public D3DApp
 {
 public:
-    FinalApp(HINSTANCE hInstance);
+    FinalApp(HINSTANCE hInstance, const BenchmarkDesc* benchmark = nullptr);
     FinalApp(const FinalApp& rhs) = delete;
     FinalApp& operator=(const FinalApp& rhs) = delete;
     ~FinalApp();
@@ -68,25 +354,64 @@ private:
     virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
     virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
     virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
+	virtual void OnKeyUp(WPARAM key)override;
 
     void OnKeyboardInput(const GameTimer& gt);
+	void MoveCameraRays(const GameTimer& gt);
+	void MoveCameraSwept(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void BeginBenchmark();
+	void EndBenchmarkFrame();
+	void FollowCameraPath(const GameTimer& gt);
+	void RecordCameraPath(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void AnimateRenderItems(const GameTimer& gt);
+	void MarkRitemDirty(RenderItem* ri);
+	void MarkMaterialDirty(Material* mat);
+	void UpdateInstanceData();
+	void UploadInstanceData(ID3D12GraphicsCommandList* cmdList);
 	void UpdateMaterialCBs(const GameTimer& gt);
+	void UpdateCameraData();
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateLights();
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateWavesGPU(const GameTimer& gt, ID3D12GraphicsCommandList* cmdList);
+	void SetFrameResourceCount(int count);
+	void UpdateOverlay();
+	void UpdateMazeChunks();
+	void LoadMazeChunk(MazeChunkSlot& slot, int chunkX, int chunkZ);
+	void UnloadMazeChunk(MazeChunkSlot& slot);
+	void ParkMazeWall(RenderItem* ri);
+	void BuildMazeCollision();
+	void CullRenderItems();
+	void UploadObjectConstants();
+	bool DrawsInstanceBatches(RenderLayer layer)const;
+	void CullTreeSprites(const BoundingFrustum& worldFrustum);
+	void CullGpuWavesMeshlets(const BoundingFrustum& worldFrustum);
+	void SortVisibleRitems();
+	std::uint32_t DrawStateKey(const RenderItem* ri);
+	InstanceData MakeInstanceData(const RenderItem* ri)const;
+	UINT SelectLod(const RenderItem* ri)const;
 
 	void LoadTextures();
     void BuildRootSignature();
+	void BuildCullRootSignature();
+	void BuildClusterRootSignature();
+	void BuildWavesRootSignature();
+	void BuildDepthPyramidRootSignature();
+	void BuildOverlayRootSignature();
 	void BuildDescriptorHeaps();
+	void WriteTextureDescriptors(int frameIndex);
     void BuildShadersAndInputLayouts();
-    void BuildLandGeometry();
+    void BuildTerrainGeometry();
     void BuildWavesGeometry();
+	void BuildGpuWavesGeometry();
 	void BuildBoxGeometry();
 	void BuildTreeSpritesGeometry();
 	void BuildXgeometry();
 	void BuildWallsGeometry();
+	void AddLodChain(MeshGeometry* geo, const std::string& submesh,
+		std::vector<GeometryGenerator::MeshData>& lods);
 	void BuildTowersGeometry();
 	void BuildCylinderGeometry();
 	void BuildDiamondGeometry();
@@ -94,21 +419,52 @@ private:
 	void BuildGateGeometry();
 	void BuildMerlonlGeometry();
 	void BuildMazeGeometry();
+	void BuildDepthPrePassPSOs(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+		const D3D12_SHADER_BYTECODE& prePassPS, const D3D12_SHADER_BYTECODE& mainPassPS);
 
 
     void BuildPSOs();
+	void ResolveFrameHandles();
     void BuildFrameResources();
+	void BuildComputeQueue();
     void BuildMaterials();
+	void BuildSceneItems();
+	bool LoadSceneItems(const SceneFile& scene);
+	void BakeScene(SceneFile& scene)const;
+	std::uint64_t SceneSourceHash()const;
+	void ClearSceneItems();
     void BuildRenderItems();
 	void BuildRenderTowers();
 	void BuildRotationItems();
 	void BuildRenderGate();
 	void BuilRenderMaze();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildGpuWavesItems();
+	void BuildTerrainItems();
+	void BuildMazeItems();
+	void BuildCollisionGrid();
+	void BuildCullBounds();
+	void BuildInstanceBatches();
+	void BuildCullResources();
+	void DispatchFrustumCull(ID3D12GraphicsCommandList* cmdList, bool onComputeQueue);
+	void BuildDepthPyramid(ID3D12GraphicsCommandList* cmdList);
+	void BuildLights();
+	void BuildTrees();
+	void BuildClusterResources();
+	void DispatchLightClusters(ID3D12GraphicsCommandList* cmdList);
+	UINT LayerDrawCount(RenderLayer layer)const;
+	void SubmitAsyncCompute(const GameTimer& gt, bool cull, bool waves);
+	void BuildDrawChunks(UINT listCount);
+	void BeginLayerCommands(ID3D12GraphicsCommandList* cmdList);
+	void RecordDrawChunks(ID3D12GraphicsCommandList* cmdList, UINT list);
+	void RecordEndOfFrame(ID3D12GraphicsCommandList* cmdList);
+	void DrawOverlay(ID3D12GraphicsCommandList* cmdList);
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, RenderItem* const* ritems,
+		const D3D12_GPU_VIRTUAL_ADDRESS* objectCBs, size_t count, bool bindless);
+	void DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const InstanceBatch* batches, size_t count,
+		ID3D12Resource* instanceBuffer);
+	void DrawIndirectBatches(ID3D12GraphicsCommandList* cmdList, const InstanceBatch* batches, size_t count);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
-    float GetHillsHeight(float x, float z)const;
-    XMFLOAT3 GetHillsNormal(float x, float z)const;
 
 private:
 
@@ -119,18 +475,98 @@ private:
     UINT mCbvSrvDescriptorSize = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mClusterRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mWavesRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mDepthPyramidRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mOverlayRootSignature = nullptr;
+	ComPtr<ID3D12CommandSignature> mCullCommandSignature = nullptr;
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
+
+	// Shared VB/IB behind every geometry in the standard vertex format.  The dynamic
+	// waves and the tree sprite quad keep buffers of their own.
+	GeometryRegistry mStaticGeometry;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+
+	// Only what changed is visited each frame.  A material stays listed until every frame
+	// resource's MaterialCB has its new constants; an instanced item until the frame
+	// that copies its InstanceData into mInstanceBuffer.
+	std::vector<Material*> mDirtyMaterials;
+	std::vector<RenderItem*> mDirtyRitems;
+	std::vector<TextureSlot> mTextureSlots;
+
+	// The textures load in the background.  The heap holds one copy of their SRVs per
+	// frame resource, so a copy is only rewritten (placeholder to texture) once the GPU
+	// is done with its frame; mTextureTableStart is the current frame's copy.
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	int mTextureDescriptorsDirty = gNumFrameResources;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mTextureTableStart;
+
+	// Shader bytecode and PSOs from the previous run, keyed by what they were built from.
+	std::unique_ptr<PipelineCache> mPipelineCache;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
+	// What the frame loop uses from the maps above, looked up once by ResolveFrameHandles
+	// so a frame does no string lookups.  One set of layer PSOs per combination of
+	// instancing (bit 0), bindless materials (bit 1) and the depth pre-pass (bit 2).
+	LayerPipelines mLayerPipelines[8];
+	ID3D12PipelineState* mOpaquePSO = nullptr;
+	ID3D12PipelineState* mOverlayPSO = nullptr;
+	ID3D12PipelineState* mWavesDisturbPSO = nullptr;
+	ID3D12PipelineState* mWavesUpdatePSO = nullptr;
+	ID3D12PipelineState* mTerrainHeightPSO = nullptr;
+	ID3D12PipelineState* mFrustumCullPSO = nullptr;
+	ID3D12PipelineState* mDepthPyramidPSO = nullptr;
+	ID3D12PipelineState* mClusterLightsPSO = nullptr;
+	Material* mWaterMat = nullptr;
+
+	// CPU and GPU timings of the frame's scopes.  O toggles the readout, drawn by the
+	// last layer list from FrameResource::OverlayGlyphs; K saves the recent frames.
+	std::unique_ptr<Profiler> mProfiler;
+	UINT mGpuFrameScope = 0;
+	TextOverlay mOverlay;
+	UINT mOverlayGlyphCount = 0;
+	bool mShowProfiler = true;
+
+	// Benchmark mode (-benchmark) replays mCameraPath with a fixed timestep and ignores
+	// input; the waves are always disturbed from mWaveRandom, so such runs repeat.
+	// Outside it, J records the free camera into the path file.
+	bool mBenchmarkMode = false;
+	BenchmarkDesc mBenchmarkDesc;
+	std::unique_ptr<Benchmark> mBenchmark;
+	CameraPath mCameraPath;
+	bool mRecordingPath = false;
+	float mPathStartTime = 0.0f;
+	float mNextPathKeyTime = 0.0f;
+	std::mt19937 mWaveRandom;
+
+	// API draws (DrawRenderItems, instance batches, ExecuteIndirect calls) this frame,
+	// summed across the recording threads.
+	std::atomic<UINT> mDrawCallCount{ 0 };
+
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mWavesInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
     RenderItem* mWavesRitem = nullptr;
+	RenderItem* mGpuWavesRitem = nullptr;
+	RenderItem* mTerrainRitem = nullptr;
+
+	// The GPU waves grid is stored in meshlet order: each meshlet's indices, and its
+	// bounding sphere in the grid's space, grown by gGpuWavesMaxHeight.  The meshlets
+	// that pass the frustum test are merged into mGpuWavesRuns, which the item draws.
+	std::vector<IndexRun> mGpuWavesMeshlets;
+	std::vector<BoundingSphere> mGpuWavesMeshletBounds;
+	std::vector<IndexRun> mGpuWavesRuns;
+
+	// Every billboard tree, from gTreePositions and gTreeScatters.  The tree sprites
+	// item draws the quad once per tree that CullTreeSprites kept this frame.
+	std::vector<TreeInstance> mTrees;
+	RenderItem* mTreeSpritesRitem = nullptr;
 
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
@@ -138,16 +574,170 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Render items whose transforms change every frame.
+	std::vector<RenderItemAnimation> mAnimations;
+
+	// Opaque and alpha-tested items grouped for the instanced draw path; I toggles it.
+	std::vector<InstanceBatch> mInstanceBatches[(int)RenderLayer::Count];
+	UINT mInstanceCount = 0;
+	bool mInstancingEnabled = true;
+
+	// Items of each layer that passed this frame's frustum test; F cycles the cull mode.
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+	BoundingFrustum mCamFrustum;
+
+	// This frame's constants in the frame resource's ConstantAllocator: the object CB
+	// of each entry of mVisibleRitems drawn on its own, and the per-pass buffers.
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> mVisibleObjectCBs[(int)RenderLayer::Count];
+	D3D12_GPU_VIRTUAL_ADDRESS mPassCBAddress = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS mCullCBAddress = 0;
+	D3D12_GPU_VIRTUAL_ADDRESS mClusterCBAddress = 0;
+
+	// Scratch for ordering mVisibleRitems by draw state (and depth) each frame, and the
+	// vertex buffers seen this frame, whose slots stand in for them in the sort keys.
+	std::vector<DrawSortEntry> mDrawSortEntries;
+	std::vector<ID3D12Resource*> mSortVertexBuffers;
+	CullMode mCullMode = CullMode::Gpu;
+
+	// InstanceData of every batched item, in a default heap buffer that rests in the
+	// NON_PIXEL_SHADER_RESOURCE state.  Static items are copied into it once; changed
+	// ones are staged by UpdateInstanceData and copied at the start of the frame.
+	struct InstanceCopy
+	{
+		ID3D12Resource* Source = nullptr;
+		UINT64 SourceOffset = 0;
+		UINT FirstInstance = 0;
+		UINT Count = 0;
+	};
+	ComPtr<ID3D12Resource> mInstanceBuffer = nullptr;
+	std::vector<InstanceCopy> mInstanceCopies;
+
+	// GPU cull outputs are in the frame resources, sized by these.
+	UINT mCommandCount = 0;
+	UINT mCulledInstanceCount = 0;
+
+	// X toggles the occlusion test of the GPU cull.  The pyramids are built from the
+	// depth of the opaque layers, frame n into mDepthPyramids[n & 1], and read by a later
+	// frame's cull with the view-projection they were built under: the next frame's on
+	// the direct queue, the one after on the compute queue, which runs alongside the
+	// next frame's draws.  mDepthPyramidValid is false for a pyramid that frame built none.
+	std::unique_ptr<DepthPyramid> mDepthPyramids[2];
+	XMFLOAT4X4 mDepthPyramidViewProj[2] = { MathHelper::Identity4x4(), MathHelper::Identity4x4() };
+	bool mDepthPyramidValid[2] = { false, false };
+	UINT mCullPyramid = 0;
+	UINT64 mFrameNumber = 0;
+	bool mOcclusionCulling = true;
+
+	// N toggles async compute: the instance upload and the GPU cull, and the GPU wave
+	// step, are recorded into mComputeCommandList and run on mComputeQueue while the last
+	// frame's draws finish.  The frame's draws wait on mComputeFence; the compute work
+	// waits on mFence for the frame before last, or for the last frame when it reads
+	// what that frame wrote.  The light clusters stay on the direct queue, as they end
+	// in PIXEL_SHADER_RESOURCE, which a compute list cannot transition to.
+	ComPtr<ID3D12CommandQueue> mComputeQueue = nullptr;
+	ComPtr<ID3D12GraphicsCommandList> mComputeCommandList = nullptr;
+	ComPtr<ID3D12Fence> mComputeFence = nullptr;
+	UINT64 mComputeFenceValue = 0;
+	bool mAsyncCompute = true;
+	bool mAsyncCull = false;
+	bool mPrevAsyncCull = false;
+	bool mPrevAsyncWaves = false;
+
+	// Point and spot lights go through the light clusters; the castle's are fixed and
+	// the maze adds the torches of its loaded chunks.  FrameResource::LightBuffer is
+	// sized for mLightCapacity and rewritten when the set changes, like the waves.
+	// The cluster lists are rebuilt every frame into one buffer shared by all frame
+	// resources, which is safe as they are only built on the direct queue.
+	std::vector<Light> mPointLights;
+	std::vector<Light> mSpotLights;
+	UINT mLightCapacity = 0;
+	UINT mPointLightCount = 0;
+	UINT mSpotLightCount = 0;
+	int mLightsFramesDirty = gNumFrameResources;
+	ComPtr<ID3D12Resource> mClusterBuffer = nullptr;
+
+	// This frame's draws split across the layer command lists; P toggles recording them
+	// on worker threads.  The PSOs and the instance source are resolved before the
+	// workers start, so they only read shared state.
+	std::vector<DrawChunk> mDrawChunks;
+	const LayerPipelines* mCurrPipelines = nullptr;
+	ID3D12Resource* mDrawInstanceBuffer = nullptr;
+	bool mDrawIndirect = false;
+	bool mParallelRecording = true;
+
+	// B toggles the bindless PSOs for the opaque, alpha-tested and transparent layers:
+	// materials come from FrameResource::MaterialBuffer and textures from one table
+	// over the whole heap, so a draw only sets its material index.
+	bool mBindlessMaterials = false;
+
+	// Z toggles the depth pre-pass: the opaque and alpha-tested layers are drawn
+	// depth-only first, then shaded with EQUAL depth tests and no depth writes, so each
+	// pixel is shaded once and the alpha test (only in the pre-pass) no longer stops
+	// early-Z in the main pass.
+	bool mDepthPrePass = true;
+
+	// H toggles the mesh LODs; off draws every mesh at full detail.
+	bool mLodEnabled = true;
+
 	std::unique_ptr<Waves> mWaves;
 
+	// Static tex-coord stream of the CPU waves, and how many frame resources still hold
+	// an out-of-date copy of the dynamic stream.
+	ComPtr<ID3D12Resource> mWavesTexCBufferGPU = nullptr;
+	ComPtr<ID3D12Resource> mWavesTexCBufferUploader = nullptr;
+	int mWavesFramesDirty = gNumFrameResources;
+	std::unique_ptr<GpuWaves> mGpuWaves;
+	WaveMode mWaveMode = WaveMode::Gpu;
+
+	// Heightfield around the lake, tessellated on the GPU; U hides it.
+	std::unique_ptr<Terrain> mTerrain;
+	bool mTerrainEnabled = true;
+
     PassConstants mMainPassCB;
 	Camera mCamera;
+
+	// Everything derived from the camera's matrices, rebuilt by UpdateCameraData only on
+	// the frames the camera's revision moves.  The pass constants keep theirs in
+	// mMainPassCB between frames.
+	UINT64 mCameraRevision = 0;
+	BoundingFrustum mWorldFrustum;
+	CullConstants mCullConstants;
+	ClusterConstants mClusterConstants;
+
+	// Calls to operator new during the last frame (gHeapAllocations), shown under the
+	// profiler readout; zero once everything has warmed up.
+	UINT64 mFrameHeapAllocations = 0;
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
+	// Static opaque Bounds binned for the camera collision queries; animated opaque
+	// items move, so they are kept out of the grid and tested directly.
+	CollisionGrid mCollisionGrid;
+	std::vector<RenderItem*> mDynamicColliders;
+	std::vector<std::uint32_t> mCollisionCandidates;
+	SphereSweep mCameraSweep;
+	CollisionMode mCollisionMode = CollisionMode::SweptSphere;
+
+	// Procedural labyrinth, streamed in chunks around the camera.  There are as many
+	// slots as chunks fit in the evict square, and each owns MaxWallsPerChunk wall items
+	// in the Opaque layer, so the instance batches and buffers never change size.  The
+	// loaded walls get their own collision grid, rebuilt when the set of chunks changes.
+	std::unique_ptr<MazeGenerator> mMaze;
+	std::vector<MazeChunkSlot> mMazeSlots;
+	std::vector<RenderItem*> mMazeWallItems;
+	std::vector<BoundingBox> mMazeWallBoxes;
+	CollisionGrid mMazeCollisionGrid;
+	bool mMazeCollisionDirty = false;
+
 	float c_distance = 0.0f;
 	const float kHitDist = 8.0f;
+	const float kCollisionCellSize = 10.0f;
+	const float kCameraRadius = 2.5f;
+	const int kMazeLoadRadius = 2;
+	const int kMazeEvictRadius = 3;
+	const int kMazeChunksPerFrame = 2;
+	const int kMazeTorchSpacing = 2;
     POINT mLastMousePos;
 };
 
@@ -161,7 +751,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
     try
     {
-        FinalApp theApp(hInstance);
+        BenchmarkDesc benchmark;
+        bool benchmarkMode = Benchmark::ParseCommandLine(cmdLine, benchmark);
+
+        FinalApp theApp(hInstance, benchmarkMode ? &benchmark : nullptr);
         if(!theApp.Initialize())
             return 0;
 
@@ -174,9 +767,15 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     }
 }
 
-FinalApp::FinalApp(HINSTANCE hInstance)
+FinalApp::FinalApp(HINSTANCE hInstance, const BenchmarkDesc* benchmark)
     : D3DApp(hInstance)
 {
+	if(benchmark != nullptr)
+	{
+		mBenchmarkMode = true;
+		mBenchmarkDesc = *benchmark;
+	}
+	mWaveRandom.seed(mBenchmarkDesc.Seed);
 }
 
 FinalApp::~FinalApp()
@@ -196,13 +795,36 @@ bool FinalApp::Initialize()
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	mCamera.SetPosition(0.0f, 20.0f, -400.0f);
     mWaves = std::make_unique<Waves>(200, 200, 2.50f, 0.3f, 0.5130f, 0.112f);
+	mGpuWaves = std::make_unique<GpuWaves>(md3dDevice.Get(), mCommandList.Get(),
+		200, 200, 2.50f, 0.3f, 0.5130f, 0.112f);
+
+	// 4096 x 4096 around the lake and the maze: 4-unit texels, 64-unit patches.
+	mTerrain = std::make_unique<Terrain>(md3dDevice.Get(), 1024, 4096.0f, 4096.0f, 64);
+	for(auto& pyramid : mDepthPyramids)
+		pyramid = std::make_unique<DepthPyramid>(md3dDevice.Get(), mClientWidth, mClientHeight);
+
+	// 128 x 128 cells south of the castle, entered from its north side.
+	MazeDesc mazeDesc;
+	mazeDesc.Seed = 3111;
+	mazeDesc.Origin = XMFLOAT3(-768.0f, -2.5f, -2016.0f);
+	mMaze = std::make_unique<MazeGenerator>(mazeDesc);
+
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get());
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), L"ShaderCache");
+	mProfiler = std::make_unique<Profiler>(md3dDevice.Get(), mCommandQueue.Get(), gMaxFrameResources);
 	
 	LoadTextures();
     BuildRootSignature();
+	BuildCullRootSignature();
+	BuildClusterRootSignature();
+	BuildWavesRootSignature();
+	BuildDepthPyramidRootSignature();
+	BuildOverlayRootSignature();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayouts();
-    BuildLandGeometry();
+    BuildTerrainGeometry();
     BuildWavesGeometry();
+	BuildGpuWavesGeometry();
 	BuildBoxGeometry();
 	BuildTreeSpritesGeometry();
 	BuildXgeometry();
@@ -214,22 +836,48 @@ bool FinalApp::Initialize()
 	BuildGateGeometry();
 	BuildMerlonlGeometry();
 	BuildMazeGeometry();
+	mStaticGeometry.Upload(md3dDevice.Get(), mCommandList.Get());
 	BuildMaterials();
-    BuildRenderItems();
-	BuildRenderTowers();
-	BuildRotationItems();
-	BuildRenderGate();
-	BuilRenderMaze();
+	BuildSceneItems();
+	BuildGpuWavesItems();
+	BuildTerrainItems();
+	BuildMazeItems();
+	BuildCollisionGrid();
+	BuildCullBounds();
+	BuildInstanceBatches();
+	BuildLights();
+	BuildTrees();
 	BuildFrameResources();
+	BuildComputeQueue();
+	BuildCullResources();
+	BuildClusterResources();
     BuildPSOs();
+	ResolveFrameHandles();
+	mPipelineCache->Save();
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+	mTerrain->BuildHeightMap(mCommandList.Get(), mWavesRootSignature.Get(), mTerrainHeightPSO);
+	OutputDebugString(mPipelineCache->Stats().c_str());
 	
     // Execute the initialization commands.
     ThrowIfFailed(mCommandList->Close());
     ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
     mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-    // Wait until initialization is complete.
+    // Wait until initialization is complete.  The textures keep loading; the first
+    // frames draw with placeholders.
     FlushCommandQueue();
+
+	// The copies out of the geometry upload heaps have run, so the heaps can go.
+	mStaticGeometry.ReleaseUploaders();
+	for (auto& e : mGeometries)
+		e.second->DisposeUploaders();
+	mWavesTexCBufferUploader = nullptr;
+
+	if (mBenchmarkMode)
+		BeginBenchmark();
+
     return true;
 }
  
@@ -238,40 +886,109 @@ void FinalApp::OnResize()
     D3DApp::OnResize();
 
 	mCamera.SetLens(0.35f * MathHelper::Pi, AspectRatio(), 1.0f, 5000.0f);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+
+	// D3DApp::OnResize flushed the queue, and with it the compute work each frame's
+	// draws waited on, so nothing reads the old pyramids.  The new ones are empty until
+	// a frame builds them.
+	for(int i = 0; i < 2; ++i)
+	{
+		if(mDepthPyramids[i] != nullptr)
+		{
+			mDepthPyramids[i]->OnResize(mClientWidth, mClientHeight, mDepthStencilBuffer.Get());
+			mDepthPyramidValid[i] = false;
+		}
+	}
 }
 
 void FinalApp::Update(const GameTimer& gt)
 {
-	
-    OnKeyboardInput(gt);
+	mProfiler->BeginFrame();
+	{
+		CpuProfileScope scope(mProfiler.get(), "Keyboard input");
+		OnKeyboardInput(gt);
+	}
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
     mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
-    if(mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
-    {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-    }
+    // Has the GPU finished processing the commands of the current frame resource?
+    // If not, wait until the GPU has completed commands up to this fence point.
+	{
+		CpuProfileScope scope(mProfiler.get(), "Fence wait");
+		WaitForFence(mCurrFrameResource->Fence);
+	}
+
+	// The timestamps this frame resource's last frame resolved are now readable.
+	mProfiler->BeginGpuFrame(mCurrFrameResourceIndex);
+
+	// Nothing the GPU still reads was allocated from it now.
+	mCurrFrameResource->ConstantAllocator->Reset();
+
+	// Only the current frame resource's SRVs are out of the GPU's hands, so textures
+	// that finished loading reach the others over the next frames.
+	if(mTextureStreamer->Update())
+		mTextureDescriptorsDirty = gNumFrameResources;
+	if(mTextureDescriptorsDirty > 0)
+	{
+		WriteTextureDescriptors(mCurrFrameResourceIndex);
+		mTextureDescriptorsDirty--;
+	}
 
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	AnimateRenderItems(gt);
+	UpdateMazeChunks();
+	{
+		CpuProfileScope scope(mProfiler.get(), "Update instances");
+		UpdateInstanceData();
+	}
 	UpdateMaterialCBs(gt);
+	UpdateCameraData();
+	UpdateLights();
 	UpdateMainPassCB(gt);
-    UpdateWaves(gt);
-	BuildRotationItems();
-
+	{
+		CpuProfileScope scope(mProfiler.get(), "Update waves");
+		UpdateWaves(gt);
+	}
+	{
+		CpuProfileScope scope(mProfiler.get(), "Cull");
+		CullRenderItems();
+	}
+	UploadObjectConstants();
+	UpdateOverlay();
 }
 
 void FinalApp::Draw(const GameTimer& gt)
 {
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
     ThrowIfFailed(cmdListAlloc->Reset());
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mOpaquePSO));
+
+	// Fill the indirect arguments before any draw reads them, on the compute queue if
+	// N has it on; the draws below wait for it.
+	mDrawIndirect = mInstancingEnabled && mCullMode == CullMode::Gpu;
+	mAsyncCull = mAsyncCompute && mDrawIndirect;
+	const bool asyncWaves = mAsyncCompute && mWaveMode == WaveMode::Gpu;
+	if (mAsyncCull || asyncWaves)
+		SubmitAsyncCompute(gt, mAsyncCull, asyncWaves);
+	mPrevAsyncCull = mAsyncCull;
+	mPrevAsyncWaves = asyncWaves;
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+	// Ended by RecordEndOfFrame, in whichever list records last.
+	mGpuFrameScope = mProfiler->BeginGpuScope(mCommandList.Get(), "Frame");
+
+	mDrawCallCount = 0;
+
+	if (!mAsyncCull)
+		UploadInstanceData(mCommandList.Get());
+
+	// The cull reads the depth pyramid from the heap, as the wave passes bind their UAVs.
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	if (mDrawIndirect && !mAsyncCull)
+		DispatchFrustumCull(mCommandList.Get(), false);
+	DispatchLightClusters(mCommandList.Get());
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -281,47 +998,125 @@ void FinalApp::Draw(const GameTimer& gt)
     mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::CornflowerBlue, 0, nullptr);
     mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+	// The wave compute passes bind their UAVs from the heap set above.
+	if (mWaveMode == WaveMode::Gpu && !asyncWaves)
+		UpdateWavesGPU(gt, mCommandList.Get());
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+	// Resolve everything the layers read once, up front.
+	mTextureTableStart = CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(),
+		mCurrFrameResourceIndex * (INT)mTextureSlots.size(), mCbvSrvDescriptorSize);
+	mCurrPipelines = &mLayerPipelines[(mInstancingEnabled ? 1 : 0) | (mBindlessMaterials ? 2 : 0) | (mDepthPrePass ? 4 : 0)];
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	// The CPU cull compacts the visible instances into their own buffer.
+	mDrawInstanceBuffer = (mCullMode == CullMode::Cpu) ?
+		mCurrFrameResource->VisibleInstanceBuffer->Resource() :
+		mInstanceBuffer.Get();
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+	UINT listCount = mParallelRecording ? (UINT)mCurrFrameResource->LayerCmdLists.size() : 1;
+	BuildDrawChunks(listCount);
+	UINT usedLists = mDrawChunks.empty() ? 0 : mDrawChunks.back().List + 1;
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	if (!mParallelRecording || usedLists == 0)
+	{
+		BeginLayerCommands(mCommandList.Get());
+		RecordDrawChunks(mCommandList.Get(), 0);
+		RecordEndOfFrame(mCommandList.Get());
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+		// Done recording commands.
+		ThrowIfFailed(mCommandList->Close());
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+		// Add the command list to the queue for execution.
+		ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+		mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	}
+	else
+	{
+		ThrowIfFailed(mCommandList->Close());
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+		// Each worker owns one allocator/list pair, so nothing is shared while recording.
+		// The last list also records the end-of-frame transitions.
+		concurrency::parallel_for(0u, usedLists, [this, usedLists](UINT i)
+		{
+			auto alloc = mCurrFrameResource->LayerCmdListAllocs[i].Get();
+			auto cmdList = mCurrFrameResource->LayerCmdLists[i].Get();
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+			ThrowIfFailed(alloc->Reset());
+			ThrowIfFailed(cmdList->Reset(alloc, nullptr));
 
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
+			BeginLayerCommands(cmdList);
+			RecordDrawChunks(cmdList, i);
+			if (i == usedLists - 1)
+				RecordEndOfFrame(cmdList);
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+			ThrowIfFailed(cmdList->Close());
+		});
+
+		// The queue runs the lists in array order, so the layers still draw in order.
+		ID3D12CommandList* cmdsLists[1 + gNumLayerCmdLists] = { mCommandList.Get() };
+		for (UINT i = 0; i < usedLists; ++i)
+			cmdsLists[1 + i] = mCurrFrameResource->LayerCmdLists[i].Get();
+		mCommandQueue->ExecuteCommandLists(1 + usedLists, cmdsLists);
+	}
 
     // Swap the back and front buffers
-    ThrowIfFailed(mSwapChain->Present(0, 0));
+	{
+		CpuProfileScope scope(mProfiler.get(), "Present");
+		PresentFrame();
+	}
 	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 
+	mFrameHeapAllocations = gHeapAllocations.exchange(0);
+
+	if (mBenchmark != nullptr)
+		EndBenchmarkFrame();
+
     // Advance the fence value to mark commands up to this fence point.
     mCurrFrameResource->Fence = ++mCurrentFence;
 
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	++mFrameNumber;
+}
+
+void FinalApp::SubmitAsyncCompute(const GameTimer& gt, bool cull, bool waves)
+{
+	// The frame resource's fence has passed, and with it its compute work, which the
+	// draws waited on.
+	auto cmdListAlloc = mCurrFrameResource->ComputeCmdListAlloc;
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(mComputeCommandList->Reset(cmdListAlloc.Get(), nullptr));
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	mComputeCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	// The scopes are timed on the compute queue against the direct queue's clock
+	// calibration; the two queues' timestamps may drift apart a little.
+	if (cull)
+	{
+		UploadInstanceData(mComputeCommandList.Get());
+		DispatchFrustumCull(mComputeCommandList.Get(), true);
+	}
+	if (waves)
+		UpdateWavesGPU(gt, mComputeCommandList.Get());
+
+	ThrowIfFailed(mComputeCommandList->Close());
+
+	// The frame before last is done with everything written here: its cull outputs
+	// are another frame resource's, its pyramid is the one this cull reads, and the
+	// wave step writes the solution nothing has displaced with since.  The last frame's
+	// draws must finish first when the instance buffer is rewritten under them, or when
+	// the last frame did the same work on the direct queue, whose results this reads.
+	bool waitForLastFrame = (cull && (!mPrevAsyncCull || !mInstanceCopies.empty())) ||
+		(waves && !mPrevAsyncWaves);
+	UINT64 waitFence = (waitForLastFrame || mCurrentFence == 0) ? mCurrentFence : mCurrentFence - 1;
+	ThrowIfFailed(mComputeQueue->Wait(mFence.Get(), waitFence));
+
+	ID3D12CommandList* cmdsLists[] = { mComputeCommandList.Get() };
+	mComputeQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	// Everything the direct queue runs after this point waits for the compute work.
+	ThrowIfFailed(mComputeQueue->Signal(mComputeFence.Get(), ++mComputeFenceValue));
+	ThrowIfFailed(mCommandQueue->Wait(mComputeFence.Get(), mComputeFenceValue));
 }
 
 void FinalApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -339,7 +1134,7 @@ void FinalApp::OnMouseUp(WPARAM btnState, int x, int y)
 
 void FinalApp::OnMouseMove(WPARAM btnState, int x, int y)
 {
-	if ((btnState & MK_LBUTTON) != 0)
+	if ((btnState & MK_LBUTTON) != 0 && !mBenchmarkMode)
 	{
 		// Make each pixel correspond to a quarter of a degree.
 		float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
@@ -353,7 +1148,137 @@ void FinalApp::OnMouseMove(WPARAM btnState, int x, int y)
 	mLastMousePos.y = y;
 }
  
+void FinalApp::OnKeyUp(WPARAM key)
+{
+	// A benchmark keeps the settings it started with.
+	if (mBenchmarkMode)
+		return;
+
+	// C toggles between the ray and swept-sphere collision modes.
+	if (key == 'C')
+	{
+		mCollisionMode = (mCollisionMode == CollisionMode::Rays) ?
+			CollisionMode::SweptSphere : CollisionMode::Rays;
+	}
+	// I toggles the instanced draw path for the opaque and alpha-tested layers.
+	else if (key == 'I')
+	{
+		mInstancingEnabled = !mInstancingEnabled;
+	}
+	// F cycles the frustum culling: off, CPU, GPU.
+	else if (key == 'F')
+	{
+		mCullMode = (CullMode)(((int)mCullMode + 1) % 3);
+	}
+	// G toggles between the CPU and GPU wave simulations.
+	else if (key == 'G')
+	{
+		mWaveMode = (mWaveMode == WaveMode::Cpu) ? WaveMode::Gpu : WaveMode::Cpu;
+	}
+	// P toggles recording the layers on worker threads.
+	else if (key == 'P')
+	{
+		mParallelRecording = !mParallelRecording;
+	}
+	// V toggles vsync; T toggles tearing, which only applies with vsync off.
+	else if (key == 'V')
+	{
+		mSyncInterval = (mSyncInterval == 0) ? 1 : 0;
+	}
+	else if (key == 'T')
+	{
+		mTearingEnabled = !mTearingEnabled;
+	}
+	// L cycles the swap chain's maximum frame latency: 1, 2, 3.
+	else if (key == 'L')
+	{
+		SetMaxFrameLatency(mMaxFrameLatency % 3 + 1);
+	}
+	// R cycles the number of frame resources in flight: 1 to gMaxFrameResources.
+	else if (key == 'R')
+	{
+		SetFrameResourceCount(gNumFrameResources % gMaxFrameResources + 1);
+	}
+	// B toggles the bindless material path.
+	else if (key == 'B')
+	{
+		mBindlessMaterials = !mBindlessMaterials;
+	}
+	// Z toggles the depth pre-pass.
+	else if (key == 'Z')
+	{
+		mDepthPrePass = !mDepthPrePass;
+	}
+	// X toggles the occlusion test of the GPU cull.
+	else if (key == 'X')
+	{
+		mOcclusionCulling = !mOcclusionCulling;
+	}
+	// N toggles async compute.
+	else if (key == 'N')
+	{
+		mAsyncCompute = !mAsyncCompute;
+	}
+	// H toggles the mesh LODs.
+	else if (key == 'H')
+	{
+		mLodEnabled = !mLodEnabled;
+	}
+	// U toggles the tessellated terrain.
+	else if (key == 'U')
+	{
+		mTerrainEnabled = !mTerrainEnabled;
+	}
+	// O toggles the profiler readout; K saves the recorded frames as CSV and as a
+	// Chrome trace.
+	else if (key == 'O')
+	{
+		mShowProfiler = !mShowProfiler;
+	}
+	else if (key == 'K')
+	{
+		CreateDirectoryW(L"Profiles", nullptr);
+		mProfiler->SaveCsv(L"Profiles\\Frames.csv");
+		mProfiler->SaveTrace(L"Profiles\\Frames.json");
+	}
+	// J starts recording the camera, and stops and saves the path for -benchmark.
+	else if (key == 'J')
+	{
+		if (!mRecordingPath)
+		{
+			mCameraPath.Clear();
+			mPathStartTime = mTimer.TotalTime();
+			mNextPathKeyTime = 0.0f;
+		}
+		else if (mCameraPath.KeyCount() > 0)
+		{
+			CreateDirectoryW(mBenchmarkDesc.OutputDir.c_str(), nullptr);
+			mCameraPath.Save(mBenchmarkDesc.CameraPath);
+		}
+		mRecordingPath = !mRecordingPath;
+	}
+}
+
 void FinalApp::OnKeyboardInput(const GameTimer& gt)
+{
+	if (mBenchmark != nullptr)
+	{
+		FollowCameraPath(gt);
+		return;
+	}
+
+	if (mCollisionMode == CollisionMode::SweptSphere)
+		MoveCameraSwept(gt);
+	else
+		MoveCameraRays(gt);
+
+	mCamera.UpdateViewMatrix();
+
+	if (mRecordingPath)
+		RecordCameraPath(gt);
+}
+
+void FinalApp::MoveCameraRays(const GameTimer& gt)
 {
 	bool move_w = true;
 	bool move_s = true;
@@ -362,30 +1287,49 @@ void FinalApp::OnKeyboardInput(const GameTimer& gt)
 	bool move_q = true;
 	bool move_e = true;
 
-	for (int i = 0; i < mRitemLayer[(int)RenderLayer::Opaque].size(); i++)
+	XMVECTOR pos = mCamera.GetPosition();
+	XMVECTOR look = mCamera.GetLook();
+	XMVECTOR right = mCamera.GetRight();
+	XMVECTOR up = mCamera.GetUp();
+
+	auto testBounds = [&](const BoundingBox& bounds)
 	{
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(), mCamera.GetLook(), c_distance)) && c_distance < kHitDist)
+		if (bounds.Intersects(pos, look, c_distance) && c_distance < kHitDist)
 			move_w = false;
 
-
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(), -1.0f * mCamera.GetLook(), c_distance)) && c_distance < kHitDist)
+		if (bounds.Intersects(pos, -1.0f * look, c_distance) && c_distance < kHitDist)
 			move_s = false;
 
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(), -1.0f * mCamera.GetRight(), c_distance)) && c_distance < kHitDist)
+		if (bounds.Intersects(pos, -1.0f * right, c_distance) && c_distance < kHitDist)
 			move_a = false;
 
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(), mCamera.GetRight(), c_distance)) && c_distance < kHitDist) 
-		{
+		if (bounds.Intersects(pos, right, c_distance) && c_distance < kHitDist)
 			move_d = false;
-		}
 
-
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(), -1.0f * mCamera.GetUp(), c_distance)) && c_distance < kHitDist)
+		if (bounds.Intersects(pos, -1.0f * up, c_distance) && c_distance < kHitDist)
 			move_q = false;
 
-		if ((mRitemLayer[(int)RenderLayer::Opaque][i]->Bounds.Intersects(mCamera.GetPosition(),  mCamera.GetUp(), c_distance)) && c_distance < kHitDist)
+		if (bounds.Intersects(pos, up, c_distance) && c_distance < kHitDist)
 			move_e = false;
-	}
+	};
+
+	// A ray can only hit within kHitDist a box that overlaps the kHitDist square
+	// around the camera, so only the grid cells under that square are visited.
+	mCollisionCandidates.clear();
+	mCollisionGrid.Query(pos, kHitDist, mCollisionCandidates);
+
+	for (std::uint32_t i : mCollisionCandidates)
+		testBounds(mCollisionGrid.Box(i));
+
+	for (auto ri : mDynamicColliders)
+		testBounds(ri->Bounds);
+
+	mCollisionCandidates.clear();
+	mMazeCollisionGrid.Query(pos, kHitDist, mCollisionCandidates);
+
+	for (std::uint32_t i : mCollisionCandidates)
+		testBounds(mMazeCollisionGrid.Box(i));
+
 	const float dt = gt.DeltaTime();
 
 	if ((GetAsyncKeyState('W') & 0x8000) && move_w)
@@ -406,10 +1350,61 @@ void FinalApp::OnKeyboardInput(const GameTimer& gt)
 
 	if ((GetAsyncKeyState('E') & 0x8000) && move_e )
 		mCamera.Pedestal(20.0f * dt);
+}
 
-	mCamera.UpdateViewMatrix();
+void FinalApp::MoveCameraSwept(const GameTimer& gt)
+{
+	const float dt = gt.DeltaTime();
+
+	// Same speeds as Walk/Strafe/Pedestal in MoveCameraRays, summed into one move.
+	float walk = 0.0f;
+	float strafe = 0.0f;
+	float pedestal = 0.0f;
 
+	if (GetAsyncKeyState('W') & 0x8000)
+		walk += 20.0f * dt;
 
+	if (GetAsyncKeyState('S') & 0x8000)
+		walk -= 20.0f * dt;
+
+	if (GetAsyncKeyState('A') & 0x8000)
+		strafe -= 25.0f * dt;
+
+	if (GetAsyncKeyState('D') & 0x8000)
+		strafe += 25.0f * dt;
+
+	if (GetAsyncKeyState('Q') & 0x8000)
+		pedestal -= 20.0f * dt;
+
+	if (GetAsyncKeyState('E') & 0x8000)
+		pedestal += 20.0f * dt;
+
+	if (walk == 0.0f && strafe == 0.0f && pedestal == 0.0f)
+		return;
+
+	XMVECTOR start = mCamera.GetPosition();
+	XMVECTOR delta = walk * mCamera.GetLook() + strafe * mCamera.GetRight() + pedestal * mCamera.GetUp();
+
+	// Gather every box the sphere could touch anywhere along the move.
+	float reach = 0.5f * XMVectorGetX(XMVector3Length(delta)) + kCameraRadius;
+	mCollisionCandidates.clear();
+	mCollisionGrid.Query(start + 0.5f * delta, reach, mCollisionCandidates);
+
+	mCameraSweep.Clear();
+	for (std::uint32_t i : mCollisionCandidates)
+		mCameraSweep.AddBox(mCollisionGrid.Box(i));
+
+	mCollisionCandidates.clear();
+	mMazeCollisionGrid.Query(start + 0.5f * delta, reach, mCollisionCandidates);
+	for (std::uint32_t i : mCollisionCandidates)
+		mCameraSweep.AddBox(mMazeCollisionGrid.Box(i));
+
+	for (auto ri : mDynamicColliders)
+		mCameraSweep.AddBox(ri->Bounds);
+
+	XMFLOAT3 end;
+	XMStoreFloat3(&end, mCameraSweep.Move(start, delta, kCameraRadius));
+	mCamera.SetPosition(end);
 }
  
 void FinalApp::UpdateCamera(const GameTimer& gt)
@@ -417,10 +1412,79 @@ void FinalApp::UpdateCamera(const GameTimer& gt)
 
 }
 
+void FinalApp::BeginBenchmark()
+{
+	if (!mCameraPath.Load(mBenchmarkDesc.CameraPath))
+		mCameraPath.SetKeys(gBenchmarkPath, _countof(gBenchmarkPath));
+
+	// Zero frames means the whole path once.
+	if (mBenchmarkDesc.FrameCount == 0)
+		mBenchmarkDesc.FrameCount = (UINT)(mCameraPath.Duration() / mBenchmarkDesc.TimeStep) + 1;
+
+	mBenchmark = std::make_unique<Benchmark>(mBenchmarkDesc);
+
+	std::ostringstream settings;
+	settings << mClientWidth << "x" << mClientHeight
+		<< " cull=" << (mCullMode == CullMode::None ? "off" : mCullMode == CullMode::Cpu ? "cpu" : "gpu")
+		<< " occlusion=" << mOcclusionCulling
+		<< " instancing=" << mInstancingEnabled << " bindless=" << mBindlessMaterials
+		<< " prepass=" << mDepthPrePass << " lod=" << mLodEnabled << " terrain=" << mTerrainEnabled << " parallel=" << mParallelRecording
+		<< " waves=" << (mWaveMode == WaveMode::Cpu ? "cpu" : "gpu") << " async=" << mAsyncCompute
+		<< " frameResources=" << gNumFrameResources << " path=" << mCameraPath.Duration() << "s";
+	mBenchmark->SetConfiguration(settings.str());
+
+	// Unthrottled and unattended, with no overlay in the frames being timed.
+	mSyncInterval = 0;
+	mRunWhenInactive = true;
+	mShowProfiler = false;
+	mTimer.SetFixedTimeStep(mBenchmarkDesc.TimeStep);
+
+	// Every frame then draws the same textures on every run.
+	mTextureStreamer->Flush();
+}
+
+void FinalApp::EndBenchmarkFrame()
+{
+	if (!mBenchmark->EndFrame(mDrawCallCount, gUploadBytes.exchange(0), mFrameHeapAllocations))
+		return;
+
+	mBenchmark->WriteReport();
+	mProfiler->SaveTrace(mBenchmarkDesc.OutputDir + L"\\Trace.json");
+	PostQuitMessage(0);
+}
+
+void FinalApp::FollowCameraPath(const GameTimer& gt)
+{
+	// The path starts with the first timed frame; the warm-up holds its first key.
+	float t = gt.TotalTime() - (float)(mBenchmarkDesc.WarmupFrames * mBenchmarkDesc.TimeStep);
+
+	XMFLOAT3 pos, look;
+	mCameraPath.Sample(std::max(t, 0.0f), pos, look);
+
+	XMFLOAT3 target(pos.x + look.x, pos.y + look.y, pos.z + look.z);
+	mCamera.LookAt(pos, target, XMFLOAT3(0.0f, 1.0f, 0.0f));
+	mCamera.UpdateViewMatrix();
+}
+
+void FinalApp::RecordCameraPath(const GameTimer& gt)
+{
+	// A key every quarter second; the spline smooths the walk between them.
+	float t = gt.TotalTime() - mPathStartTime;
+	if (t < mNextPathKeyTime)
+		return;
+	mNextPathKeyTime = t + 0.25f;
+
+	CameraKey key;
+	key.Time = t;
+	key.Position = mCamera.GetPosition3f();
+	key.Look = mCamera.GetLook3f();
+	mCameraPath.AddKey(key);
+}
+
 void FinalApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water"].get();
+	auto waterMat = mWaterMat;
 
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
@@ -438,42 +1502,129 @@ void FinalApp::AnimateMaterials(const GameTimer& gt)
 	waterMat->MatTransform(4, 1) = tv;
 
 	// Material has changed, so need to update cbuffer.
-	waterMat->NumFramesDirty = gNumFrameResources;
+	MarkMaterialDirty(waterMat);
 }
 
-void FinalApp::UpdateObjectCBs(const GameTimer& gt)
+void FinalApp::AnimateRenderItems(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	const float t = gt.TotalTime();
+
+	for(auto& a : mAnimations)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		XMVECTOR slide = XMVectorZero();
+		if(a.SlidePeriod > 0.0f)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			// Ease between the rest position (0) and the fully slid position (1).
+			float s = 0.5f - 0.5f * cosf(XM_2PI * t / a.SlidePeriod);
+			slide = XMVectorScale(XMLoadFloat3(&a.SlideAxis), s * a.SlideDistance);
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+			// Only a slide moves the collision box; items that just spin keep theirs.
+			XMStoreFloat3(&a.Ritem->Bounds.Center, XMLoadFloat3(&a.BoundsCenter) + slide);
+		}
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		XMMATRIX world = XMMatrixScaling(a.Scale.x, a.Scale.y, a.Scale.z) *
+			XMMatrixRotationY(XMConvertToRadians(a.StartAngle + a.AngularSpeed * t)) *
+			XMMatrixTranslationFromVector(XMLoadFloat3(&a.Position) + slide);
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+		XMStoreFloat4x4(&a.Ritem->World, world);
+		a.Ritem->LocalBounds.Transform(a.Ritem->CullBounds, world);
 
+		// Transform has changed, so need to update the instance data.
+		MarkRitemDirty(a.Ritem);
+	}
+}
+
+void FinalApp::MarkRitemDirty(RenderItem* ri)
+{
+	// Items drawn one by one have no instance data; their object constants are
+	// allocated afresh each frame by UploadObjectConstants.
+	if(ri->InstanceIndex == -1 || ri->InstanceDirty)
+		return;
+
+	ri->InstanceDirty = true;
+	mDirtyRitems.push_back(ri);
+}
+
+void FinalApp::MarkMaterialDirty(Material* mat)
+{
+	// Every frame resource's MaterialCB needs the new constants.
+	mat->NumFramesDirty = gNumFrameResources;
+	if(std::find(mDirtyMaterials.begin(), mDirtyMaterials.end(), mat) == mDirtyMaterials.end())
+		mDirtyMaterials.push_back(mat);
+}
+
+void FinalApp::UpdateInstanceData()
+{
+	mInstanceCopies.clear();
+	if(mDirtyRitems.empty())
+		return;
+
+	// In instance order, so neighbours that changed together copy as one run.
+	std::sort(mDirtyRitems.begin(), mDirtyRitems.end(), [](const RenderItem* a, const RenderItem* b)
+	{
+		return a->InstanceIndex < b->InstanceIndex;
+	});
+
+	const UINT64 byteSize = mDirtyRitems.size() * sizeof(InstanceData);
+	UploadAllocator::Allocation staging = mCurrFrameResource->ConstantAllocator->Allocate(byteSize, 16);
+	InstanceData* dst = reinterpret_cast<InstanceData*>(staging.CPU);
+	gUploadBytes += byteSize;
+
+	for(size_t i = 0; i < mDirtyRitems.size(); ++i)
+	{
+		RenderItem* ri = mDirtyRitems[i];
+		dst[i] = MakeInstanceData(ri);
+		ri->InstanceDirty = false;
+
+		UINT instance = (UINT)ri->InstanceIndex;
+		if(!mInstanceCopies.empty() &&
+			mInstanceCopies.back().FirstInstance + mInstanceCopies.back().Count == instance)
+		{
+			mInstanceCopies.back().Count++;
+			continue;
 		}
+
+		InstanceCopy copy;
+		copy.Source = staging.Resource;
+		copy.SourceOffset = staging.Offset + i * sizeof(InstanceData);
+		copy.FirstInstance = instance;
+		copy.Count = 1;
+		mInstanceCopies.push_back(copy);
+	}
+
+	mDirtyRitems.clear();
+}
+
+void FinalApp::UploadInstanceData(ID3D12GraphicsCommandList* cmdList)
+{
+	if(mInstanceCopies.empty())
+		return;
+
+	GpuProfileScope scope(mProfiler.get(), cmdList, "Instance upload");
+
+	D3D12_RESOURCE_BARRIER toCopyDest = CD3DX12_RESOURCE_BARRIER::Transition(mInstanceBuffer.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+	cmdList->ResourceBarrier(1, &toCopyDest);
+
+	for(const InstanceCopy& copy : mInstanceCopies)
+	{
+		cmdList->CopyBufferRegion(mInstanceBuffer.Get(), (UINT64)copy.FirstInstance * sizeof(InstanceData),
+			copy.Source, copy.SourceOffset, (UINT64)copy.Count * sizeof(InstanceData));
 	}
+
+	D3D12_RESOURCE_BARRIER toRead = CD3DX12_RESOURCE_BARRIER::Transition(mInstanceBuffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	cmdList->ResourceBarrier(1, &toRead);
 }
 
 void FinalApp::UpdateMaterialCBs(const GameTimer& gt)
 {
 	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for(auto& e : mMaterials)
+	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
+	for(Material* mat : mDirtyMaterials)
 	{
 		// Only update the cbuffer data if the constants have changed.  If the cbuffer
 		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
 		if(mat->NumFramesDirty > 0)
 		{
 			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
@@ -486,14 +1637,31 @@ void FinalApp::UpdateMaterialCBs(const GameTimer& gt)
 
 			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
 
+			MaterialData matData;
+			matData.DiffuseAlbedo = matConstants.DiffuseAlbedo;
+			matData.FresnelR0 = matConstants.FresnelR0;
+			matData.Roughness = matConstants.Roughness;
+			matData.MatTransform = matConstants.MatTransform;
+			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
+
+			currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
+
 			// Next FrameResource need to be updated too.
 			mat->NumFramesDirty--;
 		}
 	}
+
+	// Drop the materials every frame resource now has.
+	mDirtyMaterials.erase(std::remove_if(mDirtyMaterials.begin(), mDirtyMaterials.end(),
+		[](const Material* mat) { return mat->NumFramesDirty <= 0; }), mDirtyMaterials.end());
 }
 
-void FinalApp::UpdateMainPassCB(const GameTimer& gt)
+void FinalApp::UpdateCameraData()
 {
+	if(mCamera.GetRevision() == mCameraRevision)
+		return;
+	mCameraRevision = mCamera.GetRevision();
+
 	XMMATRIX view = mCamera.GetView();
 	XMMATRIX proj = mCamera.GetProj();
 
@@ -509,926 +1677,1215 @@ void FinalApp::UpdateMainPassCB(const GameTimer& gt)
 	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
 	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
 	mMainPassCB.EyePosW = mCamera.GetPosition3f();
+
+	// OnResize sets the lens, so the render target size moves with the revision too.
 	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
 	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
 
-	
+	// The clusters slice the camera's own depth range.
+	float nearZ = mCamera.GetNearZ();
+	float farZ = mCamera.GetFarZ();
+	mMainPassCB.ClusterSliceScale = ClusterGridZ / logf(farZ / nearZ);
+	mMainPassCB.ClusterSliceBias = -ClusterGridZ * logf(nearZ) / logf(farZ / nearZ);
+
+	XMFLOAT4X4 proj4x4 = mCamera.GetProj4x4f();
+	mClusterConstants.View = mMainPassCB.View;
+	mClusterConstants.ProjScaleX = proj4x4(0, 0);
+	mClusterConstants.ProjScaleY = proj4x4(1, 1);
+	mClusterConstants.NearZ = nearZ;
+	mClusterConstants.FarZ = farZ;
+
+	mCullConstants.EyePosW = mMainPassCB.EyePosW;
+	mCullConstants.LodScale = proj4x4(1, 1);
+
+	// Bring the view-space frustum into world space, where the cull bounds live.
+	mCamFrustum.Transform(mWorldFrustum, invView);
+
+	// Gribb-Hartmann: the frustum planes are sums and differences of the columns of
+	// the view-projection matrix, i.e. the rows of its transpose.
+	XMMATRIX viewProjT = XMMatrixTranspose(viewProj);
+
+	const XMVECTOR planes[6] =
+	{
+		viewProjT.r[3] + viewProjT.r[0],	// left
+		viewProjT.r[3] - viewProjT.r[0],	// right
+		viewProjT.r[3] + viewProjT.r[1],	// bottom
+		viewProjT.r[3] - viewProjT.r[1],	// top
+		viewProjT.r[2],						// near
+		viewProjT.r[3] - viewProjT.r[2]		// far
+	};
+
+	for(int i = 0; i < 6; ++i)
+		XMStoreFloat4(&mCullConstants.FrustumPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
+void FinalApp::UpdateMainPassCB(const GameTimer& gt)
+{
+	// The camera's share of the constants is kept up to date by UpdateCameraData.
 	mMainPassCB.NearZ = 1.0f;
 	mMainPassCB.FarZ = 3000.0f;
 	mMainPassCB.TotalTime = gt.TotalTime();
 	mMainPassCB.DeltaTime = gt.DeltaTime();
 	mMainPassCB.AmbientLight = { 0.4725f, 0.4725f, 0.4725f, 1.0f };
 	//direction light
-	mMainPassCB.Lights[0].Direction = { 0.0f, -0.27735f, 0.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.3f, 0.3f, 0.45f };
-
-	//point lights
-																									   //
-	mMainPassCB.Lights[1].Position = { -16.5f, 15.5f, +16.5f };										   //
-	mMainPassCB.Lights[1].Strength = { 255.0f/4.0f, 192.0f / 4.0f, 203.0f / 4.0f };					   //
-																									   //
-	mMainPassCB.Lights[2].Position = { 16.5f, 15.5f, +16.5f };										   //
-	mMainPassCB.Lights[2].Strength = { 255.0f / 4.0f, 192.0f / 4.0f, 203.0f / 4.0f };				   //
-																									   // lights for the towers
-	mMainPassCB.Lights[3].Position = { -16.5f, 15.5f, -16.5f };										   //
-	mMainPassCB.Lights[3].Strength = { 255.0f / 4.0f, 192.0f / 4.0f, 203.0f / 4.0f };				   //
-																									   //
-	mMainPassCB.Lights[4].Position = { 16.5f, 15.5f, -16.5f };										   //
-	mMainPassCB.Lights[4].Strength = { 255.0f / 4.0f, 192.0f / 4.0f, 203.0f / 4.0f };				   //
-																
-																									   
-	mMainPassCB.Lights[5].Position = { 0.0f, 30.0f, 0.0f };										   //Centre light
-	mMainPassCB.Lights[5].Strength = { 5.35f, 5.35f, 5.35f };
+	mMainPassCB.DirLights[0].Direction = { 0.0f, -0.27735f, 0.57735f };
+	mMainPassCB.DirLights[0].Strength = { 0.3f, 0.3f, 0.45f };
+	for (int i = 1; i < MaxDirLights; ++i)
+		mMainPassCB.DirLights[i].Strength = { 0.0f, 0.0f, 0.0f };
 
+	mMainPassCB.PointLightCount = mPointLightCount;
+	mMainPassCB.SpotLightCount = mSpotLightCount;
 
-	mMainPassCB.Lights[6].Position = { 0.0f, 45.0f, 0.0f };
-	mMainPassCB.Lights[6].Direction = { 0.0f, -5.0f, 0.0f };
-	mMainPassCB.Lights[6].Strength = { 5.35f, 5.35f, 5.35f };
-	mMainPassCB.Lights[6].SpotPower = 0.95;
+	mPassCBAddress = mCurrFrameResource->ConstantAllocator->AllocateConstants(mMainPassCB);
+}
 
-	mMainPassCB.Lights[7].Position = { 34.0f, 10.0f, 34.0f };										   //Centre light
-	mMainPassCB.Lights[7].Strength = { 1.0, 0.3f, 0.0f };
+void FinalApp::UpdateLights()
+{
+	// Only rewrite the lights if the set has changed since this frame resource last
+	// held it.  The point lights come first, so the spot lights start at their count.
+	if(mLightsFramesDirty > 0)
+	{
+		auto currLights = mCurrFrameResource->LightBuffer.get();
+		UINT count = 0;
 
+		for(const Light& l : mPointLights)
+			currLights->CopyData(count++, l);
+		for(const auto& slot : mMazeSlots)
+		{
+			for(const Light& l : slot.Torches)
+				currLights->CopyData(count++, l);
+		}
+		mPointLightCount = count;
 
-	mMainPassCB.Lights[8].Position = { 34.0f, 10.0f, 4.0f };										   //Centre light
-	mMainPassCB.Lights[8].Strength = { 1.0, 0.3f, 0.0f };
+		for(const Light& l : mSpotLights)
+			currLights->CopyData(count++, l);
+		mSpotLightCount = count - mPointLightCount;
 
-	mMainPassCB.Lights[9].Position = { -34.0f, 10.0f, 34.0f };										   //Centre light
-	mMainPassCB.Lights[9].Strength = { 1.0, 0.3f, 0.0f };
+		assert(count <= mLightCapacity);
+		mLightsFramesDirty--;
+	}
 
-	mMainPassCB.Lights[10].Position = { -34.0f, 10.0f, 4.0f };										   //Centre light
-	mMainPassCB.Lights[10].Strength = { 1.0, 0.3f, 0.0f };
+	// The camera's share of the constants is kept up to date by UpdateCameraData.
+	mClusterConstants.LightCount = mPointLightCount + mSpotLightCount;
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	mClusterCBAddress = mCurrFrameResource->ConstantAllocator->AllocateConstants(mClusterConstants);
 }
 
 void FinalApp::UpdateWaves(const GameTimer& gt)
 {
+	// The GPU simulation is recorded in Draw.
+	if(mWaveMode == WaveMode::Gpu)
+		return;
+
 	// Every quarter second, generate a random wave.
 	static float t_base = 0.0f;
 	if((mTimer.TotalTime() - t_base) >= 0.25f)
 	{
 		t_base += 0.25f;
 
-		int i = MathHelper::Rand(6, mWaves->RowCount() - 5);
-		int j = MathHelper::Rand(6, mWaves->ColumnCount() - 5);
+		int i = std::uniform_int_distribution<int>(6, mWaves->RowCount() - 5)(mWaveRandom);
+		int j = std::uniform_int_distribution<int>(6, mWaves->ColumnCount() - 5)(mWaveRandom);
 
-		float r = MathHelper::RandF(0.1f, 0.3f);
+		float r = std::uniform_real_distribution<float>(0.1f, 0.3f)(mWaveRandom);
 
 		mWaves->Disturb(i, j, r);
-	}
 
-	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
+		// Disturb moves heights of the current solution, so every copy is stale.
+		mWavesFramesDirty = gNumFrameResources;
+	}
 
-	// Update the wave vertex buffer with the new solution.
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
-	{
-		Vertex v;
-
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 1.15f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 1.15f - v.Pos.z / mWaves->Depth();
 
-		currWavesVB->CopyData(i, v);
+	// Update the wave simulation; a step writes the solution straight into this frame's VB.
+	if(mWaves->Update(gt.DeltaTime(), currWavesVB->MappedData()))
+	{
+		// The other frame resources still hold the previous solution.
+		mWavesFramesDirty = gNumFrameResources - 1;
+		gUploadBytes += mWaves->VertexCount() * sizeof(WaveVertex);
+	}
+	else if(mWavesFramesDirty > 0)
+	{
+		mWaves->WriteVertices(currWavesVB->MappedData());
+		mWavesFramesDirty--;
+		gUploadBytes += mWaves->VertexCount() * sizeof(WaveVertex);
 	}
 
 	// Set the dynamic VB of the wave renderitem to the current frame VB.
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
-void FinalApp::LoadTextures()
+void FinalApp::UpdateWavesGPU(const GameTimer& gt, ID3D12GraphicsCommandList* cmdList)
 {
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"../../Textures/sand.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
-
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../../Textures/water8.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-
-	auto fenceTex = std::make_unique<Texture>();
-	fenceTex->Name = "fenceTex";
-	fenceTex->Filename = L"../../Textures/ice.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), fenceTex->Filename.c_str(),
-		fenceTex->Resource, fenceTex->UploadHeap));
-
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../../Textures/palmtree.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
-
-	auto WallTex = std::make_unique<Texture>();
-	WallTex->Name = "WallTex";
-	WallTex->Filename = L"../../Textures/wall.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), WallTex->Filename.c_str(),
-		WallTex->Resource, WallTex->UploadHeap));
-
-	auto WallTex2 = std::make_unique<Texture>();
-	WallTex2->Name = "WallTex2";
-	WallTex2->Filename = L"../../Textures/lava.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), WallTex2->Filename.c_str(),
-		WallTex2->Resource, WallTex2->UploadHeap));
-
-	auto WallTex3 = std::make_unique<Texture>();
-	WallTex3->Name = "WallTex3";
-	WallTex3->Filename = L"../../Textures/wall3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), WallTex3->Filename.c_str(),
-		WallTex3->Resource, WallTex3->UploadHeap));
-
-	auto sample1 = std::make_unique<Texture>();
-	sample1->Name = "sample1";
-	sample1->Filename = L"../../Textures/sample2.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), sample1->Filename.c_str(),
-		sample1->Resource, sample1->UploadHeap));
+	GpuProfileScope scope(mProfiler.get(), cmdList, "Wave simulation");
 
-	auto gate = std::make_unique<Texture>();
-	gate->Name = "gate";
-	gate->Filename = L"../../Textures/gate6.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), gate->Filename.c_str(),
-		gate->Resource, gate->UploadHeap));
+	// Every quarter second, generate a random wave.
+	static float t_base = 0.0f;
+	if((mTimer.TotalTime() - t_base) >= 0.25f)
+	{
+		t_base += 0.25f;
 
-	auto bush = std::make_unique<Texture>();
-	bush->Name = "bush";
-	bush->Filename = L"../../Textures/bush.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bush->Filename.c_str(),
-		bush->Resource, bush->UploadHeap));
+		int i = std::uniform_int_distribution<int>(6, mGpuWaves->RowCount() - 5)(mWaveRandom);
+		int j = std::uniform_int_distribution<int>(6, mGpuWaves->ColumnCount() - 5)(mWaveRandom);
 
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
+		float r = std::uniform_real_distribution<float>(0.1f, 0.3f)(mWaveRandom);
 
-	mTextures[WallTex->Name] = std::move(WallTex);
-	mTextures[WallTex2->Name] = std::move(WallTex2);
-	mTextures[WallTex3->Name] = std::move(WallTex3);
-	mTextures[sample1->Name] = std::move(sample1);
-	mTextures[gate->Name] = std::move(gate);
-	mTextures[bush->Name] = std::move(bush);
+		mGpuWaves->Disturb(i, j, r);
+	}
+
+	// Update the wave simulation.
+	mGpuWaves->Update(gt, cmdList, mWavesRootSignature.Get(), mWavesUpdatePSO, mWavesDisturbPSO);
 }
 
-void FinalApp::BuildRootSignature()
+void FinalApp::SetFrameResourceCount(int count)
 {
-	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+	// The frame resources that join the ring may hold data several frames old, so
+	// drain the GPU and have every dirty-tracked buffer rewritten for the new ring.
+	// The instance buffer is shared by the ring and needs nothing.
+	FlushCommandQueue();
 
-    // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	gNumFrameResources = count;
+	mCurrFrameResourceIndex = gNumFrameResources - 1;
 
-	// Perfomance TIP: Order from most frequent to least frequent.
-	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0);
-    slotRootParameter[2].InitAsConstantBufferView(1);
-    slotRootParameter[3].InitAsConstantBufferView(2);
+	for(auto& e : mMaterials)
+		MarkMaterialDirty(e.second.get());
+	mWavesFramesDirty = gNumFrameResources;
+	mTextureDescriptorsDirty = gNumFrameResources;
+	mLightsFramesDirty = gNumFrameResources;
+}
 
-	auto staticSamplers = GetStaticSamplers();
+void FinalApp::UpdateOverlay()
+{
+	mOverlay.Clear();
 
-    // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
-		(UINT)staticSamplers.size(), staticSamplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	if(mShowProfiler)
+	{
+		const auto& stats = mProfiler->Stats();
+		const int lineCount = (int)stats.size() + 3;
+		const float x = 16.0f;
+		float y = 16.0f;
 
-    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
-    ComPtr<ID3DBlob> serializedRootSig = nullptr;
-    ComPtr<ID3DBlob> errorBlob = nullptr;
-    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+		mOverlay.Box(x - 8.0f, y - 8.0f, 36.0f * TextOverlay::CharAdvance + 16.0f,
+			(lineCount - 1) * TextOverlay::LineAdvance + 7.0f * TextOverlay::Scale + 16.0f,
+			XMFLOAT4(0.0f, 0.0f, 0.0f, 0.6f));
 
-    if(errorBlob != nullptr)
-    {
-        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
-    }
-    ThrowIfFailed(hr);
+		char line[64];
+		sprintf_s(line, "%-20s %7s %7s", "Scope", "CPU ms", "GPU ms");
+		mOverlay.Text(x, y, line, XMFLOAT4(1.0f, 0.8f, 0.3f, 1.0f));
 
-    ThrowIfFailed(md3dDevice->CreateRootSignature(
-		0,
-        serializedRootSig->GetBufferPointer(),
-        serializedRootSig->GetBufferSize(),
-        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+		for(const Profiler::ScopeStats& s : stats)
+		{
+			char cpu[16] = "-";
+			char gpu[16] = "-";
+			if(s.CpuMs >= 0.0f)
+				sprintf_s(cpu, "%.2f", s.CpuMs);
+			if(s.GpuMs >= 0.0f)
+				sprintf_s(gpu, "%.2f", s.GpuMs);
+
+			y += TextOverlay::LineAdvance;
+			sprintf_s(line, "%-20.20s %7s %7s", s.Name, cpu, gpu);
+			mOverlay.Text(x, y, line, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+		}
+
+		y += TextOverlay::LineAdvance;
+		sprintf_s(line, "%-20s %7llu", "Heap allocs", mFrameHeapAllocations);
+		mOverlay.Text(x, y, line, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+
+		y += TextOverlay::LineAdvance;
+		mOverlay.Text(x, y, "O hides, K saves to Profiles", XMFLOAT4(0.6f, 0.6f, 0.6f, 1.0f));
+	}
+
+	const auto& glyphs = mOverlay.Glyphs();
+	if(!glyphs.empty())
+		mCurrFrameResource->OverlayGlyphs->CopyData(0, glyphs.data(), (UINT)glyphs.size());
+	mOverlayGlyphCount = (UINT)glyphs.size();
 }
 
-void FinalApp::BuildDescriptorHeaps()
+void FinalApp::UpdateMazeChunks()
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 10;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	int camX, camZ;
+	mMaze->ChunkAt(eye.x, eye.z, camX, camZ);
+
+	// Chunks are evicted beyond a wider radius than they load in, so walking along a
+	// chunk border does not reload the same row every frame.  Everything resident is
+	// then inside the evict square, which has exactly as many chunks as there are slots.
+	for (auto& slot : mMazeSlots)
+	{
+		if (slot.Loaded && (std::abs(slot.ChunkX - camX) > kMazeEvictRadius ||
+			std::abs(slot.ChunkZ - camZ) > kMazeEvictRadius))
+		{
+			UnloadMazeChunk(slot);
+		}
+	}
 
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	// Load the missing chunks ring by ring outwards from the camera's, a few per frame,
+	// so crossing into a new chunk does not build a whole row in one frame.
+	int loads = 0;
+	for (int ring = 0; ring <= kMazeLoadRadius && loads < kMazeChunksPerFrame; ++ring)
+	{
+		for (int z = camZ - ring; z <= camZ + ring && loads < kMazeChunksPerFrame; ++z)
+		{
+			for (int x = camX - ring; x <= camX + ring && loads < kMazeChunksPerFrame; ++x)
+			{
+				// The inside of the ring was covered by the smaller rings.
+				if (std::abs(x - camX) != ring && std::abs(z - camZ) != ring)
+					continue;
+
+				if (x < 0 || x >= mMaze->ChunkCountX() || z < 0 || z >= mMaze->ChunkCountZ())
+					continue;
+
+				bool resident = std::any_of(mMazeSlots.begin(), mMazeSlots.end(),
+					[x, z](const MazeChunkSlot& s) { return s.Loaded && s.ChunkX == x && s.ChunkZ == z; });
+				if (resident)
+					continue;
+
+				auto slot = std::find_if(mMazeSlots.begin(), mMazeSlots.end(),
+					[](const MazeChunkSlot& s) { return !s.Loaded; });
+				assert(slot != mMazeSlots.end());
+
+				LoadMazeChunk(*slot, x, z);
+				++loads;
+			}
+		}
+	}
 
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto fenceTex = mTextures["fenceTex"]->Resource;
-	auto WallTex = mTextures["WallTex"]->Resource;
+	if (mMazeCollisionDirty)
+		BuildMazeCollision();
+}
 
-	auto WallTex2 = mTextures["WallTex2"]->Resource;
-	auto WallTex3 = mTextures["WallTex3"]->Resource;
-	auto sample1 = mTextures["sample1"]->Resource; 
-	auto gate = mTextures["gate"]->Resource;
+void FinalApp::LoadMazeChunk(MazeChunkSlot& slot, int chunkX, int chunkZ)
+{
+	mMaze->BuildChunk(chunkX, chunkZ, mMazeWallBoxes);
+	assert(mMazeWallBoxes.size() <= mMaze->MaxWallsPerChunk());
 
-	auto bush = mTextures["bush"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-	
-	
-	
+	for (UINT i = 0; i < (UINT)mMazeWallBoxes.size(); ++i)
+	{
+		const BoundingBox& b = mMazeWallBoxes[i];
+		RenderItem* ri = mMazeWallItems[slot.FirstItem + i];
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = grassTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	srvDesc.Format = waterTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	srvDesc.Format = fenceTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(fenceTex.Get(), &srvDesc, hDescriptor);
-
-	//// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	srvDesc.Format = WallTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(WallTex.Get(), &srvDesc, hDescriptor);
-
-	// next descriptor
-hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-srvDesc.Format = WallTex2->GetDesc().Format;
-md3dDevice->CreateShaderResourceView(WallTex2.Get(), &srvDesc, hDescriptor);
-// next descriptor
-hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-srvDesc.Format = WallTex3->GetDesc().Format;
-md3dDevice->CreateShaderResourceView(WallTex3.Get(), &srvDesc, hDescriptor);
-// next descriptor
-hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-srvDesc.Format = sample1->GetDesc().Format;
-md3dDevice->CreateShaderResourceView(sample1.Get(), &srvDesc, hDescriptor);
-
-// next descriptor
-hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-srvDesc.Format = gate->GetDesc().Format;
-md3dDevice->CreateShaderResourceView(gate.Get(), &srvDesc, hDescriptor);
-
-// next descriptor
-hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-srvDesc.Format = bush->GetDesc().Format;
-md3dDevice->CreateShaderResourceView(bush.Get(), &srvDesc, hDescriptor);
-
-
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	auto desc = treeArrayTex->GetDesc();
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
-	srvDesc.Format = treeArrayTex->GetDesc().Format;
-	srvDesc.Texture2DArray.MostDetailedMip = 0;
-	srvDesc.Texture2DArray.MipLevels = -1;
-	srvDesc.Texture2DArray.FirstArraySlice = 0;
-	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
-	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+		// The wall mesh is a unit box, so the world box is the wall's bounds.
+		XMFLOAT3 size(2.0f * b.Extents.x, 2.0f * b.Extents.y, 2.0f * b.Extents.z);
+		XMStoreFloat4x4(&ri->World, XMMatrixScaling(size.x, size.y, size.z) *
+			XMMatrixTranslation(b.Center.x, b.Center.y, b.Center.z));
 
+		// Tiled like the hand-placed maze walls: a repeat every 10 units along the wall.
+		XMStoreFloat4x4(&ri->TexTransform, XMMatrixScaling(0.1f * std::max<float>(size.x, size.z), 4.0f, 1.0f));
 
+		ri->Bounds = b;
+		ri->CullBounds = b;
+		ri->Active = true;
 
+		// Copied into the instance buffer at the start of the next frame.
+		MarkRitemDirty(ri);
+	}
 
-	
+	// A torch on top of every kMazeTorchSpacing-th wall lights the corridors either side.
+	slot.Torches.clear();
+	for (UINT i = 0; i < (UINT)mMazeWallBoxes.size(); i += kMazeTorchSpacing)
+	{
+		const BoundingBox& b = mMazeWallBoxes[i];
+
+		Light torch;
+		torch.Position = { b.Center.x, b.Center.y + b.Extents.y + 1.0f, b.Center.z };
+		torch.Strength = { 2.0f, 0.9f, 0.3f };
+		torch.FalloffStart = 2.0f;
+		torch.FalloffEnd = 16.0f;
+		slot.Torches.push_back(torch);
+	}
+	mLightsFramesDirty = gNumFrameResources;
+
+	slot.ChunkX = chunkX;
+	slot.ChunkZ = chunkZ;
+	slot.WallCount = (UINT)mMazeWallBoxes.size();
+	slot.Loaded = true;
+	mMazeCollisionDirty = true;
 }
 
-void FinalApp::BuildShadersAndInputLayouts()
+void FinalApp::UnloadMazeChunk(MazeChunkSlot& slot)
 {
-	const D3D_SHADER_MACRO defines[] =
-	{
-		"FOG", "1",
-		NULL, NULL
-	};
+	for (UINT i = 0; i < slot.WallCount; ++i)
+		ParkMazeWall(mMazeWallItems[slot.FirstItem + i]);
+
+	slot.WallCount = 0;
+	slot.Torches.clear();
+	slot.Loaded = false;
+	mMazeCollisionDirty = true;
+	mLightsFramesDirty = gNumFrameResources;
+}
 
-	const D3D_SHADER_MACRO alphaTestDefines[] =
+void FinalApp::ParkMazeWall(RenderItem* ri)
+{
+	// A zero scale collapses the wall to a point for the paths that draw whole batches,
+	// and the GPU cull rejects the box far below the world.
+	XMStoreFloat4x4(&ri->World, XMMatrixScaling(0.0f, 0.0f, 0.0f));
+	ri->CullBounds = BoundingBox(XMFLOAT3(0.0f, -1.0e6f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	ri->Active = false;
+	MarkRitemDirty(ri);
+}
+
+void FinalApp::BuildMazeCollision()
+{
+	mMazeWallBoxes.clear();
+	for (const auto& slot : mMazeSlots)
 	{
-		"FOG", "1",
-		"ALPHA_TEST", "1",
-		NULL, NULL
-	};
+		if (!slot.Loaded)
+			continue;
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
-	
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+		for (UINT i = 0; i < slot.WallCount; ++i)
+			mMazeWallBoxes.push_back(mMazeWallItems[slot.FirstItem + i]->Bounds);
+	}
 
-    mStdInputLayout =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+	mMazeCollisionGrid.Build(mMazeWallBoxes, kCollisionCellSize);
+	mMazeCollisionDirty = false;
+}
 
-	mTreeSpriteInputLayout =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
+bool FinalApp::DrawsInstanceBatches(RenderLayer layer)const
+{
+	return mInstancingEnabled && (layer == RenderLayer::Opaque || layer == RenderLayer::AlphaTested);
 }
 
-void FinalApp::BuildLandGeometry()
+void FinalApp::UploadObjectConstants()
 {
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(0.0f, 0.0f, 50, 50);
+	// Only what is drawn this frame gets constants, so items can come and go without
+	// any buffer being resized.
+	UploadAllocator* allocator = mCurrFrameResource->ConstantAllocator.get();
+	for(int i = 0; i < (int)RenderLayer::Count; ++i)
+	{
+		auto& objectCBs = mVisibleObjectCBs[i];
+		objectCBs.clear();
+		if(DrawsInstanceBatches((RenderLayer)i))
+			continue;
 
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for(size_t i = 0; i < grid.Vertices.size(); ++i)
-    {
-        auto& p = grid.Vertices[i].Position;
-        vertices[i].Pos = p;
-        vertices[i].Pos.y = -2.0f;
-        vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
-    }
+		for(RenderItem* ri : mVisibleRitems[i])
+		{
+			ObjectConstants objConstants;
+			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(XMLoadFloat4x4(&ri->World)));
+			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri->TexTransform)));
+			objConstants.GridSpatialStep = ri->GridSpatialStep;
 
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+			objectCBs.push_back(allocator->AllocateConstants(objConstants));
+		}
+	}
+}
 
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+void FinalApp::CullRenderItems()
+{
+	// The world-space frustum is rebuilt by UpdateCameraData when the camera moves.
+	const BoundingFrustum& worldFrustum = mWorldFrustum;
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
+	// Sizes of zero keep every LOD chain at its finest level.
+	for(int i = 0; i < MaxMeshLods - 1; ++i)
+		mCullConstants.LodScreenSizes[i] = mLodEnabled ? gLodScreenSizes[i] : 0.0f;
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CullTreeSprites(worldFrustum);
+	if(mWaveMode == WaveMode::Gpu)
+		CullGpuWavesMeshlets(worldFrustum);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	for(int i = 0; i < (int)RenderLayer::Count; ++i)
+	{
+		mVisibleRitems[i].clear();
+		for(auto ri : mRitemLayer[i])
+		{
+			if(!ri->Active || ri->InstanceCount == 0)
+				continue;
+
+			if(mCullMode == CullMode::None || !ri->Cullable ||
+				worldFrustum.Contains(ri->CullBounds) != DirectX::DISJOINT)
+			{
+				mVisibleRitems[i].push_back(ri);
+
+				// Only the items drawn one by one read these; the batches pick their own.
+				if(ri->LodCount > 1)
+				{
+					ri->Lod = SelectLod(ri);
+					ri->IndexCount = ri->Lods[ri->Lod].IndexCount;
+					ri->StartIndexLocation = ri->Lods[ri->Lod].StartIndexLocation;
+					ri->BaseVertexLocation = ri->Lods[ri->Lod].BaseVertexLocation;
+				}
+			}
+		}
+	}
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	SortVisibleRitems();
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	auto visibleInstances = mCurrFrameResource->VisibleInstanceBuffer.get();
+	for(auto& batches : mInstanceBatches)
+	{
+		for(auto& b : batches)
+		{
+			for(UINT l = 0; l < MaxMeshLods; ++l)
+				b.LodVisibleCounts[l] = 0;
+
+			// Unculled batches draw the persistent instance buffer as it is, so at their
+			// finest LOD; the GPU cull picks its LODs in the shader.
+			if(mCullMode != CullMode::Cpu)
+			{
+				b.VisibleCount = (UINT)b.Instances.size();
+				b.LodVisibleCounts[0] = b.VisibleCount;
+				continue;
+			}
+
+			// Count the visible instances of each LOD, then compact them to the front of
+			// the batch's range, LOD by LOD.
+			b.VisibleCount = 0;
+			for(auto ri : b.Instances)
+			{
+				if(ri->Active && (!ri->Cullable || worldFrustum.Contains(ri->CullBounds) != DirectX::DISJOINT))
+				{
+					ri->Lod = (b.LodCount > 1) ? SelectLod(ri) : 0;
+					b.LodVisibleCounts[ri->Lod]++;
+					b.VisibleCount++;
+				}
+				else
+				{
+					ri->Lod = MaxMeshLods;
+				}
+			}
+
+			UINT next[MaxMeshLods];
+			next[0] = b.FirstInstance;
+			for(UINT l = 1; l < MaxMeshLods; ++l)
+				next[l] = next[l - 1] + b.LodVisibleCounts[l - 1];
+
+			for(auto ri : b.Instances)
+			{
+				if(ri->Lod < MaxMeshLods)
+					visibleInstances->CopyData(next[ri->Lod]++, MakeInstanceData(ri));
+			}
+		}
+	}
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	if(mCullMode != CullMode::Gpu)
+		return;
+
+	// The frustum planes are kept up to date by UpdateCameraData.
+	CullConstants& cullConstants = mCullConstants;
+	cullConstants.InstanceCount = mInstanceCount;
+	cullConstants.CommandStride = sizeof(IndirectCommand);
+	cullConstants.InstanceCountOffset = offsetof(IndirectCommand, DrawArgs) + offsetof(D3D12_DRAW_INDEXED_ARGUMENTS, InstanceCount);
+	cullConstants.FirstInstanceOffset = offsetof(IndirectCommand, FirstInstance);
+	cullConstants.LodCountOffset = offsetof(IndirectCommand, LodCount);
+
+	// Last frame's pyramid, or the one before's on the compute queue, if it built one;
+	// the size cannot have changed since, as a resize drops both.  Draw decides the
+	// queue the same way.
+	bool asyncCull = mAsyncCompute && mInstancingEnabled;
+	mCullPyramid = (UINT)((asyncCull ? mFrameNumber : mFrameNumber + 1) & 1);
+	cullConstants.OcclusionViewProj = mDepthPyramidViewProj[mCullPyramid];
+	cullConstants.DepthWidth = mClientWidth;
+	cullConstants.DepthHeight = mClientHeight;
+	cullConstants.PyramidMipCount = mDepthPyramids[mCullPyramid]->MipCount();
+	cullConstants.OcclusionEnabled = (mOcclusionCulling && mDepthPyramidValid[mCullPyramid]) ? 1 : 0;
+
+	mCullCBAddress = mCurrFrameResource->ConstantAllocator->AllocateConstants(cullConstants);
+}
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+void FinalApp::CullGpuWavesMeshlets(const BoundingFrustum& worldFrustum)
+{
+	// The normals come from the displacement map, so the meshlets' normal cones say
+	// nothing about the displaced grid; only their spheres are tested.
+	XMMATRIX world = XMLoadFloat4x4(&mGpuWavesRitem->World);
 
-	geo->DrawArgs["grid"] = submesh;
+	mGpuWavesRuns.clear();
+	for(size_t i = 0; i < mGpuWavesMeshlets.size(); ++i)
+	{
+		if(mCullMode != CullMode::None)
+		{
+			BoundingSphere bounds;
+			mGpuWavesMeshletBounds[i].Transform(bounds, world);
+			if(worldFrustum.Contains(bounds) == DirectX::DISJOINT)
+				continue;
+		}
 
-	mGeometries["landGeo"] = std::move(geo);
+		// Meshlets are consecutive in the index buffer, so visible neighbours merge.
+		const IndexRun& m = mGpuWavesMeshlets[i];
+		if(!mGpuWavesRuns.empty() && mGpuWavesRuns.back().StartIndex + mGpuWavesRuns.back().IndexCount == m.StartIndex)
+			mGpuWavesRuns.back().IndexCount += m.IndexCount;
+		else
+			mGpuWavesRuns.push_back(m);
+	}
 }
 
-void FinalApp::BuildWavesGeometry()
+void FinalApp::CullTreeSprites(const BoundingFrustum& worldFrustum)
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	// The LOD is a dithered fade over the last stretch before gTreeFadeEnd; trees past
+	// it, or outside the frustum, are left out of this frame's instances.
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	auto treeInstances = mCurrFrameResource->TreeInstanceBuffer.get();
+	UINT count = 0;
 
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for(int i = 0; i < m - 1; ++i)
-    {
-        for(int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i*n + j;
-            indices[k + 1] = i*n + j + 1;
-            indices[k + 2] = (i + 1)*n + j;
+	for(const TreeInstance& tree : mTrees)
+	{
+		float dx = tree.Pos.x - eye.x;
+		float dy = tree.Pos.y - eye.y;
+		float dz = tree.Pos.z - eye.z;
+		float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+		if(dist >= gTreeFadeEnd)
+			continue;
+
+		// The billboard turns about y, so its sphere covers every facing.
+		BoundingSphere bounds(tree.Pos, 0.5f * sqrtf(tree.Size.x*tree.Size.x + tree.Size.y*tree.Size.y));
+		if(mCullMode != CullMode::None && worldFrustum.Contains(bounds) == DirectX::DISJOINT)
+			continue;
+
+		TreeInstance visible = tree;
+		visible.Fade = MathHelper::Clamp((gTreeFadeEnd - dist) / (gTreeFadeEnd - gTreeFadeStart), 0.0f, 1.0f);
+		treeInstances->CopyData(count++, visible);
+	}
 
-            indices[k + 3] = (i + 1)*n + j;
-            indices[k + 4] = i*n + j + 1;
-            indices[k + 5] = (i + 1)*n + j + 1;
+	if(mTreeSpritesRitem != nullptr)
+		mTreeSpritesRitem->InstanceCount = count;
+}
 
-            k += 6; // next quad
-        }
-    }
+void FinalApp::SortVisibleRitems()
+{
+	XMVECTOR eye = mCamera.GetPosition();
+	mSortVertexBuffers.clear();
 
-	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	for(int i = 0; i < (int)RenderLayer::Count; ++i)
+	{
+		auto& visible = mVisibleRitems[i];
+		if(visible.size() < 2)
+			continue;
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "waterGeo";
+		// Blending needs the transparent items far to near, whatever their state; the
+		// other layers group by state and go near to far within it, for early-Z.
+		const bool backToFront = (i == (int)RenderLayer::Transparent);
 
-	// Set dynamically.
-	geo->VertexBufferCPU = nullptr;
-	geo->VertexBufferGPU = nullptr;
+		mDrawSortEntries.clear();
+		for(auto ri : visible)
+		{
+			XMFLOAT3 center = ri->Cullable ? ri->CullBounds.Center :
+				XMFLOAT3(ri->World._41, ri->World._42, ri->World._43);
+
+			// Non-negative floats order like their bit patterns.
+			float distSq = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&center) - eye));
+			std::uint32_t depth;
+			std::memcpy(&depth, &distSq, sizeof(depth));
+
+			std::uint64_t state = DrawStateKey(ri);
+
+			DrawSortEntry entry;
+			entry.Key = backToFront ?
+				((std::uint64_t)~depth << 32) | state :
+				(state << 32) | depth;
+			entry.Ritem = ri;
+			mDrawSortEntries.push_back(entry);
+		}
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+		std::sort(mDrawSortEntries.begin(), mDrawSortEntries.end(),
+			[](const DrawSortEntry& a, const DrawSortEntry& b) { return a.Key < b.Key; });
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		for(size_t k = 0; k < visible.size(); ++k)
+			visible[k] = mDrawSortEntries[k].Ritem;
+	}
+}
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+std::uint32_t FinalApp::DrawStateKey(const RenderItem* ri)
+{
+	// The PSO is fixed per layer, so the key orders what DrawRenderItems rebinds, most
+	// expensive first: vertex buffer, topology, texture table, material CBV.
+	ID3D12Resource* vb = ri->Geo->VertexBufferGPU.Get();
+	auto it = std::find(mSortVertexBuffers.begin(), mSortVertexBuffers.end(), vb);
+	std::uint32_t vbSlot = (std::uint32_t)(it - mSortVertexBuffers.begin());
+	if(it == mSortVertexBuffers.end())
+		mSortVertexBuffers.push_back(vb);
+
+	return (std::min<std::uint32_t>(vbSlot, 0x3f) << 26) |
+		(((std::uint32_t)ri->PrimitiveType & 0x3f) << 20) |
+		(((std::uint32_t)ri->Mat->DiffuseSrvHeapIndex & 0x3ff) << 10) |
+		((std::uint32_t)ri->Mat->MatCBIndex & 0x3ff);
+}
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+InstanceData FinalApp::MakeInstanceData(const RenderItem* ri)const
+{
+	InstanceData instData;
+	XMStoreFloat4x4(&instData.World, XMMatrixTranspose(XMLoadFloat4x4(&ri->World)));
+	XMStoreFloat4x4(&instData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri->TexTransform)));
+	instData.MaterialIndex = ri->Mat->MatCBIndex;
+	instData.CommandIndex = ri->CommandIndex;
 
-	geo->DrawArgs["grid"] = submesh;
+	// Items that cannot be culled get a box no plane can reject.
+	instData.BoundsCenter = ri->Cullable ? ri->CullBounds.Center : XMFLOAT3(0.0f, 0.0f, 0.0f);
+	instData.BoundsExtents = ri->Cullable ? ri->CullBounds.Extents : XMFLOAT3(1.0e18f, 1.0e18f, 1.0e18f);
 
-	mGeometries["waterGeo"] = std::move(geo);
+	return instData;
 }
-void FinalApp::BuildBoxGeometry()
-{
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(85.0f, 0.2f, 85.0f, 0);
 
-	std::vector<Vertex> vertices(box.Vertices.size());
-	for (size_t i = 0; i < box.Vertices.size(); ++i)
+UINT FinalApp::SelectLod(const RenderItem* ri)const
+{
+	// The same test as FrustumCull.hlsl, so both culls pick the same LODs.
+	if(!ri->Cullable)
+		return 0;
+
+	XMVECTOR center = XMLoadFloat3(&ri->CullBounds.Center);
+	XMVECTOR eye = XMLoadFloat3(&mCullConstants.EyePosW);
+	float distance = std::max<float>(XMVectorGetX(XMVector3Length(center - eye)), 0.001f);
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->CullBounds.Extents)));
+	float screenSize = radius * mCullConstants.LodScale / distance;
+
+	UINT lod = 0;
+	for(UINT l = 1; l < ri->LodCount; ++l)
 	{
-		auto& p = box.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = box.Vertices[i].Normal;
-		vertices[i].TexC = box.Vertices[i].TexC;
+		if(screenSize < mCullConstants.LodScreenSizes[l - 1])
+			lod = l;
 	}
+	return lod;
+}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+void FinalApp::LoadTextures()
+{
+	// In SRV heap order; the materials' DiffuseSrvHeapIndex values follow it.
+	struct TextureFile
+	{
+		const char* Name;
+		const wchar_t* Filename;
+		bool IsArray;
+	};
+	const TextureFile textureFiles[] =
+	{
+		{ "grassTex",     L"../../Textures/sand.dds",     false },
+		{ "waterTex",     L"../../Textures/water8.dds",   false },
+		{ "fenceTex",     L"../../Textures/ice.dds",      false },
+		{ "WallTex",      L"../../Textures/wall.dds",     false },
+		{ "WallTex2",     L"../../Textures/lava.dds",     false },
+		{ "WallTex3",     L"../../Textures/wall3.dds",    false },
+		{ "sample1",      L"../../Textures/sample2.dds",  false },
+		{ "gate",         L"../../Textures/gate6.dds",    false },
+		{ "bush",         L"../../Textures/bush.dds",     false },
+		{ "treeArrayTex", L"../../Textures/palmtree.dds", true },
+	};
 
-	std::vector<std::uint16_t> indices = box.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	// Resource stays null until the streamer has the texture resident.
+	for(const TextureFile& file : textureFiles)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = file.Name;
+		tex->Filename = file.Filename;
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "boxGeo";
+		TextureSlot slot;
+		slot.Name = tex->Name;
+		slot.IsArray = file.IsArray;
+		slot.StreamId = mTextureStreamer->Request(tex->Filename);
+		mTextureSlots.push_back(slot);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		mTextures[tex->Name] = std::move(tex);
+	}
+}
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+void FinalApp::BuildRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE texTable;
+	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	CD3DX12_DESCRIPTOR_RANGE displacementMapTable;
+	displacementMapTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	// Every texture of the heap for the bindless PSOs (t0, space2).  Unbounded tables
+	// need resource binding tier 2; tier 1 gets one sized to the textures.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	ThrowIfFailed(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+	UINT textureTableSize = (options.ResourceBindingTier >= D3D12_RESOURCE_BINDING_TIER_2) ?
+		UINT_MAX : (UINT)mTextureSlots.size();
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	CD3DX12_DESCRIPTOR_RANGE textureArrayTable;
+	textureArrayTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, textureTableSize, 0, 2);
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+    // Root parameter can be a table, root descriptor or root constants.
+    CD3DX12_ROOT_PARAMETER slotRootParameter[11];
 
-	geo->DrawArgs["box"] = submesh;
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+    slotRootParameter[1].InitAsConstantBufferView(0);
+    slotRootParameter[2].InitAsConstantBufferView(1);
+    slotRootParameter[3].InitAsConstantBufferView(2);
+	// Instance data for the instanced PSOs (t0, space1).
+	slotRootParameter[4].InitAsShaderResourceView(0, 1);
+	// Wave heights for the displacement-mapped grid, or the terrain's heightmap (t1).
+	slotRootParameter[5].InitAsDescriptorTable(1, &displacementMapTable, D3D12_SHADER_VISIBILITY_ALL);
+	// Bindless PSOs: material index (b3), material buffer (t1, space1), textures.
+	slotRootParameter[6].InitAsConstants(1, 3);
+	slotRootParameter[7].InitAsShaderResourceView(1, 1);
+	slotRootParameter[8].InitAsDescriptorTable(1, &textureArrayTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	// Point/spot lights (t2, space1) and the cluster lists over them (t3, space1).
+	slotRootParameter[9].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[10].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL);
 
-	mGeometries["boxGeo"] = std::move(geo);
-}
-void FinalApp::BuildTreeSpritesGeometry()
-{
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
+	auto staticSamplers = GetStaticSamplers();
 
-	static const int treeCount = 51;
-	std::array<TreeSpriteVertex, 51> vertices;
-	float x, z;
-	for(UINT i = 0; i < treeCount; ++i)
-	{
-		switch (i)
-		{
-		case 0:
-			x = -140.0f;
-			z = -140.0f;
-			break;
-		case 1:
-			x = 140.0f;
-			z = -140.0f;
-			break;
-		case 2:
-			x = 140.0f;
-			z = 140.0f;
-			break;
-		case 3:
-			x = -140.0f;
-			z = 140.0f;
-			break;
-		case 4:
-			x = -140;
-			z = 30.0f;
-			break;
-
-		case 5:
-			x = 140;
-			z = 30.0f;
-			break;
-
-		case 6:
-			x = -140.0f;
-			z = -60.0f;
-			break;
-
-		case 7:
-			x =	140.0f;
-			z = -60.0f;
-			break;
-
-		case 8:
-			x = 20.0f;
-			z = 110.0f;
-			break;
-
-		case 9:
-			x = -20.0f;
-			z = 120.0f;
-			break;
-
-		case 10:
-			x = 40.0f;
-			z = 120.0f;
-			break;
-
-		case 11:
-			x = -40.0f;
-			z = 110.0f;
-			break;
-
-		case 12:
-			x = 60.0f;
-			z = 100.0f;
-			break;
-
-		case 13:
-			x = -60.0f;
-			z = 120.0f;
-			break;
-	
-		case 14:
-			x = 40.0f;
-			z = 90.0f;
-			break;
-
-		case 15:
-			x = 20.0f;
-			z = 80.0f;
-			break;
-
-		case 16:
-			x = 50.0f;
-			z = 80.0f;
-			break;
+    // A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(11, slotRootParameter,
+		(UINT)staticSamplers.size(), staticSamplers.data(),
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-		case 17:
-			x = -60.0f;
-			z = 70.0f;
-			break;
-
-		case 18:
-			x = -40.0f;
-			z = 70.0f;
-			break;
-
-
-		case 19:
-			x = -10.0f;
-			z = 85.0f;
-			break;
+    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-		case 20:
-			x = -80.0f;
-			z = 35.0f;
-			break;
-
-		case 21:
-			x = -85.0f;
-			z = 5.0f;
-			break;
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
 
-		case 22:
-			x = -70.0f;
-			z = 40.0f;
-			break;
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
 
+void FinalApp::BuildCullRootSignature()
+{
+	// The buffers are root descriptors; only the depth pyramid (t1) needs a table.
+	CD3DX12_DESCRIPTOR_RANGE pyramidTable;
+	pyramidTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
 
-		case 23:
-			x = -95.0f;
-			z = 15.0f;
-			break;
-
-		case 24:
-			x = -75.0f;
-			z = -10.0f;
-			break;
+	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
-		case 25:
-			x = -80.0f;
-			z = -36.0f;
-			break;
+	slotRootParameter[0].InitAsConstantBufferView(0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
+	slotRootParameter[3].InitAsUnorderedAccessView(1);
+	slotRootParameter[4].InitAsDescriptorTable(1, &pyramidTable);
 
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+		0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-		case 26:
-			x = 80.0f;
-			z = 35.0f;
-			break;
-
-		case 27:
-			x = 105.0f;
-			z = 5.0f;
-			break;
-
-		case 28:
-			x = 70.0f;
-			z = 40.0f;
-			break;
-
-
-		case 29:
-			x = 95.0f;
-			z = 15.0f;
-			break;
-
-		case 30:
-			x = 75.0f;
-			z = -10.0f;
-			break;
-
-		case 31:
-			x = 120.0f;
-			z = -36.0f;
-			break;
-
-
-		case 32:
-			x = 110.0f;
-			z = 35.0f;
-			break;
-
-		case 33:
-			x = 135.0f;
-			z = 15.0f;
-			break;
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-		case 34:
-			x = 150.0f;
-			z = 40.0f;
-			break;
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mCullRootSignature.GetAddressOf())));
+}
 
+void FinalApp::BuildClusterRootSignature()
+{
+	// Root descriptors only: cluster constants, lights and cluster lists.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
 
-		case 35:
-			x = 125.0f;
-			z = 15.0f;
-			break;
+	slotRootParameter[0].InitAsConstantBufferView(0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
 
-		case 36:
-			x = 105.0f;
-			z = -10.0f;
-			break;
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-		case 37:
-			x = -100.0f;
-			z = -106.0f;
-			break;
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-		case 38:
-			x = -75.0f;
-			z = -90.0f;
-			break;
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mClusterRootSignature.GetAddressOf())));
+}
 
-		case 39:
-			x = -120.0f;
-			z = -66.0f;
-			break;
+void FinalApp::BuildWavesRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE uavTable0;
+	uavTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
+	CD3DX12_DESCRIPTOR_RANGE uavTable1;
+	uavTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
 
-		case 40:
-			x = -110.0f;
-			z = -35.0f;
-			break;
+	CD3DX12_DESCRIPTOR_RANGE uavTable2;
+	uavTable2.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
 
-		case 41:
-			x = 135.0f;
-			z = -75.0f;
-			break;
+	// The wave update reads its two input solutions as SRVs.
+	CD3DX12_DESCRIPTOR_RANGE srvTable0;
+	srvTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-		case 42:
-			x = 150.0f;
-			z = -80.0f;
-			break;
+	CD3DX12_DESCRIPTOR_RANGE srvTable1;
+	srvTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
 
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[6];
 
-		case 43:
-			x = -125.0f;
-			z = -85.0f;
-			break;
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsConstants(6, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &uavTable0);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable1);
+	slotRootParameter[3].InitAsDescriptorTable(1, &uavTable2);
+	slotRootParameter[4].InitAsDescriptorTable(1, &srvTable0);
+	slotRootParameter[5].InitAsDescriptorTable(1, &srvTable1);
+
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(6, slotRootParameter,
+		0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-		case 44:
-			x = -105.0f;
-			z = -80.0f;
-			break;
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mWavesRootSignature.GetAddressOf())));
+}
 
-		case 45:
-			x = -120.0f;
-			z = -66.0f;
-			break;
+void FinalApp::BuildDepthPyramidRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-		case 46:
-			x = 85.0f;
-			z = -125.0f;
-			break;
+	CD3DX12_DESCRIPTOR_RANGE uavTable;
+	uavTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-		case 47:
-			x = 90.0f;
-			z = -90.0f;
-			break;
+	// The level sizes (b0), the level read (t0) and the level written (u0).
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
 
+	slotRootParameter[0].InitAsConstants(4, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &srvTable);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable);
 
-		case 48:
-			x = -125.0f;
-			z = -85.0f;
-			break;
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter,
+		0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-		case 49:
-			x = -105.0f;
-			z = -80.0f;
-			break;
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-		case 50:
-			x = 120.0f;
-			z = -126.0f;
-			break;
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mDepthPyramidRootSignature.GetAddressOf())));
+}
 
-		default:
-			break;
+void FinalApp::BuildOverlayRootSignature()
+{
+	// The render target size (b0) and the overlay quads (t0); no input assembler.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
 
-		}
-		float y = 2.5f;
+	slotRootParameter[0].InitAsConstants(2, 0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
 
-		// Move tree slightly above land height.
-		y += 8.0f;
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter,
+		0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-		vertices[i].Pos = XMFLOAT3(x, y, z);
-		vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
-	}
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	std::array<std::uint16_t, 51> indices =
+	if(errorBlob != nullptr)
 	{
-		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,14 , 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33 ,34 ,35 ,36 ,37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,49, 50
-	};
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mOverlayRootSignature.GetAddressOf())));
+}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
+void FinalApp::BuildDescriptorHeaps()
+{
+	const UINT textureCount = (UINT)mTextureSlots.size();
+	const UINT textureDescriptors = textureCount * gMaxFrameResources;
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	//
+	// Create the SRV heap.
+	//
+	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+	srvHeapDesc.NumDescriptors = textureDescriptors + mGpuWaves->DescriptorCount() + mTerrain->DescriptorCount() +
+		2 * mDepthPyramids[0]->DescriptorCount();
+	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	// Nothing has been drawn yet, so every frame resource's copy can be written now.
+	for(int i = 0; i < gMaxFrameResources; ++i)
+		WriteTextureDescriptors(i);
+
+	// The wave simulation's SRVs and UAVs follow the textures.
+	mGpuWaves->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), textureDescriptors, mCbvSrvDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), textureDescriptors, mCbvSrvDescriptorSize),
+		mCbvSrvDescriptorSize);
+
+	// Then the terrain's heightmap.
+	const UINT terrainDescriptors = textureDescriptors + mGpuWaves->DescriptorCount();
+	mTerrain->BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), terrainDescriptors, mCbvSrvDescriptorSize),
+		CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), terrainDescriptors, mCbvSrvDescriptorSize),
+		mCbvSrvDescriptorSize);
+
+	// Then the depth pyramids'.
+	UINT pyramidDescriptors = terrainDescriptors + mTerrain->DescriptorCount();
+	for(auto& pyramid : mDepthPyramids)
+	{
+		pyramid->BuildDescriptors(
+			CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), pyramidDescriptors, mCbvSrvDescriptorSize),
+			CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), pyramidDescriptors, mCbvSrvDescriptorSize),
+			mCbvSrvDescriptorSize, mDepthStencilBuffer.Get());
+		pyramidDescriptors += pyramid->DescriptorCount();
+	}
+}
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+void FinalApp::WriteTextureDescriptors(int frameIndex)
+{
+	//
+	// Fill out frameIndex's copy of the texture SRVs, one per texture in load order.
+	//
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
+		frameIndex * (INT)mTextureSlots.size(), mCbvSrvDescriptorSize);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	for(const TextureSlot& slot : mTextureSlots)
+	{
+		ID3D12Resource* tex = mTextureStreamer->Resource(slot.StreamId);
+		if(tex != nullptr)
+			mTextures[slot.Name]->Resource = tex;
+		else
+			tex = mTextureStreamer->Placeholder();
+
+		auto desc = tex->GetDesc();
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = desc.Format;
+		if(slot.IsArray)
+		{
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MostDetailedMip = 0;
+			srvDesc.Texture2DArray.MipLevels = -1;
+			srvDesc.Texture2DArray.FirstArraySlice = 0;
+			srvDesc.Texture2DArray.ArraySize = desc.DepthOrArraySize;
+		}
+		else
+		{
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+			srvDesc.Texture2D.MostDetailedMip = 0;
+			srvDesc.Texture2D.MipLevels = -1;
+		}
+		md3dDevice->CreateShaderResourceView(tex, &srvDesc, hDescriptor);
 
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+		// next descriptor
+		hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	}
+}
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+void FinalApp::BuildShadersAndInputLayouts()
+{
+	const D3D_SHADER_MACRO defines[] =
+	{
+		"FOG", "1",
+		NULL, NULL
+	};
 
-	geo->DrawArgs["points"] = submesh;
+	const D3D_SHADER_MACRO alphaTestDefines[] =
+	{
+		"FOG", "1",
+		"ALPHA_TEST", "1",
+		NULL, NULL
+	};
 
-	mGeometries["treeSpritesGeo"] = std::move(geo);
-}
-void FinalApp::BuildXgeometry()
-{
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateCylinder(20.0f, 20.0f, 20.0f, 10.0f, 10.0f);
+	const D3D_SHADER_MACRO instancedDefines[] =
+	{
+		"INSTANCED", "1",
+		NULL, NULL
+	};
 
-	std::vector<Vertex> vertices(box.Vertices.size());
-	for (size_t i = 0; i < box.Vertices.size(); ++i)
+	const D3D_SHADER_MACRO bindlessDefines[] =
 	{
-		auto& p = box.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = box.Vertices[i].Normal;
-		vertices[i].TexC = box.Vertices[i].TexC;
-	}
+		"FOG", "1",
+		"BINDLESS", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO bindlessAlphaTestDefines[] =
+	{
+		"FOG", "1",
+		"ALPHA_TEST", "1",
+		"BINDLESS", "1",
+		NULL, NULL
+	};
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const D3D_SHADER_MACRO bindlessInstancedDefines[] =
+	{
+		"INSTANCED", "1",
+		"BINDLESS", "1",
+		NULL, NULL
+	};
 
-	std::vector<std::uint16_t> indices = box.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	const D3D_SHADER_MACRO wavesDefines[] =
+	{
+		"DISPLACEMENT_MAP", "1",
+		NULL, NULL
+	};
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "xGeo";
+	mShaders["standardVS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["instancedVS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", instancedDefines, "VS", "vs_5_1");
+	mShaders["opaquePS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
+	mShaders["alphaTestedPS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	// The BINDLESS VS only needs the define to pass the material index along.
+	mShaders["bindlessVS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", bindlessDefines, "VS", "vs_5_1");
+	mShaders["bindlessInstancedVS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", bindlessInstancedDefines, "VS", "vs_5_1");
+	mShaders["bindlessOpaquePS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", bindlessDefines, "PS", "ps_5_1");
+	mShaders["bindlessAlphaTestedPS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", bindlessAlphaTestDefines, "PS", "ps_5_1");
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	mShaders["alphaTestPrePassPS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", nullptr, "AlphaTestPS", "ps_5_1");
+	mShaders["bindlessAlphaTestPrePassPS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", bindlessDefines, "AlphaTestPS", "ps_5_1");
+	
+	mShaders["wavesVS"] = mPipelineCache->CompileShader(L"Shaders\\Default.hlsl", wavesDefines, "VS", "vs_5_1");
+	mShaders["wavesUpdateCS"] = mPipelineCache->CompileShader(L"Shaders\\WaveSim.hlsl", nullptr, "UpdateWavesCS", "cs_5_0");
+	mShaders["wavesDisturbCS"] = mPipelineCache->CompileShader(L"Shaders\\WaveSim.hlsl", nullptr, "DisturbWavesCS", "cs_5_0");
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	mShaders["terrainVS"] = mPipelineCache->CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "TerrainVS", "vs_5_1");
+	mShaders["terrainHS"] = mPipelineCache->CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "TerrainHS", "hs_5_1");
+	mShaders["terrainDS"] = mPipelineCache->CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "TerrainDS", "ds_5_1");
+	mShaders["terrainHeightCS"] = mPipelineCache->CompileShader(L"Shaders\\TerrainHeight.hlsl", nullptr, "BuildHeightMapCS", "cs_5_0");
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	mShaders["frustumCullCS"] = mPipelineCache->CompileShader(L"Shaders\\FrustumCull.hlsl", nullptr, "FrustumCullCS", "cs_5_1");
+	mShaders["downsampleDepthCS"] = mPipelineCache->CompileShader(L"Shaders\\DepthPyramid.hlsl", nullptr, "DownsampleDepthCS", "cs_5_1");
+	mShaders["clusterLightsCS"] = mPipelineCache->CompileShader(L"Shaders\\ClusterLights.hlsl", nullptr, "ClusterLightsCS", "cs_5_1");
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	mShaders["overlayVS"] = mPipelineCache->CompileShader(L"Shaders\\TextOverlay.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["overlayPS"] = mPipelineCache->CompileShader(L"Shaders\\TextOverlay.hlsl", nullptr, "PS", "ps_5_1");
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	mShaders["treeSpriteVS"] = mPipelineCache->CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["treeSpritePS"] = mPipelineCache->CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+
+    mStdInputLayout =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    };
 
-	geo->DrawArgs["x"] = submesh;
+	// Position and normal are rewritten as the waves move; tex-coords come from slot 1.
+	mWavesInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 
-	mGeometries["xGeo"] = std::move(geo);
+	mTreeSpriteInputLayout =
+	{
+		{ "CORNER", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 }
-void FinalApp::BuildWallsGeometry()
+
+void FinalApp::BuildTerrainGeometry()
 {
-	//STEP 1 Define geometry
-	GeometryGenerator geoGen;//Define size
-	GeometryGenerator::MeshData m_Walls = geoGen.CreateBox(1.0f, 4.0f, 25.0f, 0);
+	// Only the flat patch corners; the heights are sampled by the domain shader.
+	const UINT n = mTerrain->PatchCount() + 1;
 
-	std::vector<Vertex> vertices(m_Walls.Vertices.size());
-	for (size_t i = 0; i < m_Walls.Vertices.size(); ++i)
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(mTerrain->Width(), mTerrain->Depth(), n, n);
+
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
 	{
-		auto& p = m_Walls.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = m_Walls.Vertices[i].Normal;
-		vertices[i].TexC = m_Walls.Vertices[i].TexC;
+		vertices[i].Pos = grid.Vertices[i].Position;
+		vertices[i].Normal = grid.Vertices[i].Normal;
+		vertices[i].TexC = grid.Vertices[i].TexC;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = m_Walls.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	// One 4-point patch per cell, corners in the order the domain shader interpolates.
+	std::vector<std::uint32_t> indices;
+	indices.reserve((n - 1)*(n - 1) * 4);
+	for(UINT i = 0; i < n - 1; ++i)
+	{
+		for(UINT j = 0; j < n - 1; ++j)
+		{
+			indices.push_back(i*n + j);
+			indices.push_back(i*n + j + 1);
+			indices.push_back((i + 1)*n + j);
+			indices.push_back((i + 1)*n + j + 1);
+		}
+	}
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "m_Walls_Geo"; // Name of unique geometry
+	geo->Name = "terrainGeo";
+	geo->DrawArgs["patches"] = mStaticGeometry.Add(geo.get(), vertices, indices);
+	mGeometries["terrainGeo"] = std::move(geo);
+}
 
+void FinalApp::BuildWavesGeometry()
+{
+	// Packed at 32 bits only once the grid goes past 256x256 (512x512 and 1024x1024 both fit).
+    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+    // Iterate over each quad.
+    int m = mWaves->RowCount();
+    int n = mWaves->ColumnCount();
+    int k = 0;
+    for(int i = 0; i < m - 1; ++i)
+    {
+        for(int j = 0; j < n - 1; ++j)
+        {
+            indices[k] = i*n + j;
+            indices[k + 1] = i*n + j + 1;
+            indices[k + 2] = (i + 1)*n + j;
 
+            indices[k + 3] = (i + 1)*n + j;
+            indices[k + 4] = i*n + j + 1;
+            indices[k + 5] = (i + 1)*n + j + 1;
+
+            k += 6; // next quad
+        }
+    }
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "waterGeo";
+
+	// Set dynamically.
+	geo->VertexBufferCPU = nullptr;
+	geo->VertexBufferGPU = nullptr;
+
+	geo->IndexFormat = d3dUtil::IndexFormatFor(mWaves->VertexCount());
+	geo->IndexBufferCPU = d3dUtil::PackIndices(indices.data(), indices.size(), geo->IndexFormat);
+
+	UINT vbByteSize = mWaves->VertexCount()*sizeof(WaveVertex);
+	UINT ibByteSize = (UINT)geo->IndexBufferCPU->GetBufferSize();
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), geo->IndexBufferCPU->GetBufferPointer(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(WaveVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
@@ -1436,116 +2893,229 @@ void FinalApp::BuildWallsGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
-	geo->DrawArgs["m_Walls"] = submesh;
-	mGeometries["m_Walls_Geo"] = std::move(geo);
+	geo->DrawArgs["grid"] = submesh;
 
+	mGeometries["waterGeo"] = std::move(geo);
+
+	// The grid only moves vertically, so its tex-coords are uploaded once into their
+	// own stream.  Derive them from position by mapping [-w/2,w/2] --> [0,1].
+	std::vector<XMFLOAT2> texC(mWaves->VertexCount());
+	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	{
+		XMFLOAT3 p = mWaves->Position(i);
+		texC[i].x = 1.15f + p.x / mWaves->Width();
+		texC[i].y = 1.15f - p.z / mWaves->Depth();
+	}
 
+	mWavesTexCBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		texC.data(), (UINT)texC.size()*sizeof(XMFLOAT2), mWavesTexCBufferUploader);
 }
-void FinalApp::BuildTowersGeometry()
+void FinalApp::BuildGpuWavesGeometry()
 {
+	// A flat grid over the simulation texels; the heights come from the displacement map.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(
+		(mGpuWaves->ColumnCount() - 1)*mGpuWaves->SpatialStep(),
+		(mGpuWaves->RowCount() - 1)*mGpuWaves->SpatialStep(),
+		mGpuWaves->RowCount(), mGpuWaves->ColumnCount());
 
-	//STEP 1 Define geometry
-	GeometryGenerator geoGen;//Define size
-	GeometryGenerator::MeshData m_Tower = geoGen.CreateCylinder(2.5f, 2.5f, 19.5f, 14, 33);
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = grid.Vertices[i].Position;
+		vertices[i].Normal = grid.Vertices[i].Normal;
+		vertices[i].TexC = grid.Vertices[i].TexC;
+	}
+
+	// Reorder the triangles by meshlet, so each meshlet is one range of the index buffer
+	// and neighbouring meshlets can be drawn as one.
+	GeometryGenerator::MeshletData meshlets = geoGen.CreateMeshlets(grid, 64, 126);
+
+	std::vector<std::uint32_t> indices;
+	indices.reserve(grid.Indices32.size());
+	for(const GeometryGenerator::Meshlet& m : meshlets.Meshlets)
+	{
+		IndexRun run;
+		run.StartIndex = (UINT)indices.size();
+		run.IndexCount = 3 * m.PrimitiveCount;
+		mGpuWavesMeshlets.push_back(run);
+
+		// The displacement only moves the vertices up and down.
+		mGpuWavesMeshletBounds.push_back(BoundingSphere(m.Center, m.Radius + gGpuWavesMaxHeight));
 
-	std::vector<Vertex> vertices(m_Tower.Vertices.size());
+		for(UINT p = 0; p < m.PrimitiveCount; ++p)
+		{
+			std::uint32_t packed = meshlets.PrimitiveIndices[m.PrimitiveOffset + p];
+			for(UINT c = 0; c < 3; ++c)
+				indices.push_back(meshlets.VertexIndices[m.VertexOffset + ((packed >> (10 * c)) & 0x3ff)]);
+		}
+	}
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "gpuWaterGeo";
+	geo->DrawArgs["grid"] = mStaticGeometry.Add(geo.get(), vertices, indices);
+	mGeometries["gpuWaterGeo"] = std::move(geo);
+}
+
+void FinalApp::BuildBoxGeometry()
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(85.0f, 0.2f, 85.0f, 0);
 
-	for (size_t i = 0; i < m_Tower.Vertices.size(); ++i)
+	std::vector<Vertex> vertices(box.Vertices.size());
+	for (size_t i = 0; i < box.Vertices.size(); ++i)
 	{
-		auto& p = m_Tower.Vertices[i].Position;
+		auto& p = box.Vertices[i].Position;
 		vertices[i].Pos = p;
-		vertices[i].Normal = m_Tower.Vertices[i].Normal;
-		vertices[i].TexC = m_Tower.Vertices[i].TexC;
+		vertices[i].Normal = box.Vertices[i].Normal;
+		vertices[i].TexC = box.Vertices[i].TexC;
 	}
 
+	std::vector<std::uint32_t> indices = box.Indices32;
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "boxGeo";
+	geo->DrawArgs["box"] = mStaticGeometry.Add(geo.get(), vertices, indices);
+	mGeometries["boxGeo"] = std::move(geo);
+}
+void FinalApp::BuildTreeSpritesGeometry()
+{
+	// One quad shared by every tree, as a strip in the order the geometry shader used
+	// to emit its corners.  The trees themselves come from TreeInstanceBuffer.
+	struct TreeSpriteVertex
+	{
+		XMFLOAT2 Corner;
+	};
+
+	std::array<TreeSpriteVertex, 4> vertices =
+	{
+		XMFLOAT2(+0.5f, -0.5f),
+		XMFLOAT2(+0.5f, +0.5f),
+		XMFLOAT2(-0.5f, -0.5f),
+		XMFLOAT2(-0.5f, +0.5f)
+	};
+
+	std::array<std::uint16_t, 4> indices = { 0, 1, 2, 3 };
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	std::vector<std::uint16_t> indices = m_Tower.GetIndices16();
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "TowerGeo"; // Name of unique geometry
-
+	geo->Name = "treeSpritesGeo";
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-
-
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-
-
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(TreeSpriteVertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
-	geo->DrawArgs["Tower"] = submesh;
-	mGeometries["TowerGeo"] = std::move(geo);
+	// Not "points" any more, so scenes baked for the geometry shader path are rebuilt.
+	geo->DrawArgs["quad"] = submesh;
+
+	mGeometries["treeSpritesGeo"] = std::move(geo);
 }
-void FinalApp::BuildCylinderGeometry()
+void FinalApp::BuildXgeometry()
 {
-	//STEP 1 Define geometry
-	GeometryGenerator geoGen;//Define size
-	GeometryGenerator::MeshData m_Tower = geoGen.CreateCylinder(1.5f, 0.0f, 3.5f, 100, 43);
-
-	std::vector<Vertex> vertices(m_Tower.Vertices.size());
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateCylinder(20.0f, 20.0f, 20.0f, 10.0f, 10.0f);
 
-	for (size_t i = 0; i < m_Tower.Vertices.size(); ++i)
+	std::vector<Vertex> vertices(box.Vertices.size());
+	for (size_t i = 0; i < box.Vertices.size(); ++i)
 	{
-		auto& p = m_Tower.Vertices[i].Position;
+		auto& p = box.Vertices[i].Position;
 		vertices[i].Pos = p;
-		vertices[i].Normal = m_Tower.Vertices[i].Normal;
-		vertices[i].TexC = m_Tower.Vertices[i].TexC;
+		vertices[i].Normal = box.Vertices[i].Normal;
+		vertices[i].TexC = box.Vertices[i].TexC;
 	}
 
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	std::vector<std::uint16_t> indices = m_Tower.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices = box.Indices32;
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "cylinderGeo"; // Name of unique geometry
+	geo->Name = "xGeo";
+	geo->DrawArgs["x"] = mStaticGeometry.Add(geo.get(), vertices, indices);
+	mGeometries["xGeo"] = std::move(geo);
+}
+void FinalApp::BuildWallsGeometry()
+{
+	//STEP 1 Define geometry
+	GeometryGenerator geoGen;//Define size
+	GeometryGenerator::MeshData m_Walls = geoGen.CreateBox(1.0f, 4.0f, 25.0f, 0);
 
+	std::vector<Vertex> vertices(m_Walls.Vertices.size());
+	for (size_t i = 0; i < m_Walls.Vertices.size(); ++i)
+	{
+		auto& p = m_Walls.Vertices[i].Position;
+		vertices[i].Pos = p;
+		vertices[i].Normal = m_Walls.Vertices[i].Normal;
+		vertices[i].TexC = m_Walls.Vertices[i].TexC;
+	}
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	std::vector<std::uint32_t> indices = m_Walls.Indices32;
 
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "m_Walls_Geo"; // Name of unique geometry
+	geo->DrawArgs["m_Walls"] = mStaticGeometry.Add(geo.get(), vertices, indices);
+	mGeometries["m_Walls_Geo"] = std::move(geo);
 
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+}
+void FinalApp::AddLodChain(MeshGeometry* geo, const std::string& submesh,
+	std::vector<GeometryGenerator::MeshData>& lods)
+{
+	// Every level goes in the shared buffers; LoadSceneItems finds them by name.
+	for (UINT l = 0; l < (UINT)lods.size(); ++l)
+	{
+		const auto& mesh = lods[l];
 
+		std::vector<Vertex> vertices(mesh.Vertices.size());
+		for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+		{
+			vertices[i].Pos = mesh.Vertices[i].Position;
+			vertices[i].Normal = mesh.Vertices[i].Normal;
+			vertices[i].TexC = mesh.Vertices[i].TexC;
+		}
 
+		geo->DrawArgs[LodSubmeshName(submesh, l)] = mStaticGeometry.Add(geo, vertices, lods[l].Indices32);
+	}
+}
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+void FinalApp::BuildTowersGeometry()
+{
 
+	//STEP 1 Define geometry
+	GeometryGenerator geoGen;//Define size
+	auto m_Tower = geoGen.CreateCylinderLods(2.5f, 2.5f, 19.5f, 14, 33, MaxMeshLods);
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "TowerGeo"; // Name of unique geometry
+	AddLodChain(geo.get(), "Tower", m_Tower);
+	mGeometries["TowerGeo"] = std::move(geo);
+}
+void FinalApp::BuildCylinderGeometry()
+{
+	//STEP 1 Define geometry
+	GeometryGenerator geoGen;//Define size
+	auto m_Tower = geoGen.CreateCylinderLods(1.5f, 0.0f, 3.5f, 100, 43, MaxMeshLods);
 
-	geo->DrawArgs["cylinder"] = submesh;
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "cylinderGeo"; // Name of unique geometry
+	AddLodChain(geo.get(), "cylinder", m_Tower);
 	mGeometries["cylinderGeo"] = std::move(geo);
 
 }
@@ -1565,41 +3135,11 @@ void FinalApp::BuildDiamondGeometry()
 		vertices[i].TexC = m_Diamond.Vertices[i].TexC;
 	}
 
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	std::vector<std::uint16_t> indices = m_Diamond.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices = m_Diamond.Indices32;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "diamondGeo"; // Name of unique geometry
-
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["diamond"] = submesh;
+	geo->DrawArgs["diamond"] = mStaticGeometry.Add(geo.get(), vertices, indices);
 	mGeometries["diamondGeo"] = std::move(geo);
 
 
@@ -1607,46 +3147,11 @@ void FinalApp::BuildDiamondGeometry()
 void FinalApp::BuildTopTowersGeometry()
 {
 	GeometryGenerator geoGen;//Define size
-	GeometryGenerator::MeshData m_TowerTopCones = geoGen.CreateCylinder(1.5f, 0.0f, 3.5f, 14, 33);
-
-	std::vector<Vertex> vertices(m_TowerTopCones.Vertices.size());
-	for (size_t i = 0; i < m_TowerTopCones.Vertices.size(); ++i)
-	{
-		auto& p = m_TowerTopCones.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Normal = m_TowerTopCones.Vertices[i].Normal;
-		vertices[i].TexC = m_TowerTopCones.Vertices[i].TexC;
-	}
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	std::vector<std::uint16_t> indices = m_TowerTopCones.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	auto m_TowerTopCones = geoGen.CreateCylinderLods(1.5f, 0.0f, 3.5f, 14, 33, MaxMeshLods);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "TowerTopGeo"; // Name of unique geometry
-
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["TowerTop"] = submesh;
+	AddLodChain(geo.get(), "TowerTop", m_TowerTopCones);
 	mGeometries["TowerTopGeo"] = std::move(geo);
 
 
@@ -1668,38 +3173,11 @@ void FinalApp::BuildGateGeometry()
 		vertices[i].TexC = m_Gate.Vertices[i].TexC;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = m_Gate.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices = m_Gate.Indices32;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "GateGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["Gate"] = submesh;
-
+	geo->DrawArgs["Gate"] = mStaticGeometry.Add(geo.get(), vertices, indices);
 	mGeometries["GateGeo"] = std::move(geo);
 }
 void FinalApp::BuildMerlonlGeometry()
@@ -1715,34 +3193,11 @@ void FinalApp::BuildMerlonlGeometry()
 		vertices[i].Normal = TriangularMerlon.Vertices[i].Normal;
 		vertices[i].TexC = TriangularMerlon.Vertices[i].TexC;
 	}
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	std::vector<std::uint16_t> indices = TriangularMerlon.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices = TriangularMerlon.Indices32;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "MerlonGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["Merlon"] = submesh;
+	geo->DrawArgs["Merlon"] = mStaticGeometry.Add(geo.get(), vertices, indices);
 	mGeometries["MerlonGeo"] = std::move(geo);
 }
 void FinalApp::BuildMazeGeometry()
@@ -1759,38 +3214,11 @@ void FinalApp::BuildMazeGeometry()
 		vertices[i].TexC = mazeWall.Vertices[i].TexC;
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-	std::vector<std::uint16_t> indices = mazeWall.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices = mazeWall.Indices32;
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "mazeWallGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["mazeWall"] = submesh;
-
+	geo->DrawArgs["mazeWall"] = mStaticGeometry.Add(geo.get(), vertices, indices);
 	mGeometries["mazeWallGeo"] = std::move(geo);
 
 
@@ -1832,7 +3260,23 @@ void FinalApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    mPSOs["opaque"] = mPipelineCache->CreateGraphicsPipeline(L"opaque", opaquePsoDesc);
+
+	// The depth pre-pass runs no pixel shader for opaque materials and only the alpha
+	// test for clip materials.  Its main-pass twins shade alpha-tested materials with
+	// the opaque PS: the EQUAL test already rejects the pixels the alpha test clipped.
+	const D3D12_SHADER_BYTECODE noPS = {};
+	const D3D12_SHADER_BYTECODE alphaTestPrePassPS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["alphaTestPrePassPS"]->GetBufferPointer()),
+		mShaders["alphaTestPrePassPS"]->GetBufferSize()
+	};
+	const D3D12_SHADER_BYTECODE bindlessAlphaTestPrePassPS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bindlessAlphaTestPrePassPS"]->GetBufferPointer()),
+		mShaders["bindlessAlphaTestPrePassPS"]->GetBufferSize()
+	};
+	BuildDepthPrePassPSOs("opaque", opaquePsoDesc, noPS, opaquePsoDesc.PS);
 
 	//
 	// PSO for transparent objects
@@ -1855,7 +3299,14 @@ void FinalApp::BuildPSOs()
 	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	mPSOs["transparent"] = mPipelineCache->CreateGraphicsPipeline(L"transparent", transparentPsoDesc);
+
+	//
+	// PSO for the CPU waves, whose tex-coords are in a second vertex stream
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC wavesPsoDesc = transparentPsoDesc;
+	wavesPsoDesc.InputLayout = { mWavesInputLayout.data(), (UINT)mWavesInputLayout.size() };
+	mPSOs["waves"] = mPipelineCache->CreateGraphicsPipeline(L"waves", wavesPsoDesc);
 
 	//
 	// PSO for alpha tested objects
@@ -1868,7 +3319,78 @@ void FinalApp::BuildPSOs()
 		mShaders["alphaTestedPS"]->GetBufferSize()
 	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	mPSOs["alphaTested"] = mPipelineCache->CreateGraphicsPipeline(L"alphaTested", alphaTestedPsoDesc);
+	BuildDepthPrePassPSOs("alphaTested", alphaTestedPsoDesc, alphaTestPrePassPS, opaquePsoDesc.PS);
+
+	//
+	// PSOs for instanced opaque and alpha tested batches
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueInstancedPsoDesc = opaquePsoDesc;
+	opaqueInstancedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+		mShaders["instancedVS"]->GetBufferSize()
+	};
+	mPSOs["opaqueInstanced"] = mPipelineCache->CreateGraphicsPipeline(L"opaqueInstanced", opaqueInstancedPsoDesc);
+	BuildDepthPrePassPSOs("opaqueInstanced", opaqueInstancedPsoDesc, noPS, opaquePsoDesc.PS);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedInstancedPsoDesc = alphaTestedPsoDesc;
+	alphaTestedInstancedPsoDesc.VS = opaqueInstancedPsoDesc.VS;
+	mPSOs["alphaTestedInstanced"] = mPipelineCache->CreateGraphicsPipeline(L"alphaTestedInstanced", alphaTestedInstancedPsoDesc);
+	BuildDepthPrePassPSOs("alphaTestedInstanced", alphaTestedInstancedPsoDesc, alphaTestPrePassPS, opaquePsoDesc.PS);
+
+	//
+	// Bindless variants of the opaque, alpha tested and transparent PSOs
+	//
+	D3D12_SHADER_BYTECODE bindlessVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bindlessVS"]->GetBufferPointer()),
+		mShaders["bindlessVS"]->GetBufferSize()
+	};
+	D3D12_SHADER_BYTECODE bindlessInstancedVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bindlessInstancedVS"]->GetBufferPointer()),
+		mShaders["bindlessInstancedVS"]->GetBufferSize()
+	};
+	D3D12_SHADER_BYTECODE bindlessOpaquePS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bindlessOpaquePS"]->GetBufferPointer()),
+		mShaders["bindlessOpaquePS"]->GetBufferSize()
+	};
+	D3D12_SHADER_BYTECODE bindlessAlphaTestedPS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["bindlessAlphaTestedPS"]->GetBufferPointer()),
+		mShaders["bindlessAlphaTestedPS"]->GetBufferSize()
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC bindlessPsoDesc = opaquePsoDesc;
+	bindlessPsoDesc.VS = bindlessVS;
+	bindlessPsoDesc.PS = bindlessOpaquePS;
+	mPSOs["opaqueBindless"] = mPipelineCache->CreateGraphicsPipeline(L"opaqueBindless", bindlessPsoDesc);
+	BuildDepthPrePassPSOs("opaqueBindless", bindlessPsoDesc, noPS, bindlessOpaquePS);
+
+	bindlessPsoDesc = transparentPsoDesc;
+	bindlessPsoDesc.VS = bindlessVS;
+	bindlessPsoDesc.PS = bindlessOpaquePS;
+	mPSOs["transparentBindless"] = mPipelineCache->CreateGraphicsPipeline(L"transparentBindless", bindlessPsoDesc);
+
+	bindlessPsoDesc = alphaTestedPsoDesc;
+	bindlessPsoDesc.VS = bindlessVS;
+	bindlessPsoDesc.PS = bindlessAlphaTestedPS;
+	mPSOs["alphaTestedBindless"] = mPipelineCache->CreateGraphicsPipeline(L"alphaTestedBindless", bindlessPsoDesc);
+	BuildDepthPrePassPSOs("alphaTestedBindless", bindlessPsoDesc, bindlessAlphaTestPrePassPS, bindlessOpaquePS);
+
+	bindlessPsoDesc = opaquePsoDesc;
+	bindlessPsoDesc.VS = bindlessInstancedVS;
+	bindlessPsoDesc.PS = bindlessOpaquePS;
+	mPSOs["opaqueInstancedBindless"] = mPipelineCache->CreateGraphicsPipeline(L"opaqueInstancedBindless", bindlessPsoDesc);
+	BuildDepthPrePassPSOs("opaqueInstancedBindless", bindlessPsoDesc, noPS, bindlessOpaquePS);
+
+	bindlessPsoDesc = alphaTestedPsoDesc;
+	bindlessPsoDesc.VS = bindlessInstancedVS;
+	bindlessPsoDesc.PS = bindlessAlphaTestedPS;
+	mPSOs["alphaTestedInstancedBindless"] = mPipelineCache->CreateGraphicsPipeline(L"alphaTestedInstancedBindless", bindlessPsoDesc);
+	BuildDepthPrePassPSOs("alphaTestedInstancedBindless", bindlessPsoDesc, bindlessAlphaTestPrePassPS, bindlessOpaquePS);
 
 	//
 	// PSO for tree sprites
@@ -1879,33 +3401,240 @@ void FinalApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
 		mShaders["treeSpriteVS"]->GetBufferSize()
 	};
-	treeSpritePsoDesc.GS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
-	};
 	treeSpritePsoDesc.PS =
 	{
 		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
 		mShaders["treeSpritePS"]->GetBufferSize()
 	};
 	//step1
-	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	mPSOs["treeSprites"] = mPipelineCache->CreateGraphicsPipeline(L"treeSprites", treeSpritePsoDesc);
+
+	//
+	// PSO for drawing the GPU waves
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC wavesRenderPSO = transparentPsoDesc;
+	wavesRenderPSO.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesVS"]->GetBufferPointer()),
+		mShaders["wavesVS"]->GetBufferSize()
+	};
+	mPSOs["wavesRender"] = mPipelineCache->CreateGraphicsPipeline(L"wavesRender", wavesRenderPSO);
+
+	//
+	// PSO for the tessellated terrain, lit by the opaque PS
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC terrainPsoDesc = opaquePsoDesc;
+	terrainPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["terrainVS"]->GetBufferPointer()),
+		mShaders["terrainVS"]->GetBufferSize()
+	};
+	terrainPsoDesc.HS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["terrainHS"]->GetBufferPointer()),
+		mShaders["terrainHS"]->GetBufferSize()
+	};
+	terrainPsoDesc.DS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["terrainDS"]->GetBufferPointer()),
+		mShaders["terrainDS"]->GetBufferSize()
+	};
+	terrainPsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_PATCH;
+	mPSOs["terrain"] = mPipelineCache->CreateGraphicsPipeline(L"terrain", terrainPsoDesc);
+
+	//
+	// PSO for the text overlay, blended over the finished frame
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC overlayPsoDesc = transparentPsoDesc;
+	overlayPsoDesc.InputLayout = { nullptr, 0 };
+	overlayPsoDesc.pRootSignature = mOverlayRootSignature.Get();
+	overlayPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["overlayVS"]->GetBufferPointer()),
+		mShaders["overlayVS"]->GetBufferSize()
+	};
+	overlayPsoDesc.PS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["overlayPS"]->GetBufferPointer()),
+		mShaders["overlayPS"]->GetBufferSize()
+	};
+	overlayPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	overlayPsoDesc.DepthStencilState.DepthEnable = false;
+	overlayPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	mPSOs["overlay"] = mPipelineCache->CreateGraphicsPipeline(L"overlay", overlayPsoDesc);
+
+	//
+	// PSOs for the wave simulation
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesDisturbPSO = {};
+	wavesDisturbPSO.pRootSignature = mWavesRootSignature.Get();
+	wavesDisturbPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesDisturbCS"]->GetBufferPointer()),
+		mShaders["wavesDisturbCS"]->GetBufferSize()
+	};
+	wavesDisturbPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["wavesDisturb"] = mPipelineCache->CreateComputePipeline(L"wavesDisturb", wavesDisturbPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesUpdatePSO = {};
+	wavesUpdatePSO.pRootSignature = mWavesRootSignature.Get();
+	wavesUpdatePSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesUpdateCS"]->GetBufferPointer()),
+		mShaders["wavesUpdateCS"]->GetBufferSize()
+	};
+	wavesUpdatePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["wavesUpdate"] = mPipelineCache->CreateComputePipeline(L"wavesUpdate", wavesUpdatePSO);
+
+	// The terrain's heightmap is written with the same root signature.
+	D3D12_COMPUTE_PIPELINE_STATE_DESC terrainHeightPSO = {};
+	terrainHeightPSO.pRootSignature = mWavesRootSignature.Get();
+	terrainHeightPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["terrainHeightCS"]->GetBufferPointer()),
+		mShaders["terrainHeightCS"]->GetBufferSize()
+	};
+	terrainHeightPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["terrainHeight"] = mPipelineCache->CreateComputePipeline(L"terrainHeight", terrainHeightPSO);
+
+	//
+	// PSO for the GPU frustum cull
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC frustumCullPsoDesc = {};
+	frustumCullPsoDesc.pRootSignature = mCullRootSignature.Get();
+	frustumCullPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["frustumCullCS"]->GetBufferPointer()),
+		mShaders["frustumCullCS"]->GetBufferSize()
+	};
+	frustumCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["frustumCull"] = mPipelineCache->CreateComputePipeline(L"frustumCull", frustumCullPsoDesc);
+
+	//
+	// PSO for building the depth pyramid
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC depthPyramidPsoDesc = {};
+	depthPyramidPsoDesc.pRootSignature = mDepthPyramidRootSignature.Get();
+	depthPyramidPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["downsampleDepthCS"]->GetBufferPointer()),
+		mShaders["downsampleDepthCS"]->GetBufferSize()
+	};
+	depthPyramidPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["depthPyramid"] = mPipelineCache->CreateComputePipeline(L"depthPyramid", depthPyramidPsoDesc);
+
+	//
+	// PSO for binning the lights into clusters
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC clusterLightsPsoDesc = {};
+	clusterLightsPsoDesc.pRootSignature = mClusterRootSignature.Get();
+	clusterLightsPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["clusterLightsCS"]->GetBufferPointer()),
+		mShaders["clusterLightsCS"]->GetBufferSize()
+	};
+	clusterLightsPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPSOs["clusterLights"] = mPipelineCache->CreateComputePipeline(L"clusterLights", clusterLightsPsoDesc);
+}
+
+void FinalApp::BuildDepthPrePassPSOs(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc,
+	const D3D12_SHADER_BYTECODE& prePassPS, const D3D12_SHADER_BYTECODE& mainPassPS)
+{
+	// Both twins keep desc's vertex shader and rasterizer state, so the main pass
+	// reproduces the pre-pass depths exactly and EQUAL holds.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC depthPsoDesc = desc;
+	depthPsoDesc.PS = prePassPS;
+	depthPsoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
+	mPSOs[name + "Depth"] = mPipelineCache->CreateGraphicsPipeline(AnsiToWString(name + "Depth"), depthPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC equalPsoDesc = desc;
+	equalPsoDesc.PS = mainPassPS;
+	equalPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+	equalPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	mPSOs[name + "Equal"] = mPipelineCache->CreateGraphicsPipeline(AnsiToWString(name + "Equal"), equalPsoDesc);
+}
+
+void FinalApp::ResolveFrameHandles()
+{
+	// at() rather than [], so a PSO that was never built fails here and not as a null
+	// pipeline in the middle of a frame.
+	for (int i = 0; i < (int)_countof(mLayerPipelines); ++i)
+	{
+		const bool instanced = (i & 1) != 0;
+		const bool bindless = (i & 2) != 0;
+		const bool prePass = (i & 4) != 0;
+
+		std::string opaquePSO = instanced ? "opaqueInstanced" : "opaque";
+		std::string alphaTestedPSO = instanced ? "alphaTestedInstanced" : "alphaTested";
+		std::string transparentPSO = "transparent";
+		if (bindless)
+		{
+			opaquePSO += "Bindless";
+			alphaTestedPSO += "Bindless";
+			transparentPSO += "Bindless";
+		}
+
+		LayerPipelines& p = mLayerPipelines[i];
+		if (prePass)
+		{
+			p.PrePass[(int)RenderLayer::Opaque] = mPSOs.at(opaquePSO + "Depth").Get();
+			p.PrePass[(int)RenderLayer::AlphaTested] = mPSOs.at(alphaTestedPSO + "Depth").Get();
+			opaquePSO += "Equal";
+			alphaTestedPSO += "Equal";
+		}
+		p.Layers[(int)RenderLayer::Opaque] = mPSOs.at(opaquePSO).Get();
+		p.Layers[(int)RenderLayer::AlphaTested] = mPSOs.at(alphaTestedPSO).Get();
+		p.Layers[(int)RenderLayer::Transparent] = mPSOs.at(transparentPSO).Get();
+		p.Layers[(int)RenderLayer::AlphaTestedTreeSprites] = mPSOs.at("treeSprites").Get();
+		p.Layers[(int)RenderLayer::Waves] = mPSOs.at("waves").Get();
+		p.Layers[(int)RenderLayer::GpuWaves] = mPSOs.at("wavesRender").Get();
+		p.Layers[(int)RenderLayer::Terrain] = mPSOs.at("terrain").Get();
+	}
+
+	mOpaquePSO = mPSOs.at("opaque").Get();
+	mOverlayPSO = mPSOs.at("overlay").Get();
+	mWavesDisturbPSO = mPSOs.at("wavesDisturb").Get();
+	mWavesUpdatePSO = mPSOs.at("wavesUpdate").Get();
+	mTerrainHeightPSO = mPSOs.at("terrainHeight").Get();
+	mFrustumCullPSO = mPSOs.at("frustumCull").Get();
+	mDepthPyramidPSO = mPSOs.at("depthPyramid").Get();
+	mClusterLightsPSO = mPSOs.at("clusterLights").Get();
+	mWaterMat = mMaterials.at("water").get();
 }
 
 void FinalApp::BuildFrameResources()
 {
-    for(int i = 0; i < gNumFrameResources; ++i)
+    for(int i = 0; i < gMaxFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            (UINT)mMaterials.size(), mWaves->VertexCount(), mInstanceCount, mCommandCount,
+            gNumLayerCmdLists, mLightCapacity, (UINT)mTrees.size()));
     }
 }
 
+void FinalApp::BuildComputeQueue()
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mComputeQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mComputeFence)));
+
+	// Reset onto the frame resource's allocator before each use.
+	ThrowIfFailed(md3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_COMPUTE,
+		mFrameResources[0]->ComputeCmdListAlloc.Get(),
+		nullptr,
+		IID_PPV_ARGS(mComputeCommandList.GetAddressOf())));
+	ThrowIfFailed(mComputeCommandList->Close());
+}
+
 void FinalApp::BuildMaterials()
 {
 	auto grass = std::make_unique<Material>();
@@ -2003,6 +3732,254 @@ void FinalApp::BuildMaterials()
 	mMaterials["sample1"] = std::move(sample1);
 	mMaterials["gate"] = std::move(gate);
 	mMaterials["bush"] = std::move(bush);
+
+	for(auto& e : mMaterials)
+		MarkMaterialDirty(e.second.get());
+}
+
+void FinalApp::BuildSceneItems()
+{
+	const std::uint64_t sourceHash = SceneSourceHash();
+
+	SceneFile scene;
+	if(scene.Load(gSceneFile, sourceHash) && LoadSceneItems(scene))
+		return;
+
+	// No usable bake: place the items by hand, bake them, and load the bake back so both
+	// paths leave exactly the same items (and collision-free ObjCBIndex values).
+	ClearSceneItems();
+	BuildRenderItems();
+	BuildRenderTowers();
+	BuildRotationItems();
+	BuildRenderGate();
+	BuilRenderMaze();
+	BakeScene(scene);
+
+	ClearSceneItems();
+	if(LoadSceneItems(scene))
+	{
+		// Failing to save only means baking again on the next run.
+		CreateDirectoryW(L"Scenes", nullptr);
+		scene.Save(gSceneFile, sourceHash);
+		return;
+	}
+
+	// The bake does not load back, so keep the hand-placed items and save nothing; the
+	// next run bakes again.
+	::OutputDebugStringA("BuildSceneItems: the baked scene does not load; using the builders' items.\n");
+	ClearSceneItems();
+	BuildRenderItems();
+	BuildRenderTowers();
+	BuildRotationItems();
+	BuildRenderGate();
+	BuilRenderMaze();
+}
+
+std::uint64_t FinalApp::SceneSourceHash()const
+{
+	std::uint64_t hash = SceneHashBytes(kSceneHashSeed, &gSceneBuilderRevision, sizeof(gSceneBuilderRevision));
+
+	// The builders resolve submeshes and materials by name, and the bake stores the
+	// names; hash them with what they resolve to, in name order as the maps are unordered.
+	std::vector<const std::string*> names;
+	for(const auto& e : mGeometries)
+		names.push_back(&e.first);
+	std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+	for(const std::string* name : names)
+	{
+		hash = SceneHashBytes(hash, name->c_str(), name->size() + 1);
+
+		const auto& drawArgs = mGeometries.at(*name)->DrawArgs;
+		std::vector<const std::string*> submeshes;
+		for(const auto& e : drawArgs)
+			submeshes.push_back(&e.first);
+		std::sort(submeshes.begin(), submeshes.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+		for(const std::string* submesh : submeshes)
+		{
+			const SubmeshGeometry& s = drawArgs.at(*submesh);
+			hash = SceneHashBytes(hash, submesh->c_str(), submesh->size() + 1);
+			hash = SceneHashBytes(hash, &s.IndexCount, sizeof(s.IndexCount));
+			hash = SceneHashBytes(hash, &s.StartIndexLocation, sizeof(s.StartIndexLocation));
+			hash = SceneHashBytes(hash, &s.BaseVertexLocation, sizeof(s.BaseVertexLocation));
+		}
+	}
+
+	names.clear();
+	for(const auto& e : mMaterials)
+		names.push_back(&e.first);
+	std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+	for(const std::string* name : names)
+	{
+		const Material* mat = mMaterials.at(*name).get();
+		hash = SceneHashBytes(hash, name->c_str(), name->size() + 1);
+		hash = SceneHashBytes(hash, &mat->MatCBIndex, sizeof(mat->MatCBIndex));
+		hash = SceneHashBytes(hash, &mat->DiffuseSrvHeapIndex, sizeof(mat->DiffuseSrvHeapIndex));
+	}
+
+	return hash;
+}
+
+bool FinalApp::LoadSceneItems(const SceneFile& scene)
+{
+	// Resolve each name once; the instances only index into these tables.
+	struct MeshLods
+	{
+		SubmeshGeometry Lods[MaxMeshLods];
+		UINT LodCount = 0;
+	};
+
+	std::vector<MeshGeometry*> geos;
+	std::vector<MeshLods> submeshes;
+	for(const SceneMeshRef& mesh : scene.Meshes())
+	{
+		auto geo = mGeometries.find(mesh.Geometry);
+		if(geo == mGeometries.end())
+			return false;
+
+		auto submesh = geo->second->DrawArgs.find(mesh.Submesh);
+		if(submesh == geo->second->DrawArgs.end())
+			return false;
+
+		// The scene names the finest level; the rest of its chain, if any, follows it.
+		MeshLods lods;
+		lods.Lods[lods.LodCount++] = submesh->second;
+		while(lods.LodCount < MaxMeshLods)
+		{
+			auto lod = geo->second->DrawArgs.find(LodSubmeshName(mesh.Submesh, lods.LodCount));
+			if(lod == geo->second->DrawArgs.end())
+				break;
+
+			lods.Lods[lods.LodCount++] = lod->second;
+		}
+
+		geos.push_back(geo->second.get());
+		submeshes.push_back(lods);
+	}
+
+	std::vector<Material*> mats;
+	for(const SceneMaterialRef& mat : scene.Materials())
+	{
+		auto it = mMaterials.find(mat.Name);
+		if(it == mMaterials.end())
+			return false;
+
+		mats.push_back(it->second.get());
+	}
+
+	const auto& instances = scene.Instances();
+	mAllRitems.reserve(instances.size() + 1);
+	for(const SceneInstance& inst : instances)
+	{
+		if(inst.Layer >= (std::uint32_t)RenderLayer::Count || inst.ObjCBIndex >= instances.size())
+			return false;
+
+		auto ri = std::make_unique<RenderItem>();
+		ri->World = inst.World;
+		ri->TexTransform = inst.TexTransform;
+		ri->Bounds = inst.Bounds;
+		ri->ObjCBIndex = inst.ObjCBIndex;
+		ri->Mat = mats[inst.Material];
+		ri->Geo = geos[inst.Mesh];
+		ri->PrimitiveType = (D3D12_PRIMITIVE_TOPOLOGY)inst.PrimitiveType;
+		const MeshLods& lods = submeshes[inst.Mesh];
+		ri->IndexCount = lods.Lods[0].IndexCount;
+		ri->StartIndexLocation = lods.Lods[0].StartIndexLocation;
+		ri->BaseVertexLocation = lods.Lods[0].BaseVertexLocation;
+		ri->LodCount = lods.LodCount;
+		for(UINT l = 0; l < lods.LodCount; ++l)
+			ri->Lods[l] = lods.Lods[l];
+
+		if(inst.Layer == (std::uint32_t)RenderLayer::Waves)
+			mWavesRitem = ri.get();
+		else if(inst.Layer == (std::uint32_t)RenderLayer::AlphaTestedTreeSprites)
+			mTreeSpritesRitem = ri.get();
+
+		mRitemLayer[inst.Layer].push_back(ri.get());
+		mAllRitems.push_back(std::move(ri));
+	}
+
+	for(const SceneAnimation& anim : scene.Animations())
+	{
+		RenderItemAnimation a;
+		a.Ritem = mAllRitems[anim.Instance].get();
+		a.Scale = anim.Scale;
+		a.Position = anim.Position;
+		a.StartAngle = anim.StartAngle;
+		a.AngularSpeed = anim.AngularSpeed;
+		a.BoundsCenter = anim.BoundsCenter;
+		a.SlideAxis = anim.SlideAxis;
+		a.SlideDistance = anim.SlideDistance;
+		a.SlidePeriod = anim.SlidePeriod;
+		mAnimations.push_back(a);
+	}
+
+	// The CPU waves item is required by the wave update and the GPU waves item.
+	return mWavesRitem != nullptr;
+}
+
+void FinalApp::BakeScene(SceneFile& scene)const
+{
+	scene.Clear();
+
+	std::unordered_map<const RenderItem*, std::uint32_t> instanceOf;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for(const RenderItem* ri : mRitemLayer[layer])
+		{
+			// The builders copy DrawArgs by value; find the submesh they copied.
+			std::string submesh;
+			for(const auto& e : ri->Geo->DrawArgs)
+			{
+				if(e.second.IndexCount == ri->IndexCount &&
+					e.second.StartIndexLocation == ri->StartIndexLocation &&
+					e.second.BaseVertexLocation == ri->BaseVertexLocation)
+				{
+					submesh = e.first;
+					break;
+				}
+			}
+			assert(!submesh.empty());
+
+			SceneInstance inst;
+			inst.World = ri->World;
+			inst.TexTransform = ri->TexTransform;
+			inst.Bounds = ri->Bounds;
+			inst.Mesh = scene.AddMesh(ri->Geo->Name, submesh);
+			inst.Material = scene.AddMaterial(ri->Mat->Name);
+			inst.Layer = (std::uint32_t)layer;
+			inst.PrimitiveType = (std::uint32_t)ri->PrimitiveType;
+
+			instanceOf[ri] = scene.AddInstance(inst);
+		}
+	}
+
+	for(const RenderItemAnimation& a : mAnimations)
+	{
+		SceneAnimation anim;
+		anim.Instance = instanceOf.at(a.Ritem);
+		anim.Scale = a.Scale;
+		anim.Position = a.Position;
+		anim.StartAngle = a.StartAngle;
+		anim.AngularSpeed = a.AngularSpeed;
+		anim.BoundsCenter = a.BoundsCenter;
+		anim.SlideAxis = a.SlideAxis;
+		anim.SlideDistance = a.SlideDistance;
+		anim.SlidePeriod = a.SlidePeriod;
+		scene.AddAnimation(anim);
+	}
+}
+
+void FinalApp::ClearSceneItems()
+{
+	mAllRitems.clear();
+	for(auto& layer : mRitemLayer)
+		layer.clear();
+	mAnimations.clear();
+	mWavesRitem = nullptr;
+	mTreeSpritesRitem = nullptr;
 }
 
 void FinalApp::BuildRenderItems()
@@ -2022,7 +3999,7 @@ void FinalApp::BuildRenderItems()
 	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
     mWavesRitem = wavesRitem.get();
 
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+	mRitemLayer[(int)RenderLayer::Waves].push_back(wavesRitem.get());
 
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
@@ -2072,10 +4049,10 @@ void FinalApp::BuildRenderItems()
 	treeSpritesRitem->ObjCBIndex = 3;
 	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
 	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["quad"].IndexCount;
+	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["quad"].StartIndexLocation;
+	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["quad"].BaseVertexLocation;
 
 
 
@@ -2578,16 +4555,16 @@ void FinalApp::BuildRotationItems()
 	UINT objCBIndex = 28;
 	auto Merlons2 = std::make_unique<RenderItem>();
 
+	// Spinning diamond above the keep; its World is rebuilt by AnimateRenderItems.
+	RenderItemAnimation spin;
+	spin.Ritem = Merlons2.get();
+	spin.Scale = XMFLOAT3(10.0f, 10.0f, 10.0f);
+	spin.Position = XMFLOAT3(0.0f, 34.0f, 0.0f);
+	spin.StartAngle = 45.0f;
+	spin.AngularSpeed = 20.0f;
+	mAnimations.push_back(spin);
 
-	float angle = 45;
-	static float t_base = 0.0f;
-	if ((mTimer.TotalTime() - t_base) >= 0.25f)
-	{
-		t_base += 1.25f;
-		angle += 0.25;
-	}
-
-	XMStoreFloat4x4(&Merlons2->World, XMMatrixScaling(10.0f, 10.0f, 10.0f) * XMMatrixRotationY(XMConvertToRadians(angle += 20 * mTimer.TotalTime())) * XMMatrixTranslation(0.0f, 34.0f, 0.0f));
+	XMStoreFloat4x4(&Merlons2->World, XMMatrixScaling(10.0f, 10.0f, 10.0f) * XMMatrixRotationY(XMConvertToRadians(45.0f)) * XMMatrixTranslation(0.0f, 34.0f, 0.0f));
 	XMStoreFloat4x4(&Merlons2->TexTransform, XMMatrixScaling(5.0f, 10.0f, 5.0f));
 	Merlons2->ObjCBIndex = objCBIndex++;
 	Merlons2->Mat = mMaterials["wall2"].get();
@@ -3106,253 +5083,1132 @@ void FinalApp::BuilRenderMaze()
 
 	mazeWallRight6->Bounds = boundsMaz8;//
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallRight6.get());
-	mAllRitems.push_back(std::move(mazeWallRight6));
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallRight6.get());
+	mAllRitems.push_back(std::move(mazeWallRight6));
+
+
+	//MAZE WALL LEFT SIDE
+	auto mazeWallLeft = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-28.5f, 5.0f, -86.5f));
+	XMStoreFloat4x4(&mazeWallLeft->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft->ObjCBIndex = objCBIndex++;
+	mazeWallLeft->Mat = mMaterials["bush"].get();
+	mazeWallLeft->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft->IndexCount = mazeWallLeft->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft->StartIndexLocation = mazeWallLeft->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft->BaseVertexLocation = mazeWallLeft->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze9;
+	XMStoreFloat3(&boundsMaze9.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze9.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft->Bounds = boundsMaze9;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft.get());
+	mAllRitems.push_back(std::move(mazeWallLeft));
+
+
+	auto mazeWallleft2 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallleft2->World, XMMatrixScaling(3.0f, 15.0f, 70.0f)* XMMatrixTranslation(-50.0f, 5.0f, -120.0f));
+	XMStoreFloat4x4(&mazeWallleft2->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallleft2->ObjCBIndex = objCBIndex++;
+	mazeWallleft2->Mat = mMaterials["bush"].get();
+	mazeWallleft2->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallleft2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallleft2->IndexCount = mazeWallleft2->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallleft2->StartIndexLocation = mazeWallleft2->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallleft2->BaseVertexLocation = mazeWallleft2->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze10;
+	XMStoreFloat3(&boundsMaze10.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), XMVectorGetY(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), XMVectorGetZ(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze10.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[2]), 1.0f));
+
+	mazeWallleft2->Bounds = boundsMaze10;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallleft2.get());
+	mAllRitems.push_back(std::move(mazeWallleft2));
+
+
+
+	auto mazeWallLeft3 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft3->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-23.5f, 5.0f, -156.5f));
+	XMStoreFloat4x4(&mazeWallLeft3->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft3->ObjCBIndex = objCBIndex++;
+	mazeWallLeft3->Mat = mMaterials["bush"].get();
+	mazeWallLeft3->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft3->IndexCount = mazeWallLeft3->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft3->StartIndexLocation = mazeWallLeft3->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft3->BaseVertexLocation = mazeWallLeft3->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	BoundingBox boundsMaze11;
+	//HEAD
+	XMStoreFloat3(&boundsMaze11.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze11.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft3->Bounds = boundsMaze11;//
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft3.get());
+	mAllRitems.push_back(std::move(mazeWallLeft3));
+
+	auto mazeWallLeft4 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft4->World, XMMatrixScaling(3.0f, 15.0f, 20.0f)* XMMatrixTranslation(-11.5f, 5.0f, -135.5f));
+	XMStoreFloat4x4(&mazeWallLeft4->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft4->ObjCBIndex = objCBIndex++;
+	mazeWallLeft4->Mat = mMaterials["bush"].get();
+	mazeWallLeft4->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft4->IndexCount = mazeWallLeft4->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft4->StartIndexLocation = mazeWallLeft4->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft4->BaseVertexLocation = mazeWallLeft4->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze12;
+	XMStoreFloat3(&boundsMaze12.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze12.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[2]), 1.0f));
+
+	mazeWallLeft4->Bounds = boundsMaze12;//
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft4.get());
+	mAllRitems.push_back(std::move(mazeWallLeft4));
+
+	auto mazeWallLeft5 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft5->World, XMMatrixScaling(3.0f, 15.0f, 20.0f)* XMMatrixTranslation(1.5f, 5.0f, -135.5f));
+	XMStoreFloat4x4(&mazeWallLeft5->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft5->ObjCBIndex = objCBIndex++;
+	mazeWallLeft5->Mat = mMaterials["bush"].get();
+	mazeWallLeft5->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft5->IndexCount = mazeWallLeft5->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft5->StartIndexLocation = mazeWallLeft5->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft5->BaseVertexLocation = mazeWallLeft5->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze13;
+	XMStoreFloat3(&boundsMaze13.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze13.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[2]), 1.0f));
+	mazeWallLeft5->Bounds = boundsMaze13;//
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft5.get());
+	mAllRitems.push_back(std::move(mazeWallLeft5));
+
+
+	auto mazeWallLeft6 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft6->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(22.5f, 5.0f, -156.5f));
+	XMStoreFloat4x4(&mazeWallLeft6->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft6->ObjCBIndex = objCBIndex++;
+	mazeWallLeft6->Mat = mMaterials["bush"].get();
+	mazeWallLeft6->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft6->IndexCount = mazeWallLeft6->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft6->StartIndexLocation = mazeWallLeft6->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft6->BaseVertexLocation = mazeWallLeft6->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze14;
+	XMStoreFloat3(&boundsMaze14.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), XMVectorGetY(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze14.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft6->Bounds = boundsMaze14;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft6.get());
+	mAllRitems.push_back(std::move(mazeWallLeft6));
+
+
+
+	auto mazeWallLeft7 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft7->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-15.5f, 5.0f, -110.5f));
+	XMStoreFloat4x4(&mazeWallLeft7->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft7->ObjCBIndex = objCBIndex++;
+	mazeWallLeft7->Mat = mMaterials["bush"].get();
+	mazeWallLeft7->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft7->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft7->IndexCount = mazeWallLeft7->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft7->StartIndexLocation = mazeWallLeft7->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft7->BaseVertexLocation = mazeWallLeft7->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze15;
+
+	//HEAD
+	XMStoreFloat3(&boundsMaze15.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze15.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft7->Bounds = boundsMaze15;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft7.get());
+	mAllRitems.push_back(std::move(mazeWallLeft7));
+
+
+
+	auto mazeWallLeft8 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft8->World, XMMatrixScaling(25.0f, 15.0f, 3.0f)* XMMatrixTranslation(-24.5f, 5.0f, -135.5f));
+	XMStoreFloat4x4(&mazeWallLeft8->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft8->ObjCBIndex = objCBIndex++;
+	mazeWallLeft8->Mat = mMaterials["bush"].get();
+	mazeWallLeft8->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft8->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft8->IndexCount = mazeWallLeft8->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft8->StartIndexLocation = mazeWallLeft8->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft8->BaseVertexLocation = mazeWallLeft8->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	BoundingBox boundsMaze16;
+	XMStoreFloat3(&boundsMaze16.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze16.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft8->Bounds = boundsMaze16;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft8.get());
+	mAllRitems.push_back(std::move(mazeWallLeft8));
+
+
+	auto mazeWallLeft9 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft9->World, XMMatrixScaling(3.0f, 15.0f, 26.0f)* XMMatrixTranslation(-36.5f, 5.0f, -115.5f));
+	XMStoreFloat4x4(&mazeWallLeft9->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft9->ObjCBIndex = objCBIndex++;
+	mazeWallLeft9->Mat = mMaterials["bush"].get();
+	mazeWallLeft9->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft9->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft9->IndexCount = mazeWallLeft9->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft9->StartIndexLocation = mazeWallLeft9->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft9->BaseVertexLocation = mazeWallLeft9->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze17;
+	XMStoreFloat3(&boundsMaze17.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze17.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[2]), 1.0f));
+
+	mazeWallLeft9->Bounds = boundsMaze17;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft9.get());
+	mAllRitems.push_back(std::move(mazeWallLeft9));
+
+
+
+
+
+	auto mazeWallLeft11 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mazeWallLeft11->World, XMMatrixScaling(30.0f, 15.0f, 3.0f)* XMMatrixTranslation(-35.5f, 5.0f, -146.5f));
+	XMStoreFloat4x4(&mazeWallLeft11->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
+	mazeWallLeft11->ObjCBIndex = objCBIndex++;
+	mazeWallLeft11->Mat = mMaterials["bush"].get();
+	mazeWallLeft11->Geo = mGeometries["mazeWallGeo"].get();
+	mazeWallLeft11->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	mazeWallLeft11->IndexCount = mazeWallLeft11->Geo->DrawArgs["mazeWall"].IndexCount;
+	mazeWallLeft11->StartIndexLocation = mazeWallLeft11->Geo->DrawArgs["mazeWall"].StartIndexLocation;
+	mazeWallLeft11->BaseVertexLocation = mazeWallLeft11->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+
+	BoundingBox boundsMaze19;
+	XMStoreFloat3(&boundsMaze19.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), 1.0f));
+	XMStoreFloat3(&boundsMaze19.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[2]), 1.0f));
+
+	mazeWallLeft11->Bounds = boundsMaze19;//
+
+	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft11.get());
+	mAllRitems.push_back(std::move(mazeWallLeft11));
+
+}
+void FinalApp::BuildGpuWavesItems()
+{
+	// Same placement and material as the CPU waves item; drawn instead of it in GPU mode.
+	auto gpuWavesRitem = std::make_unique<RenderItem>();
+	gpuWavesRitem->World = mWavesRitem->World;
+	gpuWavesRitem->TexTransform = mWavesRitem->TexTransform;
+	gpuWavesRitem->GridSpatialStep = mGpuWaves->SpatialStep();
+	gpuWavesRitem->ObjCBIndex = (UINT)mAllRitems.size();
+	gpuWavesRitem->Mat = mMaterials["water"].get();
+	gpuWavesRitem->Geo = mGeometries["gpuWaterGeo"].get();
+	gpuWavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	gpuWavesRitem->IndexCount = gpuWavesRitem->Geo->DrawArgs["grid"].IndexCount;
+	gpuWavesRitem->StartIndexLocation = gpuWavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
+	gpuWavesRitem->BaseVertexLocation = gpuWavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	gpuWavesRitem->Clusters = &mGpuWavesRuns;
+	mGpuWavesRitem = gpuWavesRitem.get();
+
+	mRitemLayer[(int)RenderLayer::GpuWaves].push_back(gpuWavesRitem.get());
+
+	mAllRitems.push_back(std::move(gpuWavesRitem));
+}
+
+void FinalApp::BuildTerrainItems()
+{
+	// Not part of the scene file; its patches are the same whatever the scene holds.
+	auto terrainRitem = std::make_unique<RenderItem>();
+	terrainRitem->World = MathHelper::Identity4x4();
+	XMStoreFloat4x4(&terrainRitem->TexTransform, XMMatrixScaling(400.0f, 400.0f, 1.0f));
+	terrainRitem->GridSpatialStep = mTerrain->TexelSpacing();
+	terrainRitem->ObjCBIndex = (UINT)mAllRitems.size();
+	terrainRitem->Mat = mMaterials["grass"].get();
+	terrainRitem->Geo = mGeometries["terrainGeo"].get();
+	terrainRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST;
+	terrainRitem->IndexCount = terrainRitem->Geo->DrawArgs["patches"].IndexCount;
+	terrainRitem->StartIndexLocation = terrainRitem->Geo->DrawArgs["patches"].StartIndexLocation;
+	terrainRitem->BaseVertexLocation = terrainRitem->Geo->DrawArgs["patches"].BaseVertexLocation;
+	mTerrainRitem = terrainRitem.get();
+
+	mRitemLayer[(int)RenderLayer::Terrain].push_back(terrainRitem.get());
+
+	mAllRitems.push_back(std::move(terrainRitem));
+}
+
+void FinalApp::BuildMazeItems()
+{
+	// Every wall item the streamer will ever use is made here, parked.  They all share
+	// the hand-placed maze's mesh and material, so they join its instance batch.
+	const UINT wallsPerChunk = mMaze->MaxWallsPerChunk();
+	const int slotsPerSide = 2 * kMazeEvictRadius + 1;
+
+	MeshGeometry* geo = mGeometries["mazeWallGeo"].get();
+	const SubmeshGeometry& wall = geo->DrawArgs["mazeWall"];
+	Material* mat = mMaterials["bush"].get();
+
+	mMazeSlots.assign(slotsPerSide * slotsPerSide, MazeChunkSlot());
+	for (size_t s = 0; s < mMazeSlots.size(); ++s)
+	{
+		mMazeSlots[s].FirstItem = (UINT)mMazeWallItems.size();
+
+		for (UINT i = 0; i < wallsPerChunk; ++i)
+		{
+			auto wallRitem = std::make_unique<RenderItem>();
+			wallRitem->ObjCBIndex = (UINT)mAllRitems.size();
+			wallRitem->Mat = mat;
+			wallRitem->Geo = geo;
+			wallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			wallRitem->IndexCount = wall.IndexCount;
+			wallRitem->StartIndexLocation = wall.StartIndexLocation;
+			wallRitem->BaseVertexLocation = wall.BaseVertexLocation;
+			ParkMazeWall(wallRitem.get());
+
+			mMazeWallItems.push_back(wallRitem.get());
+			mRitemLayer[(int)RenderLayer::Opaque].push_back(wallRitem.get());
+			mAllRitems.push_back(std::move(wallRitem));
+		}
+	}
+
+	BuildMazeCollision();
+}
+
+void FinalApp::BuildCollisionGrid()
+{
+	std::vector<BoundingBox> staticBounds;
+	mDynamicColliders.clear();
+
+	for (auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		// The maze pool is all parked here; its walls go into mMazeCollisionGrid as
+		// their chunks load.
+		if (!ri->Active)
+			continue;
+
+		bool animated = std::any_of(mAnimations.begin(), mAnimations.end(),
+			[ri](const RenderItemAnimation& a) { return a.Ritem == ri; });
+
+		if (animated)
+			mDynamicColliders.push_back(ri);
+		else
+			staticBounds.push_back(ri->Bounds);
+	}
+
+	mCollisionGrid.Build(staticBounds, kCollisionCellSize);
+	mCollisionCandidates.reserve(staticBounds.size());
+}
+
+void FinalApp::BuildCullBounds()
+{
+	for(auto& ri : mAllRitems)
+	{
+		// Only static geometry in the standard vertex format keeps a CPU copy we can read.
+		MeshGeometry* geo = ri->Geo;
+		if(geo->VertexBufferCPU == nullptr || geo->IndexBufferCPU == nullptr ||
+			geo->VertexByteStride != sizeof(Vertex) || ri->IndexCount == 0)
+			continue;
+
+		auto vertices = reinterpret_cast<const Vertex*>(geo->VertexBufferCPU->GetBufferPointer());
+
+		XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+		XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+
+		XMVECTOR vMin = XMLoadFloat3(&vMinf3);
+		XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+
+		// Only the vertices the submesh references, since geometries can hold several.
+		for(UINT i = 0; i < ri->IndexCount; ++i)
+		{
+			UINT v = ri->BaseVertexLocation + geo->Index(ri->StartIndexLocation + i);
+			XMVECTOR P = XMLoadFloat3(&vertices[v].Pos);
+
+			vMin = XMVectorMin(vMin, P);
+			vMax = XMVectorMax(vMax, P);
+		}
+
+		XMStoreFloat3(&ri->LocalBounds.Center, 0.5f*(vMin + vMax));
+		XMStoreFloat3(&ri->LocalBounds.Extents, 0.5f*(vMax - vMin));
+
+		// Parked maze walls keep their unreachable box until their chunk loads.
+		if(ri->Active)
+			ri->LocalBounds.Transform(ri->CullBounds, XMLoadFloat4x4(&ri->World));
+
+		// The GPU waves grid and the terrain are displaced on the GPU, so their flat boxes
+		// are wrong.
+		ri->Cullable = (ri.get() != mGpuWavesRitem && ri.get() != mTerrainRitem);
+	}
+}
+
+void FinalApp::BuildInstanceBatches()
+{
+	UINT instanceIndex = 0;
+	UINT commandIndex = 0;
+	UINT culledInstanceIndex = 0;
+
+	const RenderLayer instancedLayers[] = { RenderLayer::Opaque, RenderLayer::AlphaTested };
+	for (RenderLayer layer : instancedLayers)
+	{
+		auto& batches = mInstanceBatches[(int)layer];
+		batches.clear();
+
+		for (auto ri : mRitemLayer[(int)layer])
+		{
+			// CullRenderItems may have left an item's draw args on a coarser LOD.
+			SubmeshGeometry args;
+			args.IndexCount = ri->IndexCount;
+			args.StartIndexLocation = ri->StartIndexLocation;
+			args.BaseVertexLocation = ri->BaseVertexLocation;
+			if (ri->LodCount > 1)
+				args = ri->Lods[0];
+
+			auto it = std::find_if(batches.begin(), batches.end(), [ri, &args](const InstanceBatch& b)
+			{
+				return b.Geo == ri->Geo && b.Mat == ri->Mat &&
+					b.PrimitiveType == ri->PrimitiveType &&
+					b.IndexCount == args.IndexCount &&
+					b.StartIndexLocation == args.StartIndexLocation &&
+					b.BaseVertexLocation == args.BaseVertexLocation;
+			});
+
+			if (it == batches.end())
+			{
+				InstanceBatch batch;
+				batch.Geo = ri->Geo;
+				batch.Mat = ri->Mat;
+				batch.PrimitiveType = ri->PrimitiveType;
+				batch.IndexCount = args.IndexCount;
+				batch.StartIndexLocation = args.StartIndexLocation;
+				batch.BaseVertexLocation = args.BaseVertexLocation;
+				batch.LodCount = ri->LodCount;
+				for (UINT l = 1; l < ri->LodCount; ++l)
+					batch.Lods[l] = ri->Lods[l];
+				batch.Lods[0] = args;
+				batches.push_back(batch);
+				it = batches.end() - 1;
+			}
+
+			it->Instances.push_back(ri);
+		}
+
+		// Keep batches that share buffers and texture adjacent, so DrawIndirectBatches
+		// can cover them with a single ExecuteIndirect.
+		std::stable_sort(batches.begin(), batches.end(), [](const InstanceBatch& a, const InstanceBatch& b)
+		{
+			if (a.Geo->VertexBufferGPU != b.Geo->VertexBufferGPU)
+				return a.Geo->VertexBufferGPU.Get() < b.Geo->VertexBufferGPU.Get();
+			if (a.PrimitiveType != b.PrimitiveType)
+				return a.PrimitiveType < b.PrimitiveType;
+			return a.Mat->DiffuseSrvHeapIndex < b.Mat->DiffuseSrvHeapIndex;
+		});
+
+		// Lay each batch's instances out contiguously in the instance buffer.
+		for (auto& batch : batches)
+		{
+			batch.FirstInstance = instanceIndex;
+			batch.CommandIndex = commandIndex;
+			batch.CulledFirstInstance = culledInstanceIndex;
+			commandIndex += batch.LodCount;
+			culledInstanceIndex += batch.LodCount * (UINT)batch.Instances.size();
+			batch.VisibleCount = (UINT)batch.Instances.size();
+			batch.LodVisibleCounts[0] = batch.VisibleCount;
+			for (auto ri : batch.Instances)
+			{
+				ri->InstanceIndex = instanceIndex++;
+				ri->CommandIndex = batch.CommandIndex;
+			}
+		}
+	}
+
+	mInstanceCount = instanceIndex;
+	mCommandCount = commandIndex;
+	mCulledInstanceCount = culledInstanceIndex;
+
+	// The first frame copies every instance into the instance buffer; after that only
+	// the items that move or stream in are copied again.
+	for(auto& e : mAllRitems)
+		MarkRitemDirty(e.get());
+}
+
+void FinalApp::BuildCullResources()
+{
+	auto defaultHeap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+
+	// Room for every instance of a batch at each of its LODs.
+	auto instanceDesc = CD3DX12_RESOURCE_DESC::Buffer(
+		std::max<UINT>(mCulledInstanceCount, 1) * sizeof(InstanceData), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	auto commandDesc = CD3DX12_RESOURCE_DESC::Buffer(
+		std::max<UINT>(mCommandCount, 1) * sizeof(IndirectCommand), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	for(auto& frameResource : mFrameResources)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(&defaultHeap, D3D12_HEAP_FLAG_NONE,
+			&instanceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&frameResource->CulledInstanceBuffer)));
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(&defaultHeap, D3D12_HEAP_FLAG_NONE,
+			&commandDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&frameResource->IndirectCommandBuffer)));
+	}
+
+	auto sourceDesc = CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT>(mInstanceCount, 1) * sizeof(InstanceData));
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(&defaultHeap, D3D12_HEAP_FLAG_NONE,
+		&sourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&mInstanceBuffer)));
+
+	// The instance buffer rests where the vertex shaders and the cull read it.
+	D3D12_RESOURCE_BARRIER toRead = CD3DX12_RESOURCE_BARRIER::Transition(mInstanceBuffer.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	mCommandList->ResourceBarrier(1, &toRead);
+
+	// Each command rebinds the instance SRV and material CBV of the graphics root
+	// signature before its draw.
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[3] = {};
+	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+	argumentDescs[0].ShaderResourceView.RootParameterIndex = 4;
+	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+	argumentDescs[1].ConstantBufferView.RootParameterIndex = 3;
+	argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	commandSignatureDesc.pArgumentDescs = argumentDescs;
+	commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+	commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc,
+		mRootSignature.Get(), IID_PPV_ARGS(&mCullCommandSignature)));
+
+	// The command templates only depend on addresses that never change, so every
+	// frame resource gets its copy once, here, pointing at its own outputs.
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	for(auto& frameResource : mFrameResources)
+	{
+		auto matCB = frameResource->MaterialCB->Resource();
+		auto culledInstances = frameResource->CulledInstanceBuffer.Get();
+		for(auto& batches : mInstanceBatches)
+		{
+			for(auto& b : batches)
+			{
+				for(UINT l = 0; l < b.LodCount; ++l)
+				{
+					UINT firstInstance = b.CulledFirstInstance + l * (UINT)b.Instances.size();
+
+					IndirectCommand command;
+					command.InstanceSrv = culledInstances->GetGPUVirtualAddress() + firstInstance*sizeof(InstanceData);
+					command.MaterialCbv = matCB->GetGPUVirtualAddress() + b.Mat->MatCBIndex*matCBByteSize;
+					command.DrawArgs.IndexCountPerInstance = b.Lods[l].IndexCount;
+					command.DrawArgs.InstanceCount = 0;
+					command.DrawArgs.StartIndexLocation = b.Lods[l].StartIndexLocation;
+					command.DrawArgs.BaseVertexLocation = b.Lods[l].BaseVertexLocation;
+					command.DrawArgs.StartInstanceLocation = 0;
+					command.FirstInstance = firstInstance;
+					command.LodCount = b.LodCount;
+
+					frameResource->IndirectCommands->CopyData(b.CommandIndex + l, command);
+				}
+			}
+		}
+	}
+}
+
+void FinalApp::DispatchFrustumCull(ID3D12GraphicsCommandList* cmdList, bool onComputeQueue)
+{
+	GpuProfileScope scope(mProfiler.get(), cmdList, "Frustum cull");
+
+	ID3D12Resource* commandBuffer = mCurrFrameResource->IndirectCommandBuffer.Get();
+	ID3D12Resource* culledInstances = mCurrFrameResource->CulledInstanceBuffer.Get();
+
+	// Reset the instance counts by copying in the zeroed templates.
+	D3D12_RESOURCE_BARRIER toCopyDest = CD3DX12_RESOURCE_BARRIER::Transition(commandBuffer,
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+	cmdList->ResourceBarrier(1, &toCopyDest);
+
+	cmdList->CopyBufferRegion(commandBuffer, 0,
+		mCurrFrameResource->IndirectCommands->Resource(), 0, mCommandCount * sizeof(IndirectCommand));
+
+	D3D12_RESOURCE_BARRIER toUav[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(commandBuffer,
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+		CD3DX12_RESOURCE_BARRIER::Transition(culledInstances,
+			D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+	};
+	cmdList->ResourceBarrier(_countof(toUav), toUav);
+
+	cmdList->SetComputeRootSignature(mCullRootSignature.Get());
+	cmdList->SetPipelineState(mFrustumCullPSO);
+
+	cmdList->SetComputeRootConstantBufferView(0, mCullCBAddress);
+	cmdList->SetComputeRootShaderResourceView(1, mInstanceBuffer->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(2, culledInstances->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(3, commandBuffer->GetGPUVirtualAddress());
+	cmdList->SetComputeRootDescriptorTable(4, mDepthPyramids[mCullPyramid]->Srv());
+
+	// 64 instances per group.
+	cmdList->Dispatch((mInstanceCount + 63) / 64, 1, 1);
+
+	// On the compute queue the outputs go back to COMMON, from which the draws promote
+	// them, and decay back to it when the frame is done.
+	D3D12_RESOURCE_STATES commandState = onComputeQueue ?
+		D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+	D3D12_RESOURCE_STATES instanceState = onComputeQueue ?
+		D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+	D3D12_RESOURCE_BARRIER toDraw[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(commandBuffer,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, commandState),
+		CD3DX12_RESOURCE_BARRIER::Transition(culledInstances,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, instanceState)
+	};
+	cmdList->ResourceBarrier(_countof(toDraw), toDraw);
+}
+
+void FinalApp::BuildDepthPyramid(ID3D12GraphicsCommandList* cmdList)
+{
+	GpuProfileScope scope(mProfiler.get(), cmdList, "Depth pyramid");
+
+	// Compute has its own root signature and arguments, so the layer's graphics
+	// bindings survive; the next chunk sets its PSO again.
+	mDepthPyramids[mFrameNumber & 1]->Execute(cmdList, mDepthPyramidRootSignature.Get(), mDepthPyramidPSO,
+		mDepthStencilBuffer.Get());
+}
+
+void FinalApp::BuildLights()
+{
+	// The castle's lights, once rewritten every frame into the pass constants.
+	Light light;
+
+	// lights for the towers
+	light.Strength = { 255.0f / 4.0f, 192.0f / 4.0f, 203.0f / 4.0f };
+	light.Position = { -16.5f, 15.5f, +16.5f };
+	mPointLights.push_back(light);
+	light.Position = { 16.5f, 15.5f, +16.5f };
+	mPointLights.push_back(light);
+	light.Position = { -16.5f, 15.5f, -16.5f };
+	mPointLights.push_back(light);
+	light.Position = { 16.5f, 15.5f, -16.5f };
+	mPointLights.push_back(light);
+
+	//Centre light
+	light.Strength = { 5.35f, 5.35f, 5.35f };
+	light.Position = { 0.0f, 30.0f, 0.0f };
+	mPointLights.push_back(light);
+
+	light.Strength = { 1.0, 0.3f, 0.0f };
+	light.Position = { 34.0f, 10.0f, 34.0f };
+	mPointLights.push_back(light);
+	light.Position = { 34.0f, 10.0f, 4.0f };
+	mPointLights.push_back(light);
+	light.Position = { -34.0f, 10.0f, 34.0f };
+	mPointLights.push_back(light);
+	light.Position = { -34.0f, 10.0f, 4.0f };
+	mPointLights.push_back(light);
+
+	Light spot;
+	spot.Position = { 0.0f, 45.0f, 0.0f };
+	spot.Direction = { 0.0f, -1.0f, 0.0f };
+	spot.Strength = { 5.35f, 5.35f, 5.35f };
+	spot.SpotPower = 0.95f;
+	mSpotLights.push_back(spot);
+
+	// Room for every maze slot to hold a full chunk's torches.
+	const UINT torchesPerChunk = (mMaze->MaxWallsPerChunk() + kMazeTorchSpacing - 1) / kMazeTorchSpacing;
+	mLightCapacity = (UINT)(mPointLights.size() + mSpotLights.size()) + (UINT)mMazeSlots.size() * torchesPerChunk;
+}
+
+void FinalApp::BuildTrees()
+{
+	const float groundY = 0.5f;
+
+	for(const XMFLOAT2& p : gTreePositions)
+	{
+		TreeInstance tree;
+		tree.Pos = XMFLOAT3(p.x, groundY + 0.5f * gTreeSize.y, p.y);
+		tree.Size = gTreeSize;
+		tree.Slice = (UINT)mTrees.size() % 3;
+		mTrees.push_back(tree);
+	}
+
+	// Seeded, so the scatter is the same every run.  The square root spreads the
+	// trees evenly over the ring's area instead of bunching them at its inner edge.
+	std::mt19937 rng(gTreeScatterSeed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for(const TreeScatter& scatter : gTreeScatters)
+	{
+		const float inner2 = scatter.InnerRadius * scatter.InnerRadius;
+		const float outer2 = scatter.OuterRadius * scatter.OuterRadius;
+		for(UINT i = 0; i < scatter.Count; ++i)
+		{
+			float r = sqrtf(inner2 + unit(rng) * (outer2 - inner2));
+			float theta = unit(rng) * XM_2PI;
+			float size = scatter.MinSize + unit(rng) * (scatter.MaxSize - scatter.MinSize);
+
+			TreeInstance tree;
+			tree.Pos = XMFLOAT3(r * cosf(theta), groundY + 0.5f * size, r * sinf(theta));
+			tree.Size = XMFLOAT2(size, size);
+			tree.Slice = (UINT)mTrees.size() % 3;
+			mTrees.push_back(tree);
+		}
+	}
+}
+
+void FinalApp::BuildClusterResources()
+{
+	auto clusterDesc = CD3DX12_RESOURCE_DESC::Buffer(
+		ClusterCount * ClusterStride * sizeof(std::uint32_t), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE, &clusterDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&mClusterBuffer)));
+}
+
+void FinalApp::DispatchLightClusters(ID3D12GraphicsCommandList* cmdList)
+{
+	GpuProfileScope scope(mProfiler.get(), cmdList, "Light clusters");
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mClusterBuffer.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	cmdList->SetComputeRootSignature(mClusterRootSignature.Get());
+	cmdList->SetPipelineState(mClusterLightsPSO);
+
+	cmdList->SetComputeRootConstantBufferView(0, mClusterCBAddress);
+	cmdList->SetComputeRootShaderResourceView(1, mCurrFrameResource->LightBuffer->Resource()->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(2, mClusterBuffer->GetGPUVirtualAddress());
+
+	// 64 clusters per group.
+	cmdList->Dispatch((ClusterCount + 63) / 64, 1, 1);
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mClusterBuffer.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+UINT FinalApp::LayerDrawCount(RenderLayer layer)const
+{
+	bool batched = mInstancingEnabled && (layer == RenderLayer::Opaque || layer == RenderLayer::AlphaTested);
+	if (batched)
+		return (UINT)mInstanceBatches[(int)layer].size();
+
+	return (UINT)mVisibleRitems[(int)layer].size();
+}
+
+void FinalApp::BuildDrawChunks(UINT listCount)
+{
+	// Same order the layers have always been drawn in, after the depth pre-pass.
+	struct LayerPass
+	{
+		RenderLayer Layer;
+		bool PrePass;
+	};
+	const LayerPass order[] =
+	{
+		{ RenderLayer::Opaque, true },
+		{ RenderLayer::AlphaTested, true },
+		{ RenderLayer::Opaque, false },
+		{ RenderLayer::AlphaTested, false },
+		{ RenderLayer::Terrain, false },
+		{ RenderLayer::AlphaTestedTreeSprites, false },
+		{ (mWaveMode == WaveMode::Gpu) ? RenderLayer::GpuWaves : RenderLayer::Waves, false },
+		{ RenderLayer::Transparent, false }
+	};
+
+	UINT total = 0;
+	for (const LayerPass& pass : order)
+	{
+		if ((!pass.PrePass || mDepthPrePass) && (pass.Layer != RenderLayer::Terrain || mTerrainEnabled))
+			total += LayerDrawCount(pass.Layer);
+	}
+
+	// Give every list about the same number of draws.  Layers are split where a list
+	// fills up, so each list records a contiguous run of the frame in order.
+	UINT perList = std::max<UINT>((total + listCount - 1) / listCount, 1);
+
+	// The occlusion test needs only what the opaque layers leave in the depth buffer, so
+	// the pyramid is built before the tree sprites and the blended layers.
+	const bool buildPyramid = mOcclusionCulling && mDrawIndirect;
+	const UINT pyramid = (UINT)(mFrameNumber & 1);
+	mDepthPyramidValid[pyramid] = false;
+
+	mDrawChunks.clear();
+	UINT list = 0;
+	UINT filled = 0;
+	for (const LayerPass& pass : order)
+	{
+		if (pass.Layer == RenderLayer::AlphaTestedTreeSprites && buildPyramid && !mDrawChunks.empty())
+		{
+			mDrawChunks.back().BuildsDepthPyramid = true;
+			mDepthPyramidValid[pyramid] = true;
+			mDepthPyramidViewProj[pyramid] = mMainPassCB.ViewProj;
+		}
 
+		if ((pass.PrePass && !mDepthPrePass) || (pass.Layer == RenderLayer::Terrain && !mTerrainEnabled))
+			continue;
 
-	//MAZE WALL LEFT SIDE
-	auto mazeWallLeft = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-28.5f, 5.0f, -86.5f));
-	XMStoreFloat4x4(&mazeWallLeft->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft->ObjCBIndex = objCBIndex++;
-	mazeWallLeft->Mat = mMaterials["bush"].get();
-	mazeWallLeft->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft->IndexCount = mazeWallLeft->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft->StartIndexLocation = mazeWallLeft->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft->BaseVertexLocation = mazeWallLeft->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+		RenderLayer layer = pass.Layer;
+		UINT count = LayerDrawCount(layer);
+		UINT begin = 0;
+		while (begin < count)
+		{
+			UINT take = (list + 1 == listCount) ? count - begin : std::min<UINT>(count - begin, perList - filled);
+
+			DrawChunk chunk;
+			chunk.Layer = layer;
+			chunk.PrePass = pass.PrePass;
+			chunk.List = list;
+			chunk.Begin = begin;
+			chunk.End = begin + take;
+			mDrawChunks.push_back(chunk);
+
+			begin += take;
+			filled += take;
+			if (filled >= perList && list + 1 < listCount)
+			{
+				++list;
+				filled = 0;
+			}
+		}
+	}
+}
 
-	BoundingBox boundsMaze9;
-	XMStoreFloat3(&boundsMaze9.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-28.5f, 5.0f, -86.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze9.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+void FinalApp::BeginLayerCommands(ID3D12GraphicsCommandList* cmdList)
+{
+	// Command lists inherit no state, so every layer list sets up the pass itself.
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
 
-	mazeWallLeft->Bounds = boundsMaze9;//
+	// Specify the buffers we are going to render to.
+	cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft.get());
-	mAllRitems.push_back(std::move(mazeWallLeft));
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
 
-	auto mazeWallleft2 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallleft2->World, XMMatrixScaling(3.0f, 15.0f, 70.0f)* XMMatrixTranslation(-50.0f, 5.0f, -120.0f));
-	XMStoreFloat4x4(&mazeWallleft2->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallleft2->ObjCBIndex = objCBIndex++;
-	mazeWallleft2->Mat = mMaterials["bush"].get();
-	mazeWallleft2->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallleft2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallleft2->IndexCount = mazeWallleft2->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallleft2->StartIndexLocation = mazeWallleft2->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallleft2->BaseVertexLocation = mazeWallleft2->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	cmdList->SetGraphicsRootConstantBufferView(2, mPassCBAddress);
 
-	BoundingBox boundsMaze10;
-	XMStoreFloat3(&boundsMaze10.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), XMVectorGetY(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), XMVectorGetZ(XMMatrixTranslation(-50.0f, 5.0f, -120.0f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze10.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 70.0f).r[2]), 1.0f));
+	cmdList->SetGraphicsRootShaderResourceView(9, mCurrFrameResource->LightBuffer->Resource()->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(10, mClusterBuffer->GetGPUVirtualAddress());
 
-	mazeWallleft2->Bounds = boundsMaze10;//
+	// The bindless PSOs index these for the whole frame.
+	if (mBindlessMaterials)
+	{
+		cmdList->SetGraphicsRootShaderResourceView(7, mCurrFrameResource->MaterialBuffer->Resource()->GetGPUVirtualAddress());
+		cmdList->SetGraphicsRootDescriptorTable(8, mTextureTableStart);
+	}
+}
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallleft2.get());
-	mAllRitems.push_back(std::move(mazeWallleft2));
+void FinalApp::RecordDrawChunks(ID3D12GraphicsCommandList* cmdList, UINT list)
+{
+	for (const DrawChunk& chunk : mDrawChunks)
+	{
+		if (chunk.List != list)
+			continue;
 
+		int layer = (int)chunk.Layer;
+		UINT count = chunk.End - chunk.Begin;
 
+		const char* scopeName = chunk.PrePass ? gPrePassScopeNames[layer] : gLayerScopeNames[layer];
+		CpuProfileScope cpuScope(mProfiler.get(), scopeName);
+		GpuProfileScope gpuScope(mProfiler.get(), cmdList, scopeName);
 
-	auto mazeWallLeft3 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft3->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-23.5f, 5.0f, -156.5f));
-	XMStoreFloat4x4(&mazeWallLeft3->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft3->ObjCBIndex = objCBIndex++;
-	mazeWallLeft3->Mat = mMaterials["bush"].get();
-	mazeWallLeft3->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft3->IndexCount = mazeWallLeft3->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft3->StartIndexLocation = mazeWallLeft3->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft3->BaseVertexLocation = mazeWallLeft3->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
-	BoundingBox boundsMaze11;
-	//HEAD
-	XMStoreFloat3(&boundsMaze11.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-23.5f, 5.0f, -156.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze11.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+		cmdList->SetPipelineState(chunk.PrePass ? mCurrPipelines->PrePass[layer] : mCurrPipelines->Layers[layer]);
 
-	mazeWallLeft3->Bounds = boundsMaze11;//
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft3.get());
-	mAllRitems.push_back(std::move(mazeWallLeft3));
+		if (DrawsInstanceBatches(chunk.Layer))
+		{
+			const InstanceBatch* batches = mInstanceBatches[layer].data() + chunk.Begin;
+			if (mDrawIndirect)
+				DrawIndirectBatches(cmdList, batches, count);
+			else
+				DrawInstanceBatches(cmdList, batches, count, mDrawInstanceBuffer);
+
+			if (chunk.BuildsDepthPyramid)
+				BuildDepthPyramid(cmdList);
+			continue;
+		}
 
-	auto mazeWallLeft4 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft4->World, XMMatrixScaling(3.0f, 15.0f, 20.0f)* XMMatrixTranslation(-11.5f, 5.0f, -135.5f));
-	XMStoreFloat4x4(&mazeWallLeft4->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft4->ObjCBIndex = objCBIndex++;
-	mazeWallLeft4->Mat = mMaterials["bush"].get();
-	mazeWallLeft4->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft4->IndexCount = mazeWallLeft4->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft4->StartIndexLocation = mazeWallLeft4->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft4->BaseVertexLocation = mazeWallLeft4->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+		if (chunk.Layer == RenderLayer::GpuWaves)
+		{
+			cmdList->SetGraphicsRootDescriptorTable(5, mGpuWaves->DisplacementMap());
+		}
+		else if (chunk.Layer == RenderLayer::Terrain)
+		{
+			cmdList->SetGraphicsRootDescriptorTable(5, mTerrain->HeightMap());
+		}
+		else if (chunk.Layer == RenderLayer::AlphaTestedTreeSprites)
+		{
+			// The billboards read their trees by SV_InstanceID, like the instanced PSOs.
+			cmdList->SetGraphicsRootShaderResourceView(4,
+				mCurrFrameResource->TreeInstanceBuffer->Resource()->GetGPUVirtualAddress());
+		}
+		else if (chunk.Layer == RenderLayer::Waves)
+		{
+			// Slot 1 holds the static tex-coords; DrawRenderItems only rebinds slot 0.
+			D3D12_VERTEX_BUFFER_VIEW texCView;
+			texCView.BufferLocation = mWavesTexCBufferGPU->GetGPUVirtualAddress();
+			texCView.StrideInBytes = sizeof(XMFLOAT2);
+			texCView.SizeInBytes = mWaves->VertexCount() * sizeof(XMFLOAT2);
+			cmdList->IASetVertexBuffers(1, 1, &texCView);
+		}
 
-	BoundingBox boundsMaze12;
-	XMStoreFloat3(&boundsMaze12.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-11.5f, 5.0f, -135.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze12.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[2]), 1.0f));
+		// The waves, tree sprites and terrain have no bindless PSOs.
+		bool bindless = mBindlessMaterials && (chunk.Layer == RenderLayer::Opaque ||
+			chunk.Layer == RenderLayer::AlphaTested || chunk.Layer == RenderLayer::Transparent);
 
-	mazeWallLeft4->Bounds = boundsMaze12;//
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft4.get());
-	mAllRitems.push_back(std::move(mazeWallLeft4));
+		DrawRenderItems(cmdList, mVisibleRitems[layer].data() + chunk.Begin,
+			mVisibleObjectCBs[layer].data() + chunk.Begin, count, bindless);
 
-	auto mazeWallLeft5 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft5->World, XMMatrixScaling(3.0f, 15.0f, 20.0f)* XMMatrixTranslation(1.5f, 5.0f, -135.5f));
-	XMStoreFloat4x4(&mazeWallLeft5->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft5->ObjCBIndex = objCBIndex++;
-	mazeWallLeft5->Mat = mMaterials["bush"].get();
-	mazeWallLeft5->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft5->IndexCount = mazeWallLeft5->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft5->StartIndexLocation = mazeWallLeft5->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft5->BaseVertexLocation = mazeWallLeft5->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+		if (chunk.BuildsDepthPyramid)
+			BuildDepthPyramid(cmdList);
+	}
+}
 
-	BoundingBox boundsMaze13;
-	XMStoreFloat3(&boundsMaze13.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(1.5f, 5.0f, -135.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze13.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 20.0f).r[2]), 1.0f));
-	mazeWallLeft5->Bounds = boundsMaze13;//
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft5.get());
-	mAllRitems.push_back(std::move(mazeWallLeft5));
+void FinalApp::RecordEndOfFrame(ID3D12GraphicsCommandList* cmdList)
+{
+	DrawOverlay(cmdList);
 
+	mProfiler->EndGpuScope(cmdList, mGpuFrameScope);
+	mProfiler->EndGpuFrame(cmdList);
 
-	auto mazeWallLeft6 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft6->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(22.5f, 5.0f, -156.5f));
-	XMStoreFloat4x4(&mazeWallLeft6->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft6->ObjCBIndex = objCBIndex++;
-	mazeWallLeft6->Mat = mMaterials["bush"].get();
-	mazeWallLeft6->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft6->IndexCount = mazeWallLeft6->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft6->StartIndexLocation = mazeWallLeft6->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft6->BaseVertexLocation = mazeWallLeft6->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	if (mDrawIndirect && !mAsyncCull)
+	{
+		// Return the cull outputs to the state DispatchFrustumCull expects.
+		D3D12_RESOURCE_BARRIER toCommon[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(mCurrFrameResource->CulledInstanceBuffer.Get(),
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON),
+			CD3DX12_RESOURCE_BARRIER::Transition(mCurrFrameResource->IndirectCommandBuffer.Get(),
+				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COMMON)
+		};
+		cmdList->ResourceBarrier(_countof(toCommon), toCommon);
+	}
 
-	BoundingBox boundsMaze14;
-	XMStoreFloat3(&boundsMaze14.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), XMVectorGetY(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(22.5f, 5.0f, -156.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze14.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mClusterBuffer.Get(),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COMMON));
 
-	mazeWallLeft6->Bounds = boundsMaze14;//
+    // Indicate a state transition on the resource usage.
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+}
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft6.get());
-	mAllRitems.push_back(std::move(mazeWallLeft6));
+void FinalApp::DrawOverlay(ID3D12GraphicsCommandList* cmdList)
+{
+	if (mOverlayGlyphCount == 0)
+		return;
 
+	const float invRenderTargetSize[2] = { 1.0f / mClientWidth, 1.0f / mClientHeight };
 
+	cmdList->SetGraphicsRootSignature(mOverlayRootSignature.Get());
+	cmdList->SetPipelineState(mOverlayPSO);
+	cmdList->SetGraphicsRoot32BitConstants(0, 2, invRenderTargetSize, 0);
+	cmdList->SetGraphicsRootShaderResourceView(1, mCurrFrameResource->OverlayGlyphs->Resource()->GetGPUVirtualAddress());
 
-	auto mazeWallLeft7 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft7->World, XMMatrixScaling(40.0f, 15.0f, 3.0f)* XMMatrixTranslation(-15.5f, 5.0f, -110.5f));
-	XMStoreFloat4x4(&mazeWallLeft7->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft7->ObjCBIndex = objCBIndex++;
-	mazeWallLeft7->Mat = mMaterials["bush"].get();
-	mazeWallLeft7->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft7->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft7->IndexCount = mazeWallLeft7->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft7->StartIndexLocation = mazeWallLeft7->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft7->BaseVertexLocation = mazeWallLeft7->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	// One strip per quad, its corners from SV_VertexID.
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	cmdList->DrawInstanced(4, mOverlayGlyphCount, 0, 0);
+	++mDrawCallCount;
+}
 
-	BoundingBox boundsMaze15;
+void FinalApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, RenderItem* const* ritems,
+	const D3D12_GPU_VIRTUAL_ADDRESS* objectCBs, size_t count, bool bindless)
+{
+    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
-	//HEAD
-	XMStoreFloat3(&boundsMaze15.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-19.5f, 5.0f, -110.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze15.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(40.0f, 15.0f, 3.0f).r[2]), 1.0f));
+	D3D12_GPU_VIRTUAL_ADDRESS matCBStart = mCurrFrameResource->MaterialCB->Resource()->GetGPUVirtualAddress();
 
-	mazeWallLeft7->Bounds = boundsMaze15;//
+	// The items arrive sorted by state (SortVisibleRitems), so only the object CBV
+	// changes on every draw; everything else is set when it differs from the last item.
+	ID3D12Resource* boundVB = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	int boundTex = -1;
+	int boundMatCB = -1;
+	UINT drawCalls = 0;
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft7.get());
-	mAllRitems.push_back(std::move(mazeWallLeft7));
+    // For each render item...
+    for(size_t i = 0; i < count; ++i)
+    {
+        auto ri = ritems[i];
 
+		if(ri->Geo->VertexBufferGPU.Get() != boundVB)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+			boundVB = ri->Geo->VertexBufferGPU.Get();
+		}
 
+		if(ri->PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			boundTopology = ri->PrimitiveType;
+		}
 
-	auto mazeWallLeft8 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft8->World, XMMatrixScaling(25.0f, 15.0f, 3.0f)* XMMatrixTranslation(-24.5f, 5.0f, -135.5f));
-	XMStoreFloat4x4(&mazeWallLeft8->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft8->ObjCBIndex = objCBIndex++;
-	mazeWallLeft8->Mat = mMaterials["bush"].get();
-	mazeWallLeft8->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft8->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft8->IndexCount = mazeWallLeft8->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft8->StartIndexLocation = mazeWallLeft8->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft8->BaseVertexLocation = mazeWallLeft8->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
-	BoundingBox boundsMaze16;
-	XMStoreFloat3(&boundsMaze16.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-24.5f, 5.0f, -135.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze16.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(25.0f, 15.0f, 3.0f).r[2]), 1.0f));
+		if(bindless)
+		{
+			// The material index is all the bindless shaders need.
+			if(ri->Mat->MatCBIndex != boundMatCB)
+			{
+				cmdList->SetGraphicsRoot32BitConstant(6, (UINT)ri->Mat->MatCBIndex, 0);
+				boundMatCB = ri->Mat->MatCBIndex;
+			}
+		}
+		else
+		{
+			if(ri->Mat->DiffuseSrvHeapIndex != boundTex)
+			{
+				CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mTextureTableStart, ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+				cmdList->SetGraphicsRootDescriptorTable(0, tex);
+				boundTex = ri->Mat->DiffuseSrvHeapIndex;
+			}
+
+			if(ri->Mat->MatCBIndex != boundMatCB)
+			{
+				cmdList->SetGraphicsRootConstantBufferView(3, matCBStart + ri->Mat->MatCBIndex*matCBByteSize);
+				boundMatCB = ri->Mat->MatCBIndex;
+			}
+		}
 
-	mazeWallLeft8->Bounds = boundsMaze16;//
+        cmdList->SetGraphicsRootConstantBufferView(1, objectCBs[i]);
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft8.get());
-	mAllRitems.push_back(std::move(mazeWallLeft8));
+		if(ri->Clusters != nullptr)
+		{
+			for(const IndexRun& run : *ri->Clusters)
+			{
+				cmdList->DrawIndexedInstanced(run.IndexCount, ri->InstanceCount,
+					ri->StartIndexLocation + run.StartIndex, ri->BaseVertexLocation, 0);
+			}
+			drawCalls += (UINT)ri->Clusters->size();
+			continue;
+		}
 
+        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		++drawCalls;
+    }
 
-	auto mazeWallLeft9 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft9->World, XMMatrixScaling(3.0f, 15.0f, 26.0f)* XMMatrixTranslation(-36.5f, 5.0f, -115.5f));
-	XMStoreFloat4x4(&mazeWallLeft9->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft9->ObjCBIndex = objCBIndex++;
-	mazeWallLeft9->Mat = mMaterials["bush"].get();
-	mazeWallLeft9->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft9->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft9->IndexCount = mazeWallLeft9->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft9->StartIndexLocation = mazeWallLeft9->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft9->BaseVertexLocation = mazeWallLeft9->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+	mDrawCallCount += drawCalls;
+}
 
-	BoundingBox boundsMaze17;
-	XMStoreFloat3(&boundsMaze17.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-36.5f, 5.0f, -115.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze17.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[0]), XMVectorGetY(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[1]), XMVectorGetZ(XMMatrixScaling(3.0f, 15.0f, 26.0f).r[2]), 1.0f));
+void FinalApp::DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const InstanceBatch* batches, size_t count,
+	ID3D12Resource* instanceBuffer)
+{
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
-	mazeWallLeft9->Bounds = boundsMaze17;//
+	D3D12_GPU_VIRTUAL_ADDRESS matCBStart = mCurrFrameResource->MaterialCB->Resource()->GetGPUVirtualAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS instanceStart = instanceBuffer->GetGPUVirtualAddress();
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft9.get());
-	mAllRitems.push_back(std::move(mazeWallLeft9));
+	// Batches are sorted by buffer, topology and texture (BuildInstanceBatches), so
+	// those are only set when they change.
+	ID3D12Resource* boundVB = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	int boundTex = -1;
+	int boundMatCB = -1;
 
+	// One draw per LOD of each batch; the root SRV is offset to the LOD's first instance.
+	UINT drawCalls = 0;
+	for(size_t i = 0; i < count; ++i)
+	{
+		const InstanceBatch& b = batches[i];
+		if(b.VisibleCount == 0)
+			continue;
 
+		if(b.Geo->VertexBufferGPU.Get() != boundVB)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &b.Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&b.Geo->IndexBufferView());
+			boundVB = b.Geo->VertexBufferGPU.Get();
+		}
 
+		if(b.PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(b.PrimitiveType);
+			boundTopology = b.PrimitiveType;
+		}
 
+		// The bindless shaders take the material index from the instance data, so the
+		// instance SRV is the only per-batch binding.
+		if(!mBindlessMaterials && b.Mat->DiffuseSrvHeapIndex != boundTex)
+		{
+			CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mTextureTableStart, b.Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+			cmdList->SetGraphicsRootDescriptorTable(0, tex);
+			boundTex = b.Mat->DiffuseSrvHeapIndex;
+		}
 
-	auto mazeWallLeft11 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&mazeWallLeft11->World, XMMatrixScaling(30.0f, 15.0f, 3.0f)* XMMatrixTranslation(-35.5f, 5.0f, -146.5f));
-	XMStoreFloat4x4(&mazeWallLeft11->TexTransform, XMMatrixScaling(2.0, 4.0f, 2.0f));
-	mazeWallLeft11->ObjCBIndex = objCBIndex++;
-	mazeWallLeft11->Mat = mMaterials["bush"].get();
-	mazeWallLeft11->Geo = mGeometries["mazeWallGeo"].get();
-	mazeWallLeft11->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	mazeWallLeft11->IndexCount = mazeWallLeft11->Geo->DrawArgs["mazeWall"].IndexCount;
-	mazeWallLeft11->StartIndexLocation = mazeWallLeft11->Geo->DrawArgs["mazeWall"].StartIndexLocation;
-	mazeWallLeft11->BaseVertexLocation = mazeWallLeft11->Geo->DrawArgs["mazeWall"].BaseVertexLocation;
+		if(!mBindlessMaterials && b.Mat->MatCBIndex != boundMatCB)
+		{
+			cmdList->SetGraphicsRootConstantBufferView(3, matCBStart + b.Mat->MatCBIndex*matCBByteSize);
+			boundMatCB = b.Mat->MatCBIndex;
+		}
 
-	BoundingBox boundsMaze19;
-	XMStoreFloat3(&boundsMaze19.Center, XMVectorSet(XMVectorGetX(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), XMVectorGetY(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), XMVectorGetZ(XMMatrixTranslation(-35.5f, 5.0f, -146.5f).r[3]), 1.0f));
-	XMStoreFloat3(&boundsMaze19.Extents, 0.5f * XMVectorSet(XMVectorGetX(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[0]), XMVectorGetY(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[1]), XMVectorGetZ(XMMatrixScaling(30.0f, 15.0f, 3.0f).r[2]), 1.0f));
+		UINT firstInstance = b.FirstInstance;
+		for(UINT l = 0; l < b.LodCount; ++l)
+		{
+			UINT visibleCount = b.LodVisibleCounts[l];
+			if(visibleCount == 0)
+				continue;
+			++drawCalls;
 
-	mazeWallLeft11->Bounds = boundsMaze19;//
+			cmdList->SetGraphicsRootShaderResourceView(4, instanceStart + firstInstance*sizeof(InstanceData));
 
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(mazeWallLeft11.get());
-	mAllRitems.push_back(std::move(mazeWallLeft11));
+			const SubmeshGeometry& lod = b.Lods[l];
+			cmdList->DrawIndexedInstanced(lod.IndexCount, visibleCount, lod.StartIndexLocation, lod.BaseVertexLocation, 0);
+			firstInstance += visibleCount;
+		}
+	}
 
+	mDrawCallCount += drawCalls;
 }
-void FinalApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+
+void FinalApp::DrawIndirectBatches(ID3D12GraphicsCommandList* cmdList, const InstanceBatch* batches, size_t count)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	// Batches are sorted so runs sharing buffers, topology and texture are adjacent; each
+	// run is one ExecuteIndirect, whose commands bind their own SRV and material.
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	ID3D12Resource* boundVB = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
+	UINT drawCalls = 0;
+	size_t first = 0;
+	while(first < count)
+	{
+		const InstanceBatch& b = batches[first];
+
+		// Bindless runs only break where the IA state does; the material CBV the
+		// commands set is then unused.
+		size_t last = first + 1;
+		while(last < count && batches[last].Geo->VertexBufferGPU == b.Geo->VertexBufferGPU &&
+			batches[last].PrimitiveType == b.PrimitiveType &&
+			(mBindlessMaterials || batches[last].Mat->DiffuseSrvHeapIndex == b.Mat->DiffuseSrvHeapIndex))
+		{
+			++last;
+		}
+
+		if(b.Geo->VertexBufferGPU.Get() != boundVB)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &b.Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&b.Geo->IndexBufferView());
+			boundVB = b.Geo->VertexBufferGPU.Get();
+		}
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		//step3
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if(b.PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(b.PrimitiveType);
+			boundTopology = b.PrimitiveType;
+		}
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+		// Otherwise runs end where the texture changes, so the table is always new here.
+		if(!mBindlessMaterials)
+		{
+			CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mTextureTableStart, b.Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+			cmdList->SetGraphicsRootDescriptorTable(0, tex);
+		}
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+		// The run's commands, every LOD of every batch in it, are contiguous.
+		UINT commandCount = batches[last - 1].CommandIndex + batches[last - 1].LodCount - b.CommandIndex;
+		cmdList->ExecuteIndirect(mCullCommandSignature.Get(), commandCount,
+			mCurrFrameResource->IndirectCommandBuffer.Get(), b.CommandIndex * sizeof(IndirectCommand), nullptr, 0);
+		++drawCalls;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		first = last;
+	}
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-		
-    }
+	mDrawCallCount += drawCalls;
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> FinalApp::GetStaticSamplers()
@@ -3409,22 +6265,3 @@ std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> FinalApp::GetStaticSamplers()
 		linearWrap, linearClamp, 
 		anisotropicWrap, anisotropicClamp };
 }
-
-float FinalApp::GetHillsHeight(float x, float z)const
-{
-    return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
-}
-
-XMFLOAT3 FinalApp::GetHillsNormal(float x, float z)const
-{
-    // n = (-df/dx, 1, -df/dz)
-    XMFLOAT3 n(
-        -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
-        1.0f,
-        -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
-
-    XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-    XMStoreFloat3(&n, unitNormal);
-
-    return n;
-}
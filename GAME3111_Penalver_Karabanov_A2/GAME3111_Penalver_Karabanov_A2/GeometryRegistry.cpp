@@ -0,0 +1,89 @@
+//***************************************************************************************
+// GeometryRegistry.cpp
+//***************************************************************************************
+
+#include "GeometryRegistry.h"
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+SubmeshGeometry GeometryRegistry::Add(MeshGeometry* geo, const std::vector<Vertex>& vertices,
+	const std::vector<std::uint32_t>& indices)
+{
+	// Upload fills in every geometry at once, so nothing may be added after it.
+	assert(mVertexCount == mVertices.size());
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = (UINT)mIndices.size();
+	submesh.BaseVertexLocation = (INT)mVertices.size();
+
+	mVertices.insert(mVertices.end(), vertices.begin(), vertices.end());
+	mIndices.insert(mIndices.end(), indices.begin(), indices.end());
+	mVertexCount = (UINT)mVertices.size();
+	mIndexCount = (UINT)mIndices.size();
+	mMaxMeshVertexCount = std::max<UINT>(mMaxMeshVertexCount, (UINT)vertices.size());
+
+	if(std::find(mGeometries.begin(), mGeometries.end(), geo) == mGeometries.end())
+		mGeometries.push_back(geo);
+
+	return submesh;
+}
+
+void GeometryRegistry::Upload(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList)
+{
+	mIndexFormat = d3dUtil::IndexFormatFor(mMaxMeshVertexCount);
+
+	const UINT vbByteSize = mVertexCount * sizeof(Vertex);
+
+	ComPtr<ID3DBlob> vertexBufferCPU;
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &vertexBufferCPU));
+	CopyMemory(vertexBufferCPU->GetBufferPointer(), mVertices.data(), vbByteSize);
+
+	ComPtr<ID3DBlob> indexBufferCPU = d3dUtil::PackIndices(mIndices.data(), mIndices.size(), mIndexFormat);
+	const UINT ibByteSize = (UINT)indexBufferCPU->GetBufferSize();
+
+	ComPtr<ID3D12Resource> vertexBufferGPU = d3dUtil::CreateDefaultBuffer(device,
+		cmdList, mVertices.data(), vbByteSize, mVertexBufferUploader);
+
+	ComPtr<ID3D12Resource> indexBufferGPU = d3dUtil::CreateDefaultBuffer(device,
+		cmdList, indexBufferCPU->GetBufferPointer(), ibByteSize, mIndexBufferUploader);
+
+	for(MeshGeometry* geo : mGeometries)
+	{
+		geo->VertexBufferCPU = vertexBufferCPU;
+		geo->IndexBufferCPU = indexBufferCPU;
+		geo->VertexBufferGPU = vertexBufferGPU;
+		geo->IndexBufferGPU = indexBufferGPU;
+
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = mIndexFormat;
+		geo->IndexBufferByteSize = ibByteSize;
+	}
+
+	// The blobs hold the only CPU copy from here on.
+	std::vector<Vertex>().swap(mVertices);
+	std::vector<std::uint32_t>().swap(mIndices);
+}
+
+void GeometryRegistry::ReleaseUploaders()
+{
+	mVertexBufferUploader = nullptr;
+	mIndexBufferUploader = nullptr;
+}
+
+UINT GeometryRegistry::VertexCount()const
+{
+	return mVertexCount;
+}
+
+UINT GeometryRegistry::IndexCount()const
+{
+	return mIndexCount;
+}
+
+DXGI_FORMAT GeometryRegistry::IndexFormat()const
+{
+	return mIndexFormat;
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// GeometryRegistry.h
+//
+// Packs the static meshes into one shared vertex buffer and one shared index buffer.
+// Each Build*Geometry function adds its mesh to the MeshGeometry it names; Upload then
+// creates the two default-heap buffers and points every registered MeshGeometry at
+// them.  Their DrawArgs carry each mesh's offsets into the shared buffers, so every
+// static draw uses the same IA bindings.
+//
+// Indices stay local to their mesh; BaseVertexLocation does the rebasing.  Upload packs
+// them at 16 bits while every mesh is under 64K vertices, and at 32 bits once one is
+// not, so all the meshes keep sharing one index format.
+//***************************************************************************************
+
+#ifndef GEOMETRYREGISTRY_H
+#define GEOMETRYREGISTRY_H
+
+#include "FrameResource.h"
+
+class GeometryRegistry
+{
+public:
+	GeometryRegistry() = default;
+	GeometryRegistry(const GeometryRegistry& rhs) = delete;
+	GeometryRegistry& operator=(const GeometryRegistry& rhs) = delete;
+
+	// Appends the mesh and returns its draw args in the shared buffers.  geo is filled
+	// in by Upload, so it must outlive it.
+	SubmeshGeometry Add(MeshGeometry* geo, const std::vector<Vertex>& vertices,
+		const std::vector<std::uint32_t>& indices);
+
+	// Records the copies of everything added so far into the shared buffers.  Every
+	// registered geometry shares the buffers and their CPU copies, so CPU reads through
+	// a submesh's offsets (the cull bounds) still find its vertices.
+	void Upload(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList);
+
+	// Once the commands recorded by Upload have executed.
+	void ReleaseUploaders();
+
+	UINT VertexCount()const;
+	UINT IndexCount()const;
+	DXGI_FORMAT IndexFormat()const;
+
+private:
+	std::vector<MeshGeometry*> mGeometries;
+
+	// Accumulated until Upload, which moves them into the CPU blobs.
+	std::vector<Vertex> mVertices;
+	std::vector<std::uint32_t> mIndices;
+	UINT mVertexCount = 0;
+	UINT mIndexCount = 0;
+	UINT mMaxMeshVertexCount = 0;
+	DXGI_FORMAT mIndexFormat = DXGI_FORMAT_R16_UINT;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBufferUploader = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mIndexBufferUploader = nullptr;
+};
+
+#endif // GEOMETRYREGISTRY_H
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// GpuWaves.h
+//
+// Runs the wave simulation of Waves on the GPU with the compute shaders in WaveSim.hlsl.
+// The previous, current and next solutions are R32_FLOAT textures that are rotated after
+// every step, and the current one is read as a displacement map by the vertex shader of
+// a static grid.  Nothing is solved or uploaded on the CPU per frame, so the grid size is
+// limited only by the GPU.
+//***************************************************************************************
+
+#ifndef GPUWAVES_H
+#define GPUWAVES_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/GameTimer.h"
+
+class GpuWaves
+{
+public:
+	// The grid is dispatched in 16x16 thread groups; out-of-range threads are discarded by
+	// the shader, so m and n need not be multiples of 16.
+	GpuWaves(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		int m, int n, float dx, float dt, float speed, float damping);
+	GpuWaves(const GpuWaves& rhs) = delete;
+	GpuWaves& operator=(const GpuWaves& rhs) = delete;
+	~GpuWaves() = default;
+
+	int RowCount()const;
+	int ColumnCount()const;
+	int VertexCount()const;
+	int TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+	float SpatialStep()const;
+
+	// SRV of the current solution, for the displacement-mapped grid.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE DisplacementMap()const;
+
+	// Three SRVs followed by three UAVs.
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Records one simulation step once mTimeStep has accumulated, then the disturbances
+	// queued since the last step, on the solution it produced.  The caller must have
+	// set the descriptor heap that holds the descriptors from BuildDescriptors.
+	//
+	// A step reads the previous and current solutions only as SRVs and writes the third
+	// texture, which no frame has displaced with since the one before last.  So a step
+	// may run on another queue alongside the previous frame's draws, as long as it waits
+	// for the frame before that.
+	void Update(
+		const GameTimer& gt,
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* updatePso,
+		ID3D12PipelineState* disturbPso);
+
+	// Queued for the next step: the current solution may still be read by the vertex
+	// shader, so it is never written in place.
+	void Disturb(int i, int j, float magnitude);
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	struct Disturbance
+	{
+		int I = 0;
+		int J = 0;
+		float Magnitude = 0.0f;
+	};
+
+	int mNumRows = 0;
+	int mNumCols = 0;
+
+	int mVertexCount = 0;
+	int mTriangleCount = 0;
+
+	// Simulation constants we can precompute.
+	float mK[3] = { 0.0f, 0.0f, 0.0f };
+
+	float mTimeStep = 0.0f;
+	float mSpatialStep = 0.0f;
+
+	// Time accumulated towards the next step.
+	float mAccumulatedTime = 0.0f;
+
+	std::vector<Disturbance> mDisturbances;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolSrv;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolUav;
+
+	// All three rest in NON_PIXEL_SHADER_RESOURCE, read by the vertex shader and the
+	// update; the next solution is only in UNORDERED_ACCESS while a step writes it.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mNextSol = nullptr;
+
+	// Zero-filled initial solutions; must stay alive until the initialization commands run.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevUploadBuffer = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrUploadBuffer = nullptr;
+};
+
+#endif // GPUWAVES_H
@@ -0,0 +1,238 @@
+//***************************************************************************************
+// MazeGenerator.cpp
+//***************************************************************************************
+
+#include "MazeGenerator.h"
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	// Bits of mCellWalls.  Each cell owns the walls on its east (+x) and north (+z)
+	// edges; the west and south edges belong to its neighbours.
+	const std::uint8_t kWallEast = 1;
+	const std::uint8_t kWallNorth = 2;
+	const std::uint8_t kVisited = 4;
+
+	// Hash salts, so the decisions made about one chunk are independent.
+	const std::uint32_t kSaltCarve = 1;
+	const std::uint32_t kSaltDirection = 2;
+	const std::uint32_t kSaltNorthDoor = 3;
+	const std::uint32_t kSaltEastDoor = 4;
+}
+
+MazeGenerator::MazeGenerator(const MazeDesc& desc)
+	: mDesc(desc)
+{
+	assert(desc.CellsX > 0 && desc.CellsZ > 0 && desc.ChunkCells > 0);
+
+	mChunkCountX = (desc.CellsX + desc.ChunkCells - 1) / desc.ChunkCells;
+	mChunkCountZ = (desc.CellsZ + desc.ChunkCells - 1) / desc.ChunkCells;
+
+	mCellWalls.reserve(desc.ChunkCells * desc.ChunkCells);
+	mStack.reserve(desc.ChunkCells * desc.ChunkCells);
+}
+
+const MazeDesc& MazeGenerator::Desc()const
+{
+	return mDesc;
+}
+
+int MazeGenerator::ChunkCountX()const
+{
+	return mChunkCountX;
+}
+
+int MazeGenerator::ChunkCountZ()const
+{
+	return mChunkCountZ;
+}
+
+std::uint32_t MazeGenerator::MaxWallsPerChunk()const
+{
+	// ChunkCells + 1 wall lines per axis (the chunk's own edges plus the maze boundary
+	// on the first row or column), and merged runs on a line of n edges are separated
+	// by open edges, so there are at most (n + 1) / 2 of them.
+	std::uint32_t lines = mDesc.ChunkCells + 1;
+	std::uint32_t runsPerLine = (mDesc.ChunkCells + 1) / 2;
+	return 2 * lines * runsPerLine;
+}
+
+void MazeGenerator::ChunkAt(float x, float z, int& chunkX, int& chunkZ)const
+{
+	float chunkSize = mDesc.ChunkCells * mDesc.CellSize;
+	chunkX = (int)floorf((x - mDesc.Origin.x) / chunkSize);
+	chunkZ = (int)floorf((z - mDesc.Origin.z) / chunkSize);
+}
+
+void MazeGenerator::BuildChunk(int chunkX, int chunkZ, std::vector<BoundingBox>& walls)
+{
+	walls.clear();
+
+	if(chunkX < 0 || chunkX >= mChunkCountX || chunkZ < 0 || chunkZ >= mChunkCountZ)
+		return;
+
+	// The last row and column of chunks may be partial.
+	const int gx0 = chunkX * mDesc.ChunkCells;
+	const int gz0 = chunkZ * mDesc.ChunkCells;
+	const int w = std::min(mDesc.ChunkCells, mDesc.CellsX - gx0);
+	const int h = std::min(mDesc.ChunkCells, mDesc.CellsZ - gz0);
+
+	// Carve a perfect maze inside the chunk with an iterative recursive backtracker.
+	mCellWalls.assign(w * h, kWallEast | kWallNorth);
+
+	std::mt19937 rng(Hash(chunkX, chunkZ, kSaltCarve));
+
+	int start = (int)(rng() % (std::uint32_t)(w * h));
+	mCellWalls[start] |= kVisited;
+	mStack.clear();
+	mStack.push_back(start);
+
+	while(!mStack.empty())
+	{
+		int cell = mStack.back();
+		int x = cell % w;
+		int z = cell / w;
+
+		// Unvisited neighbours, by direction: 0 east, 1 west, 2 north, 3 south.
+		int dirs[4];
+		int count = 0;
+		if(x + 1 < w && !(mCellWalls[cell + 1] & kVisited)) dirs[count++] = 0;
+		if(x > 0     && !(mCellWalls[cell - 1] & kVisited)) dirs[count++] = 1;
+		if(z + 1 < h && !(mCellWalls[cell + w] & kVisited)) dirs[count++] = 2;
+		if(z > 0     && !(mCellWalls[cell - w] & kVisited)) dirs[count++] = 3;
+
+		if(count == 0)
+		{
+			mStack.pop_back();
+			continue;
+		}
+
+		// Step to the neighbour and knock down the wall between them; it belongs to
+		// whichever of the two is west/south.
+		int n = cell;
+		switch(dirs[rng() % (std::uint32_t)count])
+		{
+		case 0: n = cell + 1; mCellWalls[cell] &= ~kWallEast; break;
+		case 1: n = cell - 1; mCellWalls[n] &= ~kWallEast; break;
+		case 2: n = cell + w; mCellWalls[cell] &= ~kWallNorth; break;
+		case 3: n = cell - w; mCellWalls[n] &= ~kWallNorth; break;
+		}
+
+		mCellWalls[n] |= kVisited;
+		mStack.push_back(n);
+	}
+
+	// One door through the east or north edge joins the chunk to the rest of the maze.
+	if(ChunkOpensEast(chunkX, chunkZ))
+	{
+		int z = (int)(Hash(chunkX, chunkZ, kSaltEastDoor) % (std::uint32_t)h);
+		mCellWalls[z * w + (w - 1)] &= ~kWallEast;
+	}
+	if(ChunkOpensNorth(chunkX, chunkZ))
+	{
+		int x = (int)(Hash(chunkX, chunkZ, kSaltNorthDoor) % (std::uint32_t)w);
+		mCellWalls[(h - 1) * w + x] &= ~kWallNorth;
+	}
+
+	// The entrance is in the middle of the north boundary and the exit in the middle of
+	// the south one.
+	const int doorX = mDesc.CellsX / 2 - gx0;
+	const bool hasDoor = doorX >= 0 && doorX < w;
+	if(hasDoor && gz0 + h == mDesc.CellsZ)
+		mCellWalls[(h - 1) * w + doorX] &= ~kWallNorth;
+
+	const float cs = mDesc.CellSize;
+	const float ox = mDesc.Origin.x + gx0 * cs;
+	const float oz = mDesc.Origin.z + gz0 * cs;
+
+	// Walls along x: the north edges of each row, plus the maze's south boundary below
+	// the first row of chunks.  Runs of closed edges become one box.
+	for(int z = (chunkZ == 0 ? -1 : 0); z < h; ++z)
+	{
+		float lineZ = oz + (z + 1) * cs;
+		int runStart = -1;
+		for(int x = 0; x <= w; ++x)
+		{
+			bool closed = false;
+			if(x < w)
+				closed = (z < 0) ? !(hasDoor && x == doorX) : (mCellWalls[z * w + x] & kWallNorth) != 0;
+
+			if(closed && runStart < 0)
+				runStart = x;
+			else if(!closed && runStart >= 0)
+			{
+				AddWall(walls, ox + runStart * cs, lineZ, ox + x * cs, lineZ);
+				runStart = -1;
+			}
+		}
+	}
+
+	// Walls along z: the east edges of each column, plus the maze's west boundary.
+	for(int x = (chunkX == 0 ? -1 : 0); x < w; ++x)
+	{
+		float lineX = ox + (x + 1) * cs;
+		int runStart = -1;
+		for(int z = 0; z <= h; ++z)
+		{
+			bool closed = false;
+			if(z < h)
+				closed = (x < 0) || (mCellWalls[z * w + x] & kWallEast) != 0;
+
+			if(closed && runStart < 0)
+				runStart = z;
+			else if(!closed && runStart >= 0)
+			{
+				AddWall(walls, lineX, oz + runStart * cs, lineX, oz + z * cs);
+				runStart = -1;
+			}
+		}
+	}
+
+	assert(walls.size() <= MaxWallsPerChunk());
+}
+
+std::uint32_t MazeGenerator::Hash(int x, int z, std::uint32_t salt)const
+{
+	std::uint32_t h = mDesc.Seed ^ (salt * 0x9e3779b9u);
+	h ^= (std::uint32_t)x * 0x85ebca6bu;
+	h = (h ^ (h >> 16)) * 0x7feb352du;
+	h ^= (std::uint32_t)z * 0xc2b2ae35u;
+	h = (h ^ (h >> 15)) * 0x846ca68bu;
+	return h ^ (h >> 16);
+}
+
+bool MazeGenerator::ChunkOpensNorth(int chunkX, int chunkZ)const
+{
+	// Binary tree over the chunks: the top row can only open east and the last column
+	// only north; the top-right chunk is the root and opens neither way.
+	if(chunkZ == mChunkCountZ - 1)
+		return false;
+	if(chunkX == mChunkCountX - 1)
+		return true;
+	return (Hash(chunkX, chunkZ, kSaltDirection) & 1) != 0;
+}
+
+bool MazeGenerator::ChunkOpensEast(int chunkX, int chunkZ)const
+{
+	if(chunkX == mChunkCountX - 1)
+		return false;
+	if(chunkZ == mChunkCountZ - 1)
+		return true;
+	return (Hash(chunkX, chunkZ, kSaltDirection) & 1) == 0;
+}
+
+void MazeGenerator::AddWall(std::vector<BoundingBox>& walls, float x0, float z0, float x1, float z1)const
+{
+	// Both ends reach half a thickness past the line ends, so corners close up.
+	const float t = 0.5f * mDesc.WallThickness;
+
+	BoundingBox b;
+	b.Center = XMFLOAT3(0.5f * (x0 + x1), mDesc.Origin.y + 0.5f * mDesc.WallHeight, 0.5f * (z0 + z1));
+	b.Extents = XMFLOAT3(0.5f * (x1 - x0) + t, 0.5f * mDesc.WallHeight, 0.5f * (z1 - z0) + t);
+	walls.push_back(b);
+}
@@ -0,0 +1,82 @@
+//***************************************************************************************
+// MazeGenerator.h
+//
+// Seeded, grid-based labyrinth that is generated one chunk at a time.  Each chunk of
+// ChunkCells x ChunkCells cells is a perfect maze of its own (recursive backtracker),
+// and the chunks are joined by one door each to their north or east neighbour (a binary
+// tree over the chunks), so the whole maze stays perfect and connected.
+//
+// Everything about a chunk follows from the seed and its coordinates, so no state for
+// the full maze is ever kept: memory and startup cost do not depend on its size, and an
+// evicted chunk comes back identical when it is built again.
+//***************************************************************************************
+
+#ifndef MAZEGENERATOR_H
+#define MAZEGENERATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+struct MazeDesc
+{
+	std::uint32_t Seed = 1;
+
+	// Size of the whole maze, and of the chunks it is generated in, in cells.
+	int CellsX = 128;
+	int CellsZ = 128;
+	int ChunkCells = 8;
+
+	float CellSize = 12.0f;
+	float WallThickness = 2.0f;
+	float WallHeight = 15.0f;
+
+	// World position of the (-x, -z) corner of cell (0, 0), at the foot of the walls.
+	DirectX::XMFLOAT3 Origin = { 0.0f, 0.0f, 0.0f };
+};
+
+class MazeGenerator
+{
+public:
+	explicit MazeGenerator(const MazeDesc& desc);
+	MazeGenerator(const MazeGenerator& rhs) = delete;
+	MazeGenerator& operator=(const MazeGenerator& rhs) = delete;
+
+	const MazeDesc& Desc()const;
+	int ChunkCountX()const;
+	int ChunkCountZ()const;
+
+	// Upper bound on the boxes BuildChunk emits for any chunk, for sizing pools.
+	std::uint32_t MaxWallsPerChunk()const;
+
+	// Chunk under the world position (x, z).  Positions outside the maze give
+	// coordinates outside [0, ChunkCount).
+	void ChunkAt(float x, float z, int& chunkX, int& chunkZ)const;
+
+	// Replaces walls with the world-space wall boxes of chunk (chunkX, chunkZ).
+	// Collinear wall segments are merged, so a straight corridor is one box.
+	void BuildChunk(int chunkX, int chunkZ, std::vector<DirectX::BoundingBox>& walls);
+
+private:
+	std::uint32_t Hash(int x, int z, std::uint32_t salt)const;
+
+	// Which neighbour chunk (chunkX, chunkZ) has its door to, and where along that edge.
+	bool ChunkOpensNorth(int chunkX, int chunkZ)const;
+	bool ChunkOpensEast(int chunkX, int chunkZ)const;
+
+	void AddWall(std::vector<DirectX::BoundingBox>& walls,
+		float x0, float z0, float x1, float z1)const;
+
+private:
+	MazeDesc mDesc;
+	int mChunkCountX = 0;
+	int mChunkCountZ = 0;
+
+	// Per-chunk scratch, reused by every BuildChunk: the closed-wall bits of each cell
+	// and the backtracker's stack.
+	std::vector<std::uint8_t> mCellWalls;
+	std::vector<int> mStack;
+};
+
+#endif // MAZEGENERATOR_H
@@ -0,0 +1,214 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const wchar_t* const PipelineLibraryFile = L"Pipelines.bin";
+
+	// FNV-1a; only has to tell cache entries apart, not resist anyone.
+	std::uint64_t HashBytes(std::uint64_t hash, const void* data, size_t size)
+	{
+		const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+		for(size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	std::string WStringToAnsi(const std::wstring& str)
+	{
+		int size = WideCharToMultiByte(CP_ACP, 0, str.c_str(), (int)str.size(), nullptr, 0, nullptr, nullptr);
+		std::string ansi(size, '\0');
+		WideCharToMultiByte(CP_ACP, 0, str.c_str(), (int)str.size(), &ansi[0], size, nullptr, nullptr);
+		return ansi;
+	}
+
+	bool FileExists(const std::wstring& filename)
+	{
+		DWORD attributes = GetFileAttributesW(filename.c_str());
+		return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+	}
+
+	// Writes through a temporary so a run that dies mid-write never leaves a torn file
+	// for the next one to load.  A cache that cannot be written is not an error.
+	void WriteFileAtomic(const std::wstring& filename, ID3DBlob* blob)
+	{
+		const std::wstring temp = filename + L".tmp";
+		if(SUCCEEDED(D3DWriteBlobToFile(blob, temp.c_str(), TRUE)))
+			MoveFileExW(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+	}
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& directory)
+{
+	md3dDevice = device;
+	mDirectory = directory;
+	CreateDirectoryW(mDirectory.c_str(), nullptr);
+
+	if(FAILED(md3dDevice->QueryInterface(IID_PPV_ARGS(&mDevice1))))
+		return;
+
+	// Anything wrong with the file (another driver, another adapter, a torn write)
+	// just means starting from an empty library.
+	const std::wstring libraryPath = CachePath(PipelineLibraryFile);
+	if(FileExists(libraryPath) && SUCCEEDED(D3DReadFileToBlob(libraryPath.c_str(), &mLibraryData)))
+	{
+		if(FAILED(mDevice1->CreatePipelineLibrary(mLibraryData->GetBufferPointer(),
+			mLibraryData->GetBufferSize(), IID_PPV_ARGS(&mLibrary))))
+		{
+			mLibrary = nullptr;
+			mLibraryData = nullptr;
+		}
+	}
+
+	// Drivers without library support fail even the empty one; PSOs are then created
+	// directly and nothing is saved.
+	if(mLibrary == nullptr && FAILED(mDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+		mDevice1 = nullptr;
+}
+
+ComPtr<ID3DBlob> PipelineCache::CompileShader(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target)
+{
+	UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)
+	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+	if(!FileExists(filename))
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+	// The include handler resolves relative to the source name, as D3DCompileFromFile does.
+	ComPtr<ID3DBlob> source = d3dUtil::LoadBinary(filename);
+	const std::string sourceName = WStringToAnsi(filename);
+
+	ComPtr<ID3DBlob> preprocessed = nullptr;
+	ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DPreprocess(source->GetBufferPointer(), source->GetBufferSize(), sourceName.c_str(),
+		defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, &preprocessed, &errors);
+
+	if(errors != nullptr)
+		OutputDebugStringA((char*)errors->GetBufferPointer());
+
+	ThrowIfFailed(hr);
+
+	std::uint64_t hash = 14695981039346656037ull;
+	hash = HashBytes(hash, preprocessed->GetBufferPointer(), preprocessed->GetBufferSize());
+	hash = HashBytes(hash, entrypoint.c_str(), entrypoint.size() + 1);
+	hash = HashBytes(hash, target.c_str(), target.size() + 1);
+	hash = HashBytes(hash, &compileFlags, sizeof(compileFlags));
+
+	wchar_t key[17];
+	swprintf_s(key, L"%016llx", hash);
+	const std::wstring csoPath = CachePath(std::wstring(key) + L".cso");
+
+	ComPtr<ID3DBlob> byteCode = nullptr;
+	if(FileExists(csoPath) && SUCCEEDED(D3DReadFileToBlob(csoPath.c_str(), &byteCode)))
+	{
+		++mShaderHits;
+		return byteCode;
+	}
+
+	// The defines are already applied, so the preprocessed text compiles on its own.
+	errors = nullptr;
+	hr = D3DCompile(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize(), sourceName.c_str(),
+		nullptr, nullptr, entrypoint.c_str(), target.c_str(), compileFlags, 0, &byteCode, &errors);
+
+	if(errors != nullptr)
+		OutputDebugStringA((char*)errors->GetBufferPointer());
+
+	ThrowIfFailed(hr);
+
+	WriteFileAtomic(csoPath, byteCode.Get());
+	++mShaderMisses;
+
+	return byteCode;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphicsPipeline(
+	const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	// A missing name and a changed description both fail with E_INVALIDARG.
+	ComPtr<ID3D12PipelineState> pso = nullptr;
+	bool fromLibrary = mLibrary != nullptr &&
+		SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso)));
+
+	if(!fromLibrary)
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	AddPipeline(name, pso.Get(), fromLibrary);
+	return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateComputePipeline(
+	const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pso = nullptr;
+	bool fromLibrary = mLibrary != nullptr &&
+		SUCCEEDED(mLibrary->LoadComputePipeline(name.c_str(), &desc, IID_PPV_ARGS(&pso)));
+
+	if(!fromLibrary)
+		ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+
+	AddPipeline(name, pso.Get(), fromLibrary);
+	return pso;
+}
+
+void PipelineCache::Save()
+{
+	if(mDevice1 == nullptr || !mLibraryDirty)
+		return;
+
+	// The old library may hold stale entries under names that are still in use, and
+	// StorePipeline refuses to overwrite, so the library is rebuilt from scratch.
+	ComPtr<ID3D12PipelineLibrary> library;
+	if(FAILED(mDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library))))
+		return;
+
+	for(auto& p : mPipelines)
+		ThrowIfFailed(library->StorePipeline(p.first.c_str(), p.second.Get()));
+
+	ComPtr<ID3DBlob> data;
+	ThrowIfFailed(D3DCreateBlob(library->GetSerializedSize(), data.GetAddressOf()));
+	ThrowIfFailed(library->Serialize(data->GetBufferPointer(), data->GetBufferSize()));
+
+	WriteFileAtomic(CachePath(PipelineLibraryFile), data.Get());
+	mLibraryDirty = false;
+}
+
+std::wstring PipelineCache::Stats()const
+{
+	return L"Shaders: " + std::to_wstring(mShaderHits) + L" cached, " + std::to_wstring(mShaderMisses) +
+		L" compiled; pipelines: " + std::to_wstring(mPipelineHits) + L" cached, " +
+		std::to_wstring(mPipelineMisses) + L" created\n";
+}
+
+std::wstring PipelineCache::CachePath(const std::wstring& filename)const
+{
+	return mDirectory + L"\\" + filename;
+}
+
+void PipelineCache::AddPipeline(const std::wstring& name, ID3D12PipelineState* pso, bool fromLibrary)
+{
+	mPipelines.push_back(std::make_pair(name, ComPtr<ID3D12PipelineState>(pso)));
+
+	if(fromLibrary)
+	{
+		++mPipelineHits;
+	}
+	else
+	{
+		++mPipelineMisses;
+		mLibraryDirty = true;
+	}
+}
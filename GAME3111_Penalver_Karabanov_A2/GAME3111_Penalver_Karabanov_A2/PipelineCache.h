@@ -0,0 +1,76 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Keeps compiled shaders and pipeline states on disk between runs.
+//
+// Shaders are keyed by a hash of their preprocessed source (so edits to an #include or
+// a different set of defines are a different key), entry point, target and compile
+// flags, and stored as one .cso per key.  Preprocessing is much cheaper than compiling,
+// so a warm start only pays for that and a file read per shader.
+//
+// Pipeline states go through an ID3D12PipelineLibrary that is serialized to one file.
+// A PSO whose description no longer matches its stored one (new shaders, a driver
+// update) is created from scratch, and Save then rewrites the whole library.  Without
+// ID3D12Device1 every PSO is simply created.
+//***************************************************************************************
+
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "../../Common/d3dUtil.h"
+
+class PipelineCache
+{
+public:
+	// Cache files live in directory, which is created if needed.
+	PipelineCache(ID3D12Device* device, const std::wstring& directory);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+	~PipelineCache() = default;
+
+	// Same arguments as d3dUtil::CompileShader.
+	Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target);
+
+	// Names must be unique across both kinds of pipeline.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateGraphicsPipeline(
+		const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateComputePipeline(
+		const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Writes the pipeline library back if any pipeline was missing from it.
+	void Save();
+
+	// What was found on disk and what had to be built, for the startup log.
+	std::wstring Stats()const;
+
+private:
+	std::wstring CachePath(const std::wstring& filename)const;
+
+	// Records a pipeline for Save; a miss means the library on disk is stale.
+	void AddPipeline(const std::wstring& name, ID3D12PipelineState* pso, bool fromLibrary);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	std::wstring mDirectory;
+
+	// The library reads its pipelines out of mLibraryData, so the blob must outlive the
+	// library; members are destroyed in reverse order, so keep mLibraryData above mLibrary.
+	Microsoft::WRL::ComPtr<ID3D12Device1> mDevice1 = nullptr;
+	Microsoft::WRL::ComPtr<ID3DBlob> mLibraryData = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary = nullptr;
+	bool mLibraryDirty = false;
+
+	// Every pipeline handed out, for rebuilding the library in Save.
+	std::vector<std::pair<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>>> mPipelines;
+
+	UINT mShaderHits = 0;
+	UINT mShaderMisses = 0;
+	UINT mPipelineHits = 0;
+	UINT mPipelineMisses = 0;
+};
+
+#endif // PIPELINECACHE_H
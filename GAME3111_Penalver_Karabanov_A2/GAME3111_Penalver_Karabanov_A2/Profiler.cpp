@@ -0,0 +1,333 @@
+//***************************************************************************************
+// Profiler.cpp
+//***************************************************************************************
+
+#include "Profiler.h"
+#include <iomanip>
+#include <cstring>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	LONGLONG QueryTicks()
+	{
+		LARGE_INTEGER ticks;
+		QueryPerformanceCounter(&ticks);
+		return ticks.QuadPart;
+	}
+}
+
+Profiler::Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount)
+{
+	mQueue = queue;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mCpuFrequency = frequency.QuadPart;
+	mStartTicks = QueryTicks();
+	mFrameStartTicks = mStartTicks;
+	mAccumStartTicks = mStartTicks;
+
+	ThrowIfFailed(mQueue->GetTimestampFrequency(&mGpuFrequency));
+
+	const UINT queryCount = frameResourceCount * MaxGpuScopes * 2;
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = queryCount;
+	ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(queryCount * sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mReadback)));
+
+	mRegions.resize(frameResourceCount);
+	mHistory.resize(HistoryFrames);
+}
+
+void Profiler::BeginFrame()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	const LONGLONG now = QueryTicks();
+	if(mFrame > 0)
+	{
+		Event frame;
+		frame.Name = "Frame";
+		frame.Thread = GetCurrentThreadId();
+		frame.StartMs = TicksToMs(mFrameStartTicks);
+		frame.DurationMs = TicksToMs(now) - frame.StartMs;
+		Record(mFrame).Events.push_back(frame);
+	}
+
+	// The record's events keep their capacity from HistoryFrames frames ago.
+	FrameRecord& record = Record(++mFrame);
+	record.Frame = mFrame;
+	record.Complete = false;
+	record.Events.clear();
+	mFrameStartTicks = now;
+}
+
+void Profiler::BeginGpuFrame(UINT frameIndex)
+{
+	CollectGpuRegion(frameIndex);
+
+	GpuRegion& region = mRegions[frameIndex];
+	region.Frame = mFrame;
+	region.ScopeCount = 0;
+	region.Pending = false;
+
+	mCurrRegion = frameIndex;
+	mGpuScopeCount = 0;
+}
+
+void Profiler::EndGpuFrame(ID3D12GraphicsCommandList* cmdList)
+{
+	GpuRegion& region = mRegions[mCurrRegion];
+	region.ScopeCount = std::min<UINT>(mGpuScopeCount, MaxGpuScopes);
+	region.Pending = true;
+
+	if(region.ScopeCount > 0)
+	{
+		const UINT first = mCurrRegion * MaxGpuScopes * 2;
+		cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, region.ScopeCount * 2,
+			mReadback.Get(), first * sizeof(UINT64));
+	}
+}
+
+void Profiler::AddCpuScope(const char* name, LONGLONG startTicks, LONGLONG endTicks)
+{
+	Event e;
+	e.Name = name;
+	e.Thread = GetCurrentThreadId();
+	e.StartMs = TicksToMs(startTicks);
+	e.DurationMs = TicksToMs(endTicks) - e.StartMs;
+
+	std::lock_guard<std::mutex> lock(mLock);
+	Record(mFrame).Events.push_back(e);
+}
+
+UINT Profiler::BeginGpuScope(ID3D12GraphicsCommandList* cmdList, const char* name)
+{
+	UINT scope = mGpuScopeCount++;
+	if(scope >= MaxGpuScopes)
+		return scope;
+
+	mRegions[mCurrRegion].Names[scope] = name;
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrRegion * MaxGpuScopes + scope) * 2);
+	return scope;
+}
+
+void Profiler::EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)
+{
+	if(scope >= MaxGpuScopes)
+		return;
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrRegion * MaxGpuScopes + scope) * 2 + 1);
+}
+
+const std::vector<Profiler::ScopeStats>& Profiler::Stats()const
+{
+	return mStats;
+}
+
+template<typename Fn>
+void Profiler::ForEachCompleteFrame(Fn fn)const
+{
+	UINT64 first = (mFrame >= HistoryFrames) ? mFrame - HistoryFrames + 1 : 1;
+	for(UINT64 frame = first; frame <= mFrame; ++frame)
+	{
+		const FrameRecord& record = mHistory[frame % HistoryFrames];
+		if(record.Frame == frame && record.Complete)
+			fn(record);
+	}
+}
+
+bool Profiler::SaveCsv(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		return false;
+
+	fout << "frame,source,name,thread,start_ms,duration_ms\n";
+	fout << std::fixed << std::setprecision(4);
+	ForEachCompleteFrame([&fout](const FrameRecord& record)
+	{
+		for(const Event& e : record.Events)
+		{
+			fout << record.Frame << ',' << (e.Gpu ? "gpu" : "cpu") << ',' << e.Name << ',' << e.Thread << ','
+				<< e.StartMs << ',' << e.DurationMs << '\n';
+		}
+	});
+
+	return fout.good();
+}
+
+bool Profiler::SaveTrace(const std::wstring& filename)const
+{
+	std::ofstream fout(filename);
+	if(!fout)
+		return false;
+
+	// Complete ("X") events in microseconds; the CPU and GPU are two processes.
+	fout << "{\"traceEvents\":[\n";
+	fout << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	fout << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}";
+	fout << std::fixed << std::setprecision(3);
+	ForEachCompleteFrame([&fout](const FrameRecord& record)
+	{
+		for(const Event& e : record.Events)
+		{
+			fout << ",\n{\"name\":\"" << e.Name << "\",\"cat\":\"" << (e.Gpu ? "gpu" : "cpu")
+				<< "\",\"ph\":\"X\",\"pid\":" << (e.Gpu ? 2 : 1) << ",\"tid\":" << e.Thread
+				<< ",\"ts\":" << e.StartMs * 1000.0 << ",\"dur\":" << e.DurationMs * 1000.0
+				<< ",\"args\":{\"frame\":" << record.Frame << "}}";
+		}
+	});
+	fout << "\n]}\n";
+
+	return fout.good();
+}
+
+double Profiler::TicksToMs(LONGLONG ticks)const
+{
+	return (double)(ticks - mStartTicks) * 1000.0 / (double)mCpuFrequency;
+}
+
+Profiler::FrameRecord& Profiler::Record(UINT64 frame)
+{
+	return mHistory[frame % HistoryFrames];
+}
+
+void Profiler::CollectGpuRegion(UINT frameIndex)
+{
+	GpuRegion& region = mRegions[frameIndex];
+	if(!region.Pending)
+		return;
+
+	// Calibrated every time, so the two clocks cannot drift apart over a long run.
+	UINT64 gpuCalibration = 0;
+	UINT64 cpuCalibration = 0;
+	ThrowIfFailed(mQueue->GetClockCalibration(&gpuCalibration, &cpuCalibration));
+	const double calibrationMs = TicksToMs((LONGLONG)cpuCalibration);
+
+	std::lock_guard<std::mutex> lock(mLock);
+
+	// The record is gone if the ring has lapped it (a frame resource left idle by R).
+	FrameRecord& record = Record(region.Frame);
+	region.Pending = false;
+	if(record.Frame != region.Frame)
+		return;
+
+	if(region.ScopeCount > 0)
+	{
+		const UINT first = frameIndex * MaxGpuScopes * 2;
+		D3D12_RANGE readRange = { first * sizeof(UINT64), (first + region.ScopeCount * 2) * sizeof(UINT64) };
+		D3D12_RANGE writeRange = { 0, 0 };
+
+		UINT64* timestamps = nullptr;
+		ThrowIfFailed(mReadback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+		for(UINT i = 0; i < region.ScopeCount; ++i)
+		{
+			UINT64 begin = timestamps[first + i * 2];
+			UINT64 end = timestamps[first + i * 2 + 1];
+			if(end < begin)
+				continue;
+
+			Event e;
+			e.Name = region.Names[i];
+			e.Gpu = true;
+			e.StartMs = calibrationMs + (double)(INT64)(begin - gpuCalibration) * 1000.0 / (double)mGpuFrequency;
+			e.DurationMs = (double)(end - begin) * 1000.0 / (double)mGpuFrequency;
+			record.Events.push_back(e);
+		}
+
+		mReadback->Unmap(0, &writeRange);
+	}
+
+	record.Complete = true;
+	AccumulateStats(record);
+}
+
+void Profiler::AccumulateStats(const FrameRecord& record)
+{
+	for(const Event& e : record.Events)
+	{
+		auto it = std::find_if(mAccum.begin(), mAccum.end(),
+			[&e](const StatsAccum& a) { return std::strcmp(a.Name, e.Name) == 0; });
+		if(it == mAccum.end())
+		{
+			mAccum.push_back(StatsAccum());
+			it = mAccum.end() - 1;
+			it->Name = e.Name;
+		}
+
+		if(e.Gpu)
+		{
+			it->GpuMs += e.DurationMs;
+			it->OnGpu = true;
+		}
+		else
+		{
+			it->CpuMs += e.DurationMs;
+			it->OnCpu = true;
+		}
+	}
+	++mAccumFrames;
+
+	const LONGLONG now = QueryTicks();
+	if((now - mAccumStartTicks) * 1000 < (LONGLONG)StatsPeriodMs * mCpuFrequency)
+		return;
+
+	// Names keep their first-seen order, so the readout does not reshuffle.
+	mStats.clear();
+	for(StatsAccum& a : mAccum)
+	{
+		if(a.OnCpu || a.OnGpu)
+		{
+			ScopeStats s;
+			s.Name = a.Name;
+			s.CpuMs = a.OnCpu ? (float)(a.CpuMs / mAccumFrames) : -1.0f;
+			s.GpuMs = a.OnGpu ? (float)(a.GpuMs / mAccumFrames) : -1.0f;
+			mStats.push_back(s);
+		}
+
+		a.CpuMs = 0.0;
+		a.GpuMs = 0.0;
+		a.OnCpu = false;
+		a.OnGpu = false;
+	}
+
+	mAccumFrames = 0;
+	mAccumStartTicks = now;
+}
+
+CpuProfileScope::CpuProfileScope(Profiler* profiler, const char* name)
+{
+	mProfiler = profiler;
+	mName = name;
+	mStartTicks = QueryTicks();
+}
+
+CpuProfileScope::~CpuProfileScope()
+{
+	mProfiler->AddCpuScope(mName, mStartTicks, QueryTicks());
+}
+
+GpuProfileScope::GpuProfileScope(Profiler* profiler, ID3D12GraphicsCommandList* cmdList, const char* name)
+{
+	mProfiler = profiler;
+	mCmdList = cmdList;
+	mScope = mProfiler->BeginGpuScope(mCmdList, name);
+}
+
+GpuProfileScope::~GpuProfileScope()
+{
+	mProfiler->EndGpuScope(mCmdList, mScope);
+}
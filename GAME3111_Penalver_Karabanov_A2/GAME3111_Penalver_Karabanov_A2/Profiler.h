@@ -0,0 +1,167 @@
+//***************************************************************************************
+// Profiler.h
+//
+// CPU and GPU timings of named scopes of the frame.
+//
+// CPU scopes are QueryPerformanceCounter pairs and may end on any thread.  GPU scopes
+// are timestamp pairs in a query heap with one region per frame resource: the frame's
+// last command list resolves its region into readback memory, which is read when that
+// frame resource comes round again and its fence has passed.  GetClockCalibration maps
+// the GPU clock onto the CPU one, so both share one timeline.
+//
+// The last HistoryFrames frames are kept for SaveCsv and SaveTrace (the Chrome trace
+// event format, for chrome://tracing or Perfetto), and each scope name is averaged
+// over StatsPeriodMs for on-screen readouts.  Scope names must be string literals or
+// otherwise outlive the profiler.
+//***************************************************************************************
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "../../Common/d3dUtil.h"
+#include <atomic>
+#include <mutex>
+
+class Profiler
+{
+public:
+	static const UINT MaxGpuScopes = 64;
+	static const UINT HistoryFrames = 300;
+	static const UINT StatsPeriodMs = 500;
+
+	struct Event
+	{
+		const char* Name = nullptr;
+		bool Gpu = false;
+		DWORD Thread = 0;
+
+		// Since the profiler was created.
+		double StartMs = 0.0;
+		double DurationMs = 0.0;
+	};
+
+	// Per-frame averages of a scope name over the last stats period; a side the name
+	// was not timed on reads -1.  Scopes that repeat in a frame are summed.
+	struct ScopeStats
+	{
+		const char* Name = nullptr;
+		float CpuMs = -1.0f;
+		float GpuMs = -1.0f;
+	};
+
+	Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameResourceCount);
+	Profiler(const Profiler& rhs) = delete;
+	Profiler& operator=(const Profiler& rhs) = delete;
+	~Profiler() = default;
+
+	// Ends the previous frame's "Frame" CPU scope and starts the next frame.
+	void BeginFrame();
+
+	// Collects the GPU scopes frame resource frameIndex recorded last time round, and
+	// records this frame's into its region.  Its fence must have completed.
+	void BeginGpuFrame(UINT frameIndex);
+
+	// Resolves this frame's timestamps.  Record it after the last GPU scope has ended,
+	// in the frame's last command list.
+	void EndGpuFrame(ID3D12GraphicsCommandList* cmdList);
+
+	// Both are thread-safe; a GPU scope must end in a list submitted after the one it
+	// began in, or the same one.  Scopes past MaxGpuScopes are dropped.
+	void AddCpuScope(const char* name, LONGLONG startTicks, LONGLONG endTicks);
+	UINT BeginGpuScope(ID3D12GraphicsCommandList* cmdList, const char* name);
+	void EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope);
+
+	const std::vector<ScopeStats>& Stats()const;
+
+	// Every frame in the history whose GPU scopes have been collected, oldest first.
+	bool SaveCsv(const std::wstring& filename)const;
+	bool SaveTrace(const std::wstring& filename)const;
+
+private:
+	struct FrameRecord
+	{
+		UINT64 Frame = 0;
+		bool Complete = false;
+		std::vector<Event> Events;
+	};
+
+	// A frame resource's share of the query heap and readback buffer.
+	struct GpuRegion
+	{
+		UINT64 Frame = 0;
+		UINT ScopeCount = 0;
+		bool Pending = false;
+		const char* Names[MaxGpuScopes] = {};
+	};
+
+	struct StatsAccum
+	{
+		const char* Name = nullptr;
+		double CpuMs = 0.0;
+		double GpuMs = 0.0;
+		bool OnCpu = false;
+		bool OnGpu = false;
+	};
+
+	double TicksToMs(LONGLONG ticks)const;
+	FrameRecord& Record(UINT64 frame);
+	void CollectGpuRegion(UINT frameIndex);
+	void AccumulateStats(const FrameRecord& record);
+	template<typename Fn> void ForEachCompleteFrame(Fn fn)const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadback = nullptr;
+
+	LONGLONG mCpuFrequency = 1;
+	LONGLONG mStartTicks = 0;
+	UINT64 mGpuFrequency = 1;
+
+	std::vector<GpuRegion> mRegions;
+	UINT mCurrRegion = 0;
+	std::atomic<UINT> mGpuScopeCount{ 0 };
+
+	// Guards mHistory against CPU scopes ending on the recording threads.
+	std::mutex mLock;
+	std::vector<FrameRecord> mHistory;
+	UINT64 mFrame = 0;
+	LONGLONG mFrameStartTicks = 0;
+
+	std::vector<StatsAccum> mAccum;
+	UINT mAccumFrames = 0;
+	LONGLONG mAccumStartTicks = 0;
+	std::vector<ScopeStats> mStats;
+};
+
+// Times the rest of the enclosing block on the CPU.
+class CpuProfileScope
+{
+public:
+	CpuProfileScope(Profiler* profiler, const char* name);
+	CpuProfileScope(const CpuProfileScope& rhs) = delete;
+	CpuProfileScope& operator=(const CpuProfileScope& rhs) = delete;
+	~CpuProfileScope();
+
+private:
+	Profiler* mProfiler = nullptr;
+	const char* mName = nullptr;
+	LONGLONG mStartTicks = 0;
+};
+
+// Times the commands recorded into cmdList for the rest of the enclosing block.
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(Profiler* profiler, ID3D12GraphicsCommandList* cmdList, const char* name);
+	GpuProfileScope(const GpuProfileScope& rhs) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope& rhs) = delete;
+	~GpuProfileScope();
+
+private:
+	Profiler* mProfiler = nullptr;
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+	UINT mScope = 0;
+};
+
+#endif // PROFILER_H
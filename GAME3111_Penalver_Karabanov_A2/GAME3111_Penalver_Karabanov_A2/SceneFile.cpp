@@ -0,0 +1,190 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+#include <fstream>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+using namespace DirectX;
+
+std::uint64_t SceneHashBytes(std::uint64_t hash, const void* data, size_t size)
+{
+	const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+	for(size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+namespace
+{
+	void CopyName(char (&dst)[kSceneNameLength], const std::string& src)
+	{
+		// Names are NUL-terminated inside their fixed record.
+		assert(src.size() < kSceneNameLength);
+		std::memset(dst, 0, kSceneNameLength);
+		std::memcpy(dst, src.c_str(), std::min<size_t>(src.size(), kSceneNameLength - 1));
+	}
+
+	template<typename T>
+	const char* ReadTable(const char* p, std::uint32_t count, std::vector<T>& out)
+	{
+		out.resize(count);
+		if(count > 0)
+			std::memcpy(out.data(), p, count * sizeof(T));
+		return p + count * sizeof(T);
+	}
+
+	template<typename T>
+	void WriteTable(std::ofstream& fout, const std::vector<T>& table)
+	{
+		if(!table.empty())
+			fout.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(T));
+	}
+}
+
+bool SceneFile::Load(const std::wstring& filename, std::uint64_t sourceHash)
+{
+	Clear();
+
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin)
+		return false;
+
+	fin.seekg(0, std::ios_base::end);
+	size_t size = (size_t)fin.tellg();
+	fin.seekg(0, std::ios_base::beg);
+
+	if(size < sizeof(SceneFileHeader))
+		return false;
+
+	std::vector<char> data(size);
+	fin.read(data.data(), size);
+	if(!fin)
+		return false;
+
+	SceneFileHeader header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(header.Magic != kSceneFileMagic || header.Version != kSceneFileVersion ||
+		header.SourceHash != sourceHash)
+		return false;
+
+	size_t expected = sizeof(SceneFileHeader) +
+		(size_t)header.MeshCount * sizeof(SceneMeshRef) +
+		(size_t)header.MaterialCount * sizeof(SceneMaterialRef) +
+		(size_t)header.InstanceCount * sizeof(SceneInstance) +
+		(size_t)header.AnimationCount * sizeof(SceneAnimation);
+	if(size != expected)
+		return false;
+
+	const char* p = data.data() + sizeof(SceneFileHeader);
+	p = ReadTable(p, header.MeshCount, mMeshes);
+	p = ReadTable(p, header.MaterialCount, mMaterials);
+	p = ReadTable(p, header.InstanceCount, mInstances);
+	p = ReadTable(p, header.AnimationCount, mAnimations);
+
+	// The names are used as C strings; a corrupt file must not run them past their records.
+	for(SceneMeshRef& mesh : mMeshes)
+	{
+		mesh.Geometry[kSceneNameLength - 1] = '\0';
+		mesh.Submesh[kSceneNameLength - 1] = '\0';
+	}
+	for(SceneMaterialRef& mat : mMaterials)
+		mat.Name[kSceneNameLength - 1] = '\0';
+
+	// Table indices must stay inside the tables.
+	for(const SceneInstance& inst : mInstances)
+	{
+		if(inst.Mesh >= header.MeshCount || inst.Material >= header.MaterialCount)
+		{
+			Clear();
+			return false;
+		}
+	}
+	for(const SceneAnimation& anim : mAnimations)
+	{
+		if(anim.Instance >= header.InstanceCount)
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SceneFile::Save(const std::wstring& filename, std::uint64_t sourceHash)const
+{
+	std::ofstream fout(filename, std::ios::binary);
+	if(!fout)
+		return false;
+
+	SceneFileHeader header;
+	header.MeshCount = (std::uint32_t)mMeshes.size();
+	header.MaterialCount = (std::uint32_t)mMaterials.size();
+	header.InstanceCount = (std::uint32_t)mInstances.size();
+	header.AnimationCount = (std::uint32_t)mAnimations.size();
+	header.SourceHash = sourceHash;
+
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	WriteTable(fout, mMeshes);
+	WriteTable(fout, mMaterials);
+	WriteTable(fout, mInstances);
+	WriteTable(fout, mAnimations);
+
+	return (bool)fout;
+}
+
+void SceneFile::Clear()
+{
+	mMeshes.clear();
+	mMaterials.clear();
+	mInstances.clear();
+	mAnimations.clear();
+}
+
+std::uint32_t SceneFile::AddMesh(const std::string& geometry, const std::string& submesh)
+{
+	for(std::uint32_t i = 0; i < (std::uint32_t)mMeshes.size(); ++i)
+	{
+		if(geometry == mMeshes[i].Geometry && submesh == mMeshes[i].Submesh)
+			return i;
+	}
+
+	SceneMeshRef mesh;
+	CopyName(mesh.Geometry, geometry);
+	CopyName(mesh.Submesh, submesh);
+	mMeshes.push_back(mesh);
+	return (std::uint32_t)mMeshes.size() - 1;
+}
+
+std::uint32_t SceneFile::AddMaterial(const std::string& name)
+{
+	for(std::uint32_t i = 0; i < (std::uint32_t)mMaterials.size(); ++i)
+	{
+		if(name == mMaterials[i].Name)
+			return i;
+	}
+
+	SceneMaterialRef mat;
+	CopyName(mat.Name, name);
+	mMaterials.push_back(mat);
+	return (std::uint32_t)mMaterials.size() - 1;
+}
+
+std::uint32_t SceneFile::AddInstance(const SceneInstance& instance)
+{
+	mInstances.push_back(instance);
+	mInstances.back().ObjCBIndex = (std::uint32_t)mInstances.size() - 1;
+	return mInstances.back().ObjCBIndex;
+}
+
+void SceneFile::AddAnimation(const SceneAnimation& animation)
+{
+	mAnimations.push_back(animation);
+}
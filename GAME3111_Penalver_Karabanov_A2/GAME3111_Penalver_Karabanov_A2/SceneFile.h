@@ -0,0 +1,125 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Compact binary scene: a header followed by three tables of fixed-size records, with
+// no pointers or variable-length fields, so the file can be read (or mapped) in one go.
+//
+//   SceneMeshRef[MeshCount]          geometry + submesh names
+//   SceneMaterialRef[MaterialCount]  material names
+//   SceneInstance[InstanceCount]     transforms, bounds, CB slot, layer, table indices
+//   SceneAnimation[AnimationCount]   per-instance spin/slide parameters
+//
+// Names are only resolved once per table entry at load time; instances refer to them
+// by index.  The header carries a hash of what the scene was baked from (see
+// SceneHashBytes); a file whose hash or version does not match is not loaded.
+//***************************************************************************************
+
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+const std::uint32_t kSceneFileMagic = 0x454e4353; // "SCNE"
+const std::uint32_t kSceneFileVersion = 2;
+const std::uint32_t kSceneNameLength = 32;
+
+// Seed for SceneHashBytes.
+const std::uint64_t kSceneHashSeed = 14695981039346656037ull;
+
+// FNV-1a over size bytes, continuing from hash; for the source hash of a bake.
+std::uint64_t SceneHashBytes(std::uint64_t hash, const void* data, size_t size);
+
+struct SceneFileHeader
+{
+	std::uint32_t Magic = kSceneFileMagic;
+	std::uint32_t Version = kSceneFileVersion;
+	std::uint32_t MeshCount = 0;
+	std::uint32_t MaterialCount = 0;
+	std::uint32_t InstanceCount = 0;
+	std::uint32_t AnimationCount = 0;
+
+	// The caller's hash of the scene's inputs when it was baked.
+	std::uint64_t SourceHash = 0;
+};
+
+struct SceneMeshRef
+{
+	char Geometry[kSceneNameLength];
+	char Submesh[kSceneNameLength];
+};
+
+struct SceneMaterialRef
+{
+	char Name[kSceneNameLength];
+};
+
+struct SceneInstance
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 TexTransform;
+
+	// Collision bounds, in world space.
+	DirectX::BoundingBox Bounds;
+
+	std::uint32_t Mesh = 0;
+	std::uint32_t Material = 0;
+	std::uint32_t Layer = 0;
+	std::uint32_t PrimitiveType = 0;
+
+	// Slot in the per-frame ObjectCB; the writer assigns them in instance order.
+	std::uint32_t ObjCBIndex = 0;
+};
+
+struct SceneAnimation
+{
+	std::uint32_t Instance = 0;
+	DirectX::XMFLOAT3 Scale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	float StartAngle = 0.0f;
+	float AngularSpeed = 0.0f;
+	DirectX::XMFLOAT3 BoundsCenter = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 SlideAxis = { 0.0f, 0.0f, 0.0f };
+	float SlideDistance = 0.0f;
+	float SlidePeriod = 0.0f;
+};
+
+class SceneFile
+{
+public:
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+
+	// Reads the whole file with a single read.  Returns false if it is missing, was
+	// written by another version or baked from other inputs than sourceHash, or its
+	// tables do not fit its size.
+	bool Load(const std::wstring& filename, std::uint64_t sourceHash);
+	bool Save(const std::wstring& filename, std::uint64_t sourceHash)const;
+
+	void Clear();
+
+	// Authoring: return the index of the (deduplicated) table entry.
+	std::uint32_t AddMesh(const std::string& geometry, const std::string& submesh);
+	std::uint32_t AddMaterial(const std::string& name);
+
+	// Appends the instance with the next ObjCBIndex and returns its index.
+	std::uint32_t AddInstance(const SceneInstance& instance);
+	void AddAnimation(const SceneAnimation& animation);
+
+	const std::vector<SceneMeshRef>& Meshes()const { return mMeshes; }
+	const std::vector<SceneMaterialRef>& Materials()const { return mMaterials; }
+	const std::vector<SceneInstance>& Instances()const { return mInstances; }
+	const std::vector<SceneAnimation>& Animations()const { return mAnimations; }
+
+private:
+	std::vector<SceneMeshRef> mMeshes;
+	std::vector<SceneMaterialRef> mMaterials;
+	std::vector<SceneInstance> mInstances;
+	std::vector<SceneAnimation> mAnimations;
+};
+
+#endif // SCENEFILE_H
@@ -0,0 +1,93 @@
+//=============================================================================
+// ClusterLights.hlsl
+//
+// ClusterLightsCS(): One thread per cluster.  Builds the cluster's view-space
+//     box and lists the point and spot lights whose range reaches it, so the
+//     pixel shaders only evaluate those.  The group walks the lights through
+//     groupshared memory, GroupSize at a time, so each light is read and moved
+//     into view space once per group rather than once per cluster.
+//=============================================================================
+
+#include "LightingUtil.hlsl"
+
+#define GroupSize 64
+
+cbuffer cbCluster : register(b0)
+{
+	float4x4 gView;
+	float    gProjScaleX;
+	float    gProjScaleY;
+	float    gNearZ;
+	float    gFarZ;
+	uint     gLightCount;
+	uint3    cbClusterPad0;
+};
+
+StructuredBuffer<Light> gLights   : register(t0);
+RWStructuredBuffer<uint> gClusters : register(u0);
+
+// View-space centre and range of the lights being tested.
+groupshared float4 gLightSpheres[GroupSize];
+
+float SliceDepth(uint slice)
+{
+	return gNearZ * pow(gFarZ / gNearZ, slice / (float)ClusterGridZ);
+}
+
+[numthreads(GroupSize, 1, 1)]
+void ClusterLightsCS(uint3 dispatchThreadID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	uint cluster = dispatchThreadID.x;
+	uint3 cell = uint3(cluster % ClusterGridX, (cluster / ClusterGridX) % ClusterGridY,
+		cluster / (ClusterGridX * ClusterGridY));
+
+	// The tile in NDC (y up, while the tiles count down from the top of the screen),
+	// pushed out to the slice's near and far depths.
+	float2 tileSize = float2(2.0f / ClusterGridX, 2.0f / ClusterGridY);
+	float2 ndcMin = float2(-1.0f + cell.x * tileSize.x, 1.0f - (cell.y + 1) * tileSize.y);
+	float2 ndcMax = ndcMin + tileSize;
+	float2 invScale = float2(1.0f / gProjScaleX, 1.0f / gProjScaleY);
+
+	float zNear = SliceDepth(cell.z);
+	float zFar = SliceDepth(cell.z + 1);
+
+	float2 a = ndcMin * invScale * zNear;
+	float2 b = ndcMax * invScale * zNear;
+	float2 c = ndcMin * invScale * zFar;
+	float2 d = ndcMax * invScale * zFar;
+	float3 boxMin = float3(min(min(a, b), min(c, d)), zNear);
+	float3 boxMax = float3(max(max(a, b), max(c, d)), zFar);
+
+	uint first = cluster * ClusterStride;
+	uint count = 0;
+
+	for(uint base = 0; base < gLightCount; base += GroupSize)
+	{
+		uint index = base + groupIndex;
+		if(index < gLightCount)
+		{
+			Light L = gLights[index];
+			gLightSpheres[groupIndex] = float4(mul(float4(L.Position, 1.0f), gView).xyz, L.FalloffEnd);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		// Spot lights are tested by their whole range; the cone only matters per pixel.
+		uint batch = min((uint)GroupSize, gLightCount - base);
+		for(uint i = 0; i < batch; ++i)
+		{
+			float4 sphere = gLightSpheres[i];
+			float3 gap = max(0.0f, max(boxMin - sphere.xyz, sphere.xyz - boxMax));
+
+			if(dot(gap, gap) <= sphere.w * sphere.w && count < MaxLightsPerCluster)
+			{
+				if(cluster < ClusterCount)
+					gClusters[first + 1 + count] = base + i;
+				++count;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if(cluster < ClusterCount)
+		gClusters[first] = count;
+}
@@ -9,19 +9,16 @@
     #define NUM_DIR_LIGHTS 1
 #endif
 
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 10
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 1
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
 Texture2D    gDiffuseMap : register(t0);
 
+#ifdef DISPLACEMENT_MAP
+// Current solution of the GPU wave simulation.
+Texture2D    gDisplacementMap : register(t1);
+#endif
+
 
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
@@ -35,6 +32,8 @@ cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+	float    gGridSpatialStep;
+	float3   cbPerObjectPad0;
 };
 
 // Constant data that varies per material.
@@ -61,13 +60,42 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+    // gLights holds gPointLightCount point lights and then the spot lights.
+    uint gPointLightCount;
+    uint gSpotLightCount;
+    float gClusterSliceScale;
+    float gClusterSliceBias;
+
+    Light gDirLights[MaxDirLights];
 };
 
+// Point and spot lights, and the lists of them that reach each cluster.
+StructuredBuffer<Light> gLights   : register(t2, space1);
+StructuredBuffer<uint>  gClusters : register(t3, space1);
+
+#ifdef BINDLESS
+// Every material in one buffer and every texture in one table; a draw only supplies
+// its material index, from the instance data or the root constant below.
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+	float3   FresnelR0;
+	float    Roughness;
+	float4x4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     MatPad0;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
+Texture2D gTextureMaps[] : register(t0, space2);
+
+cbuffer cbMaterialIndex : register(b3)
+{
+	uint gMaterialIndex;
+};
+#else
 cbuffer cbMaterial : register(b2)
 {
 	float4   gDiffuseAlbedo;
@@ -75,6 +103,23 @@ cbuffer cbMaterial : register(b2)
     float    gRoughness;
 	float4x4 gMatTransform;
 };
+#endif
+
+#ifdef INSTANCED
+struct InstanceData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+	float3   BoundsCenter;
+	uint     MaterialIndex;
+	float3   BoundsExtents;
+	uint     CommandIndex;
+};
+
+// Instances of the current batch.  The root SRV points at the batch's first
+// instance, so SV_InstanceID indexes it directly.
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
 
 struct VertexIn
 {
@@ -89,32 +134,87 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+#ifdef BINDLESS
+	nointerpolation uint MatIndex : MATINDEX;
+#endif
 };
 
+#ifdef INSTANCED
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+#else
 VertexOut VS(VertexIn vin)
+#endif
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef INSTANCED
+	InstanceData instData = gInstanceData[instanceID];
+	float4x4 world = instData.World;
+	float4x4 texTransform = instData.TexTransform;
+#else
+	float4x4 world = gWorld;
+	float4x4 texTransform = gTexTransform;
+#endif
+
+#ifdef BINDLESS
+#ifdef INSTANCED
+	uint matIndex = instData.MaterialIndex;
+#else
+	uint matIndex = gMaterialIndex;
+#endif
+	vout.MatIndex = matIndex;
+	float4x4 matTransform = gMaterialData[matIndex].MatTransform;
+#else
+	float4x4 matTransform = gMatTransform;
+#endif
+
+#ifdef DISPLACEMENT_MAP
+	// The grid's [0,1]^2 tex-coords address the simulation texels directly.
+	uint mapWidth, mapHeight;
+	gDisplacementMap.GetDimensions(mapWidth, mapHeight);
+	int2 texel = int2(round(vin.TexC * float2(mapWidth - 1, mapHeight - 1)));
+
+	vin.PosL.y += gDisplacementMap.Load(int3(texel, 0)).r;
+
+	// Estimate normal using finite difference, as Waves does; out-of-range loads
+	// return 0, matching the simulation's zero boundary.
+	float l = gDisplacementMap.Load(int3(texel - int2(1, 0), 0)).r;
+	float r = gDisplacementMap.Load(int3(texel + int2(1, 0), 0)).r;
+	float t = gDisplacementMap.Load(int3(texel - int2(0, 1), 0)).r;
+	float b = gDisplacementMap.Load(int3(texel + int2(0, 1), 0)).r;
+	vin.NormalL = normalize(float3(-r + l, 2.0f*gGridSpatialStep, b - t));
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
-	vout.TexC = mul(texC, gMatTransform).xy;
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
+	vout.TexC = mul(texC, matTransform).xy;
 
     return vout;
 }
 
 float4 PS(VertexOut pin) : SV_Target
 {
+#ifdef BINDLESS
+	// Batches never mix materials, so the index is uniform across a draw.
+	MaterialData matData = gMaterialData[pin.MatIndex];
+	float4 diffuseAlbedo = gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC) * matData.DiffuseAlbedo;
+	float3 fresnelR0 = matData.FresnelR0;
+	float roughness = matData.Roughness;
+#else
     float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+	float3 fresnelR0 = gFresnelR0;
+	float roughness = gRoughness;
+#endif
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
@@ -134,11 +234,14 @@ float4 PS(VertexOut pin) : SV_Target
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
-    const float shininess = 1.0f - gRoughness;
-    Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+    const float shininess = 1.0f - roughness;
+    Material mat = { diffuseAlbedo, fresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy * gInvRenderTargetSize, viewZ,
+        gClusterSliceScale, gClusterSliceBias);
+    float4 directLight = ComputeLighting(gDirLights, gLights, gClusters, cluster,
+        gPointLightCount, mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
 
@@ -153,4 +256,17 @@ float4 PS(VertexOut pin) : SV_Target
     return litColor;
 }
 
+// Depth pre-pass for clip materials: the same alpha test as PS and nothing else.
+void AlphaTestPS(VertexOut pin)
+{
+#ifdef BINDLESS
+	MaterialData matData = gMaterialData[pin.MatIndex];
+	float alpha = gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC).a * matData.DiffuseAlbedo.a;
+#else
+	float alpha = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC).a * gDiffuseAlbedo.a;
+#endif
+
+	clip(alpha - 0.1f);
+}
+
 
@@ -0,0 +1,45 @@
+//=============================================================================
+// DepthPyramid.hlsl
+//
+// DownsampleDepthCS(): One thread per texel of the level being built.  Keeps
+//     the farthest of the 2x2 source texels under it.  Levels below the first
+//     halve rounding down, as D3D12 sizes mips, so on an odd-sized source the
+//     last row and column of the level also take the source's last one.
+//=============================================================================
+
+// Must match DepthPyramid::Execute.
+cbuffer cbPyramid : register(b0)
+{
+	uint2 gSrcSize;
+	uint2 gDstSize;
+};
+
+// The depth buffer for the first level, the level before for the others.
+Texture2D<float>   gInput  : register(t0);
+RWTexture2D<float> gOutput : register(u0);
+
+[numthreads(8, 8, 1)]
+void DownsampleDepthCS(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if(dispatchThreadID.x >= (int)gDstSize.x || dispatchThreadID.y >= (int)gDstSize.y)
+		return;
+
+	int2 src = dispatchThreadID.xy * 2;
+	int2 last = (int2)gSrcSize - 1;
+
+	// At most 3x3 source texels, on the level's last row and column.
+	int2 srcEnd = min(src + 1, last);
+	if(dispatchThreadID.x == (int)gDstSize.x - 1)
+		srcEnd.x = last.x;
+	if(dispatchThreadID.y == (int)gDstSize.y - 1)
+		srcEnd.y = last.y;
+
+	float d = 0.0f;
+	for(int y = src.y; y <= srcEnd.y; ++y)
+	{
+		for(int x = src.x; x <= srcEnd.x; ++x)
+			d = max(d, gInput.Load(int3(x, y, 0)));
+	}
+
+	gOutput[dispatchThreadID.xy] = d;
+}
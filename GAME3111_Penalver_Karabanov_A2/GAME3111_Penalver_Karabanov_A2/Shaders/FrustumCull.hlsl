@@ -0,0 +1,143 @@
+//=============================================================================
+// FrustumCull.hlsl
+//
+// FrustumCullCS(): One thread per instance.  Tests the instance's world-space
+//     box against the camera frustum and against last frame's depth pyramid
+//     (DepthPyramid.hlsl), picks a LOD for the visible ones by
+//     their screen size, and appends them to the range of the output buffer of
+//     their batch's command for that LOD, counting them in the command.
+//=============================================================================
+
+// Must match FrameResource.h.
+#define MaxMeshLods 3
+
+// Must match InstanceData in FrameResource.h.
+struct InstanceData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+	float3   BoundsCenter;
+	uint     MaterialIndex;
+	float3   BoundsExtents;
+	uint     CommandIndex;
+};
+
+cbuffer cbCull : register(b0)
+{
+	float4 gFrustumPlanes[6];
+	uint   gInstanceCount;
+	uint   gCommandStride;
+	uint   gInstanceCountOffset;
+	uint   gFirstInstanceOffset;
+	float3 gEyePosW;
+	float  gLodScale;
+	float2 gLodScreenSizes;	// MaxMeshLods - 1; an array would pad each to a float4
+	uint   gLodCountOffset;
+	uint   gCullPad0;
+	float4x4 gOcclusionViewProj;	// the camera of the frame the pyramid was built in
+	int2   gDepthSize;
+	uint   gPyramidMipCount;
+	uint   gOcclusionEnabled;
+};
+
+StructuredBuffer<InstanceData>   gInstances        : register(t0);
+RWStructuredBuffer<InstanceData> gVisibleInstances : register(u0);
+RWByteAddressBuffer              gCommands         : register(u1);
+Texture2D<float>                 gDepthPyramid     : register(t1);
+
+// True if the box is behind the farthest depth the pyramid holds over the box's screen
+// rectangle.  Mip m's texels are 2^(m+1) pixels wide, so the first mip whose texels are
+// as wide as the rectangle covers it with at most 2x2 of them.
+bool IsOccluded(float3 center, float3 extents)
+{
+	float2 minUV = 1.0f;
+	float2 maxUV = 0.0f;
+	float minZ = 1.0f;
+
+	[unroll]
+	for(int i = 0; i < 8; ++i)
+	{
+		float3 corner = center + extents * float3((i & 1) ? 1.0f : -1.0f,
+			(i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		float4 p = mul(float4(corner, 1.0f), gOcclusionViewProj);
+
+		// A box reaching behind the camera has no bounded rectangle.
+		if(p.w <= 0.0f)
+			return false;
+
+		float3 ndc = p.xyz / p.w;
+		float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
+		minUV = min(minUV, uv);
+		maxUV = max(maxUV, uv);
+		minZ = min(minZ, ndc.z);
+	}
+
+	int2 pmin = clamp((int2)(saturate(minUV) * gDepthSize), 0, gDepthSize - 1);
+	int2 pmax = clamp((int2)(saturate(maxUV) * gDepthSize), 0, gDepthSize - 1);
+
+	uint span = (uint)max(pmax.x - pmin.x, pmax.y - pmin.y) + 1;
+	uint level = (span > 1) ? firstbithigh(span - 1) + 1 : 0;
+	uint mip = min(max(level, 1) - 1, gPyramidMipCount - 1);
+
+	// Mips halve rounding down, so the shift can land one past the edge; the edge texel
+	// covers those pixels (DepthPyramid.hlsl), and an out-of-range Load would read 0.
+	uint mipWidth, mipHeight, mipLevels;
+	gDepthPyramid.GetDimensions(mip, mipWidth, mipHeight, mipLevels);
+	int2 mipLast = int2(mipWidth, mipHeight) - 1;
+
+	int2 t0 = min(pmin >> (mip + 1), mipLast);
+	int2 t1 = min(pmax >> (mip + 1), mipLast);
+
+	float maxZ = max(
+		max(gDepthPyramid.Load(int3(t0.x, t0.y, mip)), gDepthPyramid.Load(int3(t1.x, t0.y, mip))),
+		max(gDepthPyramid.Load(int3(t0.x, t1.y, mip)), gDepthPyramid.Load(int3(t1.x, t1.y, mip))));
+
+	return minZ > maxZ;
+}
+
+[numthreads(64, 1, 1)]
+void FrustumCullCS(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if(dispatchThreadID.x >= (int)gInstanceCount)
+		return;
+
+	InstanceData inst = gInstances[dispatchThreadID.x];
+
+	// The box is outside if it lies entirely behind any plane.
+	[unroll]
+	for(int i = 0; i < 6; ++i)
+	{
+		float4 plane = gFrustumPlanes[i];
+		float r = dot(inst.BoundsExtents, abs(plane.xyz));
+		float s = dot(plane.xyz, inst.BoundsCenter) + plane.w;
+
+		if(s + r < 0.0f)
+			return;
+	}
+
+	if(gOcclusionEnabled != 0 && IsOccluded(inst.BoundsCenter, inst.BoundsExtents))
+		return;
+
+	// A batch's LOD commands follow its first one, which holds how many there are.
+	uint command = inst.CommandIndex * gCommandStride;
+	uint lodCount = gCommands.Load(command + gLodCountOffset);
+
+	float distance = max(length(inst.BoundsCenter - gEyePosW), 0.001f);
+	float screenSize = length(inst.BoundsExtents) * gLodScale / distance;
+
+	uint lod = 0;
+	[unroll]
+	for(uint l = 1; l < MaxMeshLods; ++l)
+	{
+		if(l < lodCount && screenSize < gLodScreenSizes[l - 1])
+			lod = l;
+	}
+	command += lod * gCommandStride;
+
+	uint firstInstance = gCommands.Load(command + gFirstInstanceOffset);
+
+	uint slot;
+	gCommands.InterlockedAdd(command + gInstanceCountOffset, 1, slot);
+
+	gVisibleInstances[firstInstance + slot] = inst;
+}
@@ -4,7 +4,14 @@
 // Contains API for shader lighting.
 //***************************************************************************************
 
-#define MaxLights 32
+// Must match the light clustering constants in FrameResource.h.
+#define MaxDirLights 3
+#define ClusterGridX 16
+#define ClusterGridY 9
+#define ClusterGridZ 24
+#define ClusterCount (ClusterGridX * ClusterGridY * ClusterGridZ)
+#define MaxLightsPerCluster 63
+#define ClusterStride (MaxLightsPerCluster + 1)
 
 struct Light
 {
@@ -135,7 +142,26 @@ float3 ComputeSpotLight(Light L, Material mat, float3 pos, float3 normal, float3
     return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
 }
 
-float4 ComputeLighting(Light gLights[MaxLights], Material mat,
+//---------------------------------------------------------------------------------------
+// Cluster of a pixel, from its position in [0,1]^2 screen space (y down) and its
+// view-space depth.  The slice constants come from the pass constants.
+//---------------------------------------------------------------------------------------
+uint ClusterIndex(float2 screenUV, float viewZ, float sliceScale, float sliceBias)
+{
+    uint2 tile = min(uint2(screenUV * float2(ClusterGridX, ClusterGridY)),
+        uint2(ClusterGridX - 1, ClusterGridY - 1));
+    uint slice = (uint)clamp(log(viewZ) * sliceScale + sliceBias, 0.0f, ClusterGridZ - 1.0f);
+
+    return (slice * ClusterGridY + tile.y) * ClusterGridX + tile.x;
+}
+
+//---------------------------------------------------------------------------------------
+// Directional lights, then the lights of the pixel's cluster.  lights holds the point
+// lights in [0, pointLightCount) and the spot lights after them.
+//---------------------------------------------------------------------------------------
+float4 ComputeLighting(Light dirLights[MaxDirLights],
+    StructuredBuffer<Light> lights, StructuredBuffer<uint> clusters,
+    uint cluster, uint pointLightCount, Material mat,
     float3 pos, float3 normal, float3 toEye,
     float3 shadowFactor)
 {
@@ -146,25 +172,20 @@ float4 ComputeLighting(Light gLights[MaxLights], Material mat,
 #if (NUM_DIR_LIGHTS > 0)
     for (i = 0; i < NUM_DIR_LIGHTS; ++i)
     {
-        result += shadowFactor[i] * ComputeDirectionalLight(gLights[i], mat, normal, toEye);
+        result += shadowFactor[i] * ComputeDirectionalLight(dirLights[i], mat, normal, toEye);
     }
 #endif
 
-#if (NUM_POINT_LIGHTS > 0)
-    for (i = NUM_DIR_LIGHTS; i < NUM_DIR_LIGHTS + NUM_POINT_LIGHTS; ++i)
+    uint first = cluster * ClusterStride;
+    uint count = clusters[first];
+    for (uint j = 1; j <= count; ++j)
     {
-        result += ComputePointLight(gLights[i], mat, pos, normal, toEye);
+        uint index = clusters[first + j];
+        if (index < pointLightCount)
+            result += ComputePointLight(lights[index], mat, pos, normal, toEye);
+        else
+            result += ComputeSpotLight(lights[index], mat, pos, normal, toEye);
     }
-#endif
-
-#if (NUM_SPOT_LIGHTS > 0)
-    for (i = NUM_DIR_LIGHTS + NUM_POINT_LIGHTS; i < NUM_DIR_LIGHTS + NUM_POINT_LIGHTS + NUM_SPOT_LIGHTS; ++i)
-    {
-        result += ComputeSpotLight(gLights[i], mat, pos, normal, toEye);
-    }
-#endif 
 
     return float4(result, 0.0f);
 }
-
-
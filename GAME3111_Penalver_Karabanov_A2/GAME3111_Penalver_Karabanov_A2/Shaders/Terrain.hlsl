@@ -0,0 +1,114 @@
+//***************************************************************************************
+// Terrain.hlsl
+//
+// Tessellated heightfield terrain.  The vertex shader passes the corners of each quad
+// patch through; the hull shader subdivides each edge by its distance to the eye, and
+// the domain shader displaces the new vertices by the heightmap and takes its normal by
+// finite differences.  Pixels are shaded by the PS of Default.hlsl.
+//***************************************************************************************
+
+#include "Default.hlsl"
+
+// Heights in world units, from TerrainHeight.hlsl.
+Texture2D gHeightMap : register(t1);
+
+// Patches closer than gMinTessDistance get gMaxTess subdivisions per edge, ones past
+// gMaxTessDistance get gMinTess, with powers of two in between.
+static const float gMinTessDistance = 100.0f;
+static const float gMaxTessDistance = 1800.0f;
+static const float gMinTess = 0.0f;
+static const float gMaxTess = 4.0f;
+
+struct PatchVertex
+{
+	float3 PosW : POSITION;
+	float2 TexC : TEXCOORD;
+};
+
+PatchVertex TerrainVS(VertexIn vin)
+{
+	PatchVertex vout;
+	vout.PosW = mul(float4(vin.PosL, 1.0f), gWorld).xyz;
+	vout.TexC = vin.TexC;
+	return vout;
+}
+
+struct PatchTess
+{
+	float EdgeTess[4]   : SV_TessFactor;
+	float InsideTess[2] : SV_InsideTessFactor;
+};
+
+float CalcTessFactor(float3 p)
+{
+	// The heights are not known yet, so distance is measured in the xz plane.
+	float d = distance(p.xz, gEyePosW.xz);
+	float s = saturate((d - gMinTessDistance) / (gMaxTessDistance - gMinTessDistance));
+	return pow(2.0f, lerp(gMaxTess, gMinTess, s));
+}
+
+PatchTess ConstantHS(InputPatch<PatchVertex, 4> patch, uint patchID : SV_PrimitiveID)
+{
+	PatchTess pt;
+
+	// Each edge is subdivided by its midpoint's distance, so neighbouring patches agree
+	// on their shared edge and no cracks open between them.
+	float3 e0 = 0.5f*(patch[0].PosW + patch[2].PosW);
+	float3 e1 = 0.5f*(patch[0].PosW + patch[1].PosW);
+	float3 e2 = 0.5f*(patch[1].PosW + patch[3].PosW);
+	float3 e3 = 0.5f*(patch[2].PosW + patch[3].PosW);
+	float3 c = 0.25f*(patch[0].PosW + patch[1].PosW + patch[2].PosW + patch[3].PosW);
+
+	pt.EdgeTess[0] = CalcTessFactor(e0);
+	pt.EdgeTess[1] = CalcTessFactor(e1);
+	pt.EdgeTess[2] = CalcTessFactor(e2);
+	pt.EdgeTess[3] = CalcTessFactor(e3);
+
+	pt.InsideTess[0] = CalcTessFactor(c);
+	pt.InsideTess[1] = pt.InsideTess[0];
+
+	return pt;
+}
+
+[domain("quad")]
+[partitioning("fractional_even")]
+[outputtopology("triangle_cw")]
+[outputcontrolpoints(4)]
+[patchconstantfunc("ConstantHS")]
+[maxtessfactor(64.0f)]
+PatchVertex TerrainHS(InputPatch<PatchVertex, 4> p, uint i : SV_OutputControlPointID,
+	uint patchId : SV_PrimitiveID)
+{
+	return p[i];
+}
+
+[domain("quad")]
+VertexOut TerrainDS(PatchTess patchTess, float2 uv : SV_DomainLocation,
+	const OutputPatch<PatchVertex, 4> quad)
+{
+	VertexOut dout = (VertexOut)0.0f;
+
+	// Bilinear interpolation over the patch; corners 0 and 1 are its +z edge.
+	dout.PosW = lerp(lerp(quad[0].PosW, quad[1].PosW, uv.x), lerp(quad[2].PosW, quad[3].PosW, uv.x), uv.y);
+	float2 texC = lerp(lerp(quad[0].TexC, quad[1].TexC, uv.x), lerp(quad[2].TexC, quad[3].TexC, uv.x), uv.y);
+
+	dout.PosW.y = gHeightMap.SampleLevel(gsamLinearClamp, texC, 0).r;
+
+	// Central differences, one texel each way; gGridSpatialStep is the texel spacing.
+	uint mapWidth, mapHeight;
+	gHeightMap.GetDimensions(mapWidth, mapHeight);
+	float2 texel = 1.0f / float2(mapWidth, mapHeight);
+
+	float l = gHeightMap.SampleLevel(gsamLinearClamp, texC - float2(texel.x, 0.0f), 0).r;
+	float r = gHeightMap.SampleLevel(gsamLinearClamp, texC + float2(texel.x, 0.0f), 0).r;
+	float t = gHeightMap.SampleLevel(gsamLinearClamp, texC - float2(0.0f, texel.y), 0).r;
+	float b = gHeightMap.SampleLevel(gsamLinearClamp, texC + float2(0.0f, texel.y), 0).r;
+	dout.NormalW = normalize(float3(l - r, 2.0f*gGridSpatialStep, b - t));
+
+	dout.PosH = mul(float4(dout.PosW, 1.0f), gViewProj);
+
+	float4 tex = mul(float4(texC, 0.0f, 1.0f), gTexTransform);
+	dout.TexC = mul(tex, gMatTransform).xy;
+
+	return dout;
+}
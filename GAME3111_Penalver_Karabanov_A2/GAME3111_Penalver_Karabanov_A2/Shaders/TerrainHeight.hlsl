@@ -0,0 +1,55 @@
+//=============================================================================
+// TerrainHeight.hlsl
+//
+// BuildHeightMapCS(): One thread per heightmap texel.  Writes the world-space
+//     height of the texel's centre: rolling hills, flattened into a lake bed
+//     around the castle and into a floor under the maze.
+//=============================================================================
+
+// Root constants in slot 0 of the waves root signature; must match Terrain::BuildHeightMap.
+cbuffer cbTerrainSettings : register(b0)
+{
+	float2 gTerrainSize;
+	uint   gHeightMapSize;
+};
+
+RWTexture2D<float> gOutput : register(u0);
+
+// The lake the waves cover, and the maze's cells, in world space (min xz, max xz).
+static const float4 gLakeRect = float4(-480.0f, -480.0f, 480.0f, 480.0f);
+static const float4 gMazeRect = float4(-780.0f, -2030.0f, 780.0f, -470.0f);
+
+static const float gLakeBedHeight = -8.0f;
+static const float gMazeFloorHeight = -3.0f;
+
+// Distance from p to the rectangle, 0 inside it.
+float RectDistance(float2 p, float4 rect)
+{
+	float2 d = max(max(rect.xy - p, p - rect.zw), 0.0f);
+	return length(d);
+}
+
+float HillsHeight(float2 p)
+{
+	return 55.0f +
+		45.0f*sin(0.0031f*p.x)*cos(0.0027f*p.y) +
+		20.0f*sin(0.011f*p.x + 0.007f*p.y) +
+		6.0f*sin(0.031f*p.x)*sin(0.029f*p.y);
+}
+
+[numthreads(16, 16, 1)]
+void BuildHeightMapCS(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if(dispatchThreadID.x >= (int)gHeightMapSize || dispatchThreadID.y >= (int)gHeightMapSize)
+		return;
+
+	// Texel (0,0) is the (-x, +z) corner, as the patch grid's tex-coords have it.
+	float2 uv = (dispatchThreadID.xy + 0.5f) / gHeightMapSize;
+	float2 p = float2(uv.x - 0.5f, 0.5f - uv.y) * gTerrainSize;
+
+	float h = HillsHeight(p);
+	h = lerp(gMazeFloorHeight, h, smoothstep(0.0f, 150.0f, RectDistance(p, gMazeRect)));
+	h = lerp(gLakeBedHeight, h, smoothstep(0.0f, 200.0f, RectDistance(p, gLakeRect)));
+
+	gOutput[dispatchThreadID.xy] = h;
+}
@@ -0,0 +1,88 @@
+//=============================================================================
+// TextOverlay.hlsl
+//
+// Draws the TextOverlay quads.  One instance per quad, expanded from
+// SV_VertexID as a strip and placed in pixels from the top-left of the screen.
+// Glyphs 0-63 are ASCII 32-95 in the built-in 5x7 font; SolidGlyph fills the
+// whole quad.
+//=============================================================================
+
+#define SolidGlyph 0xffffffff
+
+cbuffer cbOverlay : register(b0)
+{
+	float2 gInvRenderTargetSize;
+};
+
+// Must match OverlayGlyph in TextOverlay.h.
+struct OverlayGlyph
+{
+	float2 PosPx;
+	float2 SizePx;
+	float4 Color;
+	uint   Glyph;
+	uint3  GlyphPad;
+};
+
+StructuredBuffer<OverlayGlyph> gGlyphs : register(t0);
+
+// One bit per font pixel, row-major from the top-left: bit row * 5 + column of
+// the 35, the first 32 in x.
+static const uint2 gFont[64] =
+{
+	uint2(0x00000000, 0x0), uint2(0x00421084, 0x1), uint2(0x0000014a, 0x0), uint2(0x95f57d4a, 0x2),
+	uint2(0x1f4717c4, 0x1), uint2(0x32222263, 0x6), uint2(0x93511526, 0x5), uint2(0x00000084, 0x0),
+	uint2(0x08210888, 0x2), uint2(0x88842082, 0x0), uint2(0x09575480, 0x0), uint2(0x084f9080, 0x0),
+	uint2(0x88600000, 0x0), uint2(0x000f8000, 0x0), uint2(0x8c000000, 0x1), uint2(0x02222200, 0x0),
+	uint2(0xa33ae62e, 0x3), uint2(0x884210c4, 0x3), uint2(0xc444422e, 0x7), uint2(0xa304111f, 0x3),
+	uint2(0x11f4a988, 0x2), uint2(0xa3083c3f, 0x3), uint2(0xa317844c, 0x3), uint2(0x8422221f, 0x0),
+	uint2(0xa317462e, 0x3), uint2(0x910f462e, 0x1), uint2(0x0c6018c0, 0x0), uint2(0x886018c0, 0x0),
+	uint2(0x08208888, 0x2), uint2(0x01f07c00, 0x0), uint2(0x88882082, 0x0), uint2(0x0044422e, 0x1),
+	uint2(0xab5b422e, 0x3), uint2(0x631fc62e, 0x4), uint2(0xe317c62f, 0x3), uint2(0xa210862e, 0x3),
+	uint2(0xd318c527, 0x1), uint2(0xc217843f, 0x7), uint2(0x4217843f, 0x0), uint2(0xa31e862e, 0x7),
+	uint2(0x631fc631, 0x4), uint2(0x8842108e, 0x3), uint2(0x9284211c, 0x1), uint2(0x52519531, 0x4),
+	uint2(0xc2108421, 0x7), uint2(0x631ad771, 0x4), uint2(0x639ace31, 0x4), uint2(0xa318c62e, 0x3),
+	uint2(0x4217c62f, 0x0), uint2(0x9358c62e, 0x5), uint2(0x5257c62f, 0x4), uint2(0xe107043e, 0x3),
+	uint2(0x0842109f, 0x1), uint2(0xa318c631, 0x3), uint2(0x1518c631, 0x1), uint2(0xab5ac631, 0x2),
+	uint2(0x62a22a31, 0x4), uint2(0x08422a31, 0x1), uint2(0xc222221f, 0x7), uint2(0x8421084e, 0x3),
+	uint2(0x20820820, 0x0), uint2(0x9084210e, 0x3), uint2(0x00004544, 0x0), uint2(0xc0000000, 0x7)
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float2 FontC : TEXCOORD;
+	float4 Color : COLOR;
+	nointerpolation uint Glyph : GLYPH;
+};
+
+VertexOut VS(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+	OverlayGlyph g = gGlyphs[instanceID];
+
+	float2 corner = float2(vertexID & 1, vertexID >> 1);
+	float2 posPx = g.PosPx + corner * g.SizePx;
+
+	VertexOut vout;
+	vout.PosH  = float4(posPx.x * gInvRenderTargetSize.x * 2.0f - 1.0f,
+		1.0f - posPx.y * gInvRenderTargetSize.y * 2.0f, 0.0f, 1.0f);
+	vout.FontC = corner * float2(5.0f, 7.0f);
+	vout.Color = g.Color;
+	vout.Glyph = g.Glyph;
+
+	return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+	if(pin.Glyph != SolidGlyph)
+	{
+		uint2 cell = min((uint2)pin.FontC, uint2(4, 6));
+		uint bit = cell.y * 5 + cell.x;
+		uint2 glyph = gFont[pin.Glyph];
+		uint word = (bit < 32) ? glyph.x : glyph.y;
+		clip((float)((word >> (bit & 31)) & 1) - 0.5f);
+	}
+
+	return pin.Color;
+}
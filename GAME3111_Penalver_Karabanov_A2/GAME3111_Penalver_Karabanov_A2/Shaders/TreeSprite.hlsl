@@ -7,14 +7,6 @@
     #define NUM_DIR_LIGHTS 3
 #endif
 
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 0
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 0
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 //step5
@@ -62,13 +54,19 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+    // gLights holds gPointLightCount point lights and then the spot lights.
+    uint gPointLightCount;
+    uint gSpotLightCount;
+    float gClusterSliceScale;
+    float gClusterSliceBias;
+
+    Light gDirLights[MaxDirLights];
 };
 
+// Point and spot lights, and the lists of them that reach each cluster.
+StructuredBuffer<Light> gLights   : register(t2, space1);
+StructuredBuffer<uint>  gClusters : register(t3, space1);
+
 cbuffer cbMaterial : register(b2)
 {
 	float4   gDiffuseAlbedo;
@@ -77,104 +75,83 @@ cbuffer cbMaterial : register(b2)
 	float4x4 gMatTransform;
 };
  
-struct VertexIn
+// Per-tree data, expanded around the shared quad by SV_InstanceID.
+struct TreeInstance
 {
-	float3 PosW  : POSITION;
-	float2 SizeW : SIZE;
+	float3 PosW;
+	float  Fade;
+	float2 SizeW;
+	uint   Slice;
+	uint   TreePad0;
 };
 
-struct VertexOut
+StructuredBuffer<TreeInstance> gTreeInstances : register(t0, space1);
+
+struct VertexIn
 {
-	float3 CenterW : POSITION;
-	float2 SizeW   : SIZE;
+	// Offset from the tree's centre in units of its size: x along right, y along up.
+	float2 Corner : CORNER;
 };
 
-struct GeoOut
+struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
-    float3 PosW    : POSITION;
-    float3 NormalW : NORMAL;
-    float2 TexC    : TEXCOORD;
-    uint   PrimID  : SV_PrimitiveID;
+	float3 PosW    : POSITION;
+	float3 NormalW : NORMAL;
+	float2 TexC    : TEXCOORD;
+	nointerpolation uint  Slice : SLICE;
+	nointerpolation float Fade  : FADE;
 };
 
-VertexOut VS(VertexIn vin)
+// 4x4 ordered dither thresholds for fading trees in and out without blending.
+static const float gDitherThresholds[16] =
 {
-	VertexOut vout;
+	 0.0f,  8.0f,  2.0f, 10.0f,
+	12.0f,  4.0f, 14.0f,  6.0f,
+	 3.0f, 11.0f,  1.0f,  9.0f,
+	15.0f,  7.0f, 13.0f,  5.0f
+};
 
-	// Just pass data over to geometry shader.
-	vout.CenterW = vin.PosW;
-	vout.SizeW   = vin.SizeW;
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	TreeInstance tree = gTreeInstances[instanceID];
 
-	return vout;
-}
- 
-//step4
- // We expand each point into a quad (4 vertices), so the maximum number of vertices
- // we output per geometry shader invocation is 4.
-[maxvertexcount(4)]
-void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumElements]-> one vertex for a point, two for aline, threefor atriangle, four for line with adjacency, and six for a triangle with adjacency.
-        uint primID : SV_PrimitiveID, //inout StreamOutputObject<OutputVertexType>
-        inout TriangleStream<GeoOut> triStream)  //OutputName
-{	
 	//
 	// Compute the local coordinate system of the sprite relative to the world
 	// space such that the billboard is aligned with the y-axis and faces the eye.
 	//
 
 	float3 up = float3(0.0f, 1.0f, 0.0f);
-	float3 look = gEyePosW - gin[0].CenterW;
+	float3 look = gEyePosW - tree.PosW;
 	look.y = 0.0f; // y-axis aligned, so project to xz-plane
 	look = normalize(look);
 	float3 right = cross(up, look);
 
-	//
-	// Compute triangle strip vertices (quad) in world space.
-	//
-	float halfWidth  = 0.5f*gin[0].SizeW.x;
-	float halfHeight = 0.5f*gin[0].SizeW.y;
-	
-	float4 v[4];
-	v[0] = float4(gin[0].CenterW + halfWidth*right - halfHeight*up, 1.0f);
-	v[1] = float4(gin[0].CenterW + halfWidth*right + halfHeight*up, 1.0f);
-	v[2] = float4(gin[0].CenterW - halfWidth*right - halfHeight*up, 1.0f);
-	v[3] = float4(gin[0].CenterW - halfWidth*right + halfHeight*up, 1.0f);
+	float3 posW = tree.PosW + vin.Corner.x*tree.SizeW.x*right + vin.Corner.y*tree.SizeW.y*up;
 
-	//
-	// Transform quad vertices to world space and output 
-	// them as a triangle strip.
-	//
-	
-	float2 texC[4] = 
-	{
-		float2(0.0f, 1.0f),
-		float2(0.0f, 0.0f),
-		float2(1.0f, 1.0f),
-		float2(1.0f, 0.0f)
-	};
-	
-	GeoOut gout;
-	[unroll]
-	for(int i = 0; i < 4; ++i)
-	{
-		gout.PosH     = mul(v[i], gViewProj);
-		gout.PosW     = v[i].xyz;
-		gout.NormalW  = look;
-		gout.TexC     = texC[i];
-		gout.PrimID   = primID;
-		
-		triStream.Append(gout);
-	}
+	VertexOut vout;
+	vout.PosH    = mul(float4(posW, 1.0f), gViewProj);
+	vout.PosW    = posW;
+	vout.NormalW = look;
+	vout.TexC    = float2(0.5f - vin.Corner.x, 0.5f - vin.Corner.y);
+	vout.Slice   = tree.Slice;
+	vout.Fade    = tree.Fade;
+
+	return vout;
 }
 
 //step6
-float4 PS(GeoOut pin) : SV_Target
+float4 PS(VertexOut pin) : SV_Target
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
+	// Trees in the fade band lose a growing share of their pixels.
+	uint2 ditherCell = (uint2)pin.PosH.xy % 4;
+	clip(pin.Fade - (gDitherThresholds[ditherCell.y * 4 + ditherCell.x] + 0.5f) / 16.0f);
+
+	float3 uvw = float3(pin.TexC, pin.Slice);
     float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
 
     //using dynamic indexing
-    //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+    //float4 diffuseAlbedo = gTreeMapArray[pin.Slice].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
 
 	
 #ifdef ALPHA_TEST
@@ -198,8 +175,11 @@ float4 PS(GeoOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy * gInvRenderTargetSize, viewZ,
+        gClusterSliceScale, gClusterSliceBias);
+    float4 directLight = ComputeLighting(gDirLights, gLights, gClusters, cluster,
+        gPointLightCount, mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
 
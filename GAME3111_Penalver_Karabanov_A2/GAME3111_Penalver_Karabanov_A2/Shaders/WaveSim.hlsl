@@ -18,8 +18,10 @@ cbuffer cbUpdateSettings
 	int2 gDisturbIndex;
 };
  
-RWTexture2D<float> gPrevSolInput : register(u0);
-RWTexture2D<float> gCurrSolInput : register(u1);
+// The inputs are read-only, so the vertex shader can keep displacing with the current
+// solution while the next one is written.
+Texture2D<float>   gPrevSolInput : register(t0);
+Texture2D<float>   gCurrSolInput : register(t1);
 RWTexture2D<float> gOutput       : register(u2);
  
 [numthreads(16, 16, 1)]
@@ -0,0 +1,178 @@
+//***************************************************************************************
+// SphereSweep.cpp
+//***************************************************************************************
+
+#include "SphereSweep.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Padding lanes sit this far away so they can never overlap the sphere.
+	const float kFarAway = 1.0e18f;
+
+	// Extra distance the sphere is pushed out, so a resting contact is not re-detected
+	// as a penetration on the next substep.
+	const float kSkin = 1.0e-3f;
+
+	// Push-out passes per substep; enough to settle into a corner between two walls.
+	const int kMaxIterations = 4;
+}
+
+void SphereSweep::Clear()
+{
+	mGroups.clear();
+	mBoxes.clear();
+}
+
+void SphereSweep::AddBox(const BoundingBox& box)
+{
+	std::uint32_t lane = (std::uint32_t)mBoxes.size() % 4;
+	if(lane == 0)
+	{
+		BoxGroup g;
+		g.CenterX = g.CenterY = g.CenterZ = XMVectorReplicate(kFarAway);
+		g.ExtentX = g.ExtentY = g.ExtentZ = XMVectorZero();
+		mGroups.push_back(g);
+	}
+
+	BoxGroup& g = mGroups.back();
+	g.CenterX = XMVectorSetByIndex(g.CenterX, box.Center.x, lane);
+	g.CenterY = XMVectorSetByIndex(g.CenterY, box.Center.y, lane);
+	g.CenterZ = XMVectorSetByIndex(g.CenterZ, box.Center.z, lane);
+	g.ExtentX = XMVectorSetByIndex(g.ExtentX, box.Extents.x, lane);
+	g.ExtentY = XMVectorSetByIndex(g.ExtentY, box.Extents.y, lane);
+	g.ExtentZ = XMVectorSetByIndex(g.ExtentZ, box.Extents.z, lane);
+
+	mBoxes.push_back(box);
+}
+
+std::uint32_t SphereSweep::BoxCount()const
+{
+	return (std::uint32_t)mBoxes.size();
+}
+
+XMVECTOR XM_CALLCONV SphereSweep::Move(FXMVECTOR start, FXMVECTOR delta, float radius)const
+{
+	if(mBoxes.empty())
+		return XMVectorAdd(start, delta);
+
+	// Not capped: a long frame (a hitch, or fixed-step catch-up) just takes more
+	// substeps rather than longer ones.
+	float length = XMVectorGetX(XMVector3Length(delta));
+	int substeps = std::max((int)ceilf(length / (0.5f * radius)), 1);
+
+	XMVECTOR step = XMVectorScale(delta, 1.0f / substeps);
+	XMVECTOR p = start;
+
+	for(int s = 0; s < substeps; ++s)
+	{
+		p = XMVectorAdd(p, step);
+
+		std::uint32_t box;
+		for(int i = 0; i < kMaxIterations && FindDeepest(p, radius, box); ++i)
+			p = PushOut(p, radius, box);
+	}
+
+	return p;
+}
+
+bool XM_CALLCONV SphereSweep::FindDeepest(FXMVECTOR center, float radius, std::uint32_t& box)const
+{
+	const XMVECTOR px = XMVectorSplatX(center);
+	const XMVECTOR py = XMVectorSplatY(center);
+	const XMVECTOR pz = XMVectorSplatZ(center);
+	const XMVECTOR r = XMVectorReplicate(radius);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR four = XMVectorReplicate(4.0f);
+
+	XMVECTOR bestDepth = zero;
+	XMVECTOR bestIndex = XMVectorReplicate(-1.0f);
+	XMVECTOR index = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+
+	for(const BoxGroup& g : mGroups)
+	{
+		// Signed distance from the sphere center to each slab (negative inside).
+		XMVECTOR ox = XMVectorSubtract(XMVectorAbs(XMVectorSubtract(px, g.CenterX)), g.ExtentX);
+		XMVECTOR oy = XMVectorSubtract(XMVectorAbs(XMVectorSubtract(py, g.CenterY)), g.ExtentY);
+		XMVECTOR oz = XMVectorSubtract(XMVectorAbs(XMVectorSubtract(pz, g.CenterZ)), g.ExtentZ);
+
+		// Squared distance from the center to the box.
+		XMVECTOR qx = XMVectorMax(ox, zero);
+		XMVECTOR qy = XMVectorMax(oy, zero);
+		XMVECTOR qz = XMVectorMax(oz, zero);
+		XMVECTOR d2 = XMVectorMultiplyAdd(qx, qx, XMVectorMultiplyAdd(qy, qy, XMVectorMultiply(qz, qz)));
+
+		// Penetration depth: radius minus distance when the center is outside the box,
+		// radius plus the distance to the nearest face when it is inside.
+		XMVECTOR outsideDepth = XMVectorSubtract(r, XMVectorSqrt(d2));
+		XMVECTOR insideDepth = XMVectorSubtract(r, XMVectorMax(ox, XMVectorMax(oy, oz)));
+		XMVECTOR depth = XMVectorSelect(outsideDepth, insideDepth, XMVectorLessOrEqual(d2, zero));
+
+		XMVECTOR deeper = XMVectorGreater(depth, bestDepth);
+		bestDepth = XMVectorSelect(bestDepth, depth, deeper);
+		bestIndex = XMVectorSelect(bestIndex, index, deeper);
+
+		index = XMVectorAdd(index, four);
+	}
+
+	XMFLOAT4A depths, indices;
+	XMStoreFloat4A(&depths, bestDepth);
+	XMStoreFloat4A(&indices, bestIndex);
+
+	const float d[4] = { depths.x, depths.y, depths.z, depths.w };
+	const float k[4] = { indices.x, indices.y, indices.z, indices.w };
+
+	int lane = -1;
+	for(int i = 0; i < 4; ++i)
+	{
+		if(k[i] >= 0.0f && (lane < 0 || d[i] > d[lane]))
+			lane = i;
+	}
+
+	if(lane < 0)
+		return false;
+
+	box = (std::uint32_t)k[lane];
+	return true;
+}
+
+XMVECTOR XM_CALLCONV SphereSweep::PushOut(FXMVECTOR center, float radius, std::uint32_t box)const
+{
+	const BoundingBox& b = mBoxes[box];
+	XMVECTOR c = XMLoadFloat3(&b.Center);
+	XMVECTOR e = XMLoadFloat3(&b.Extents);
+
+	XMVECTOR d = XMVectorSubtract(center, c);
+	XMVECTOR closest = XMVectorClamp(d, XMVectorNegate(e), e);
+	XMVECTOR sep = XMVectorSubtract(d, closest);
+	float dist = XMVectorGetX(XMVector3Length(sep));
+
+	if(dist > 1.0e-5f)
+	{
+		// Center is outside the box: move it along the contact normal to radius + skin.
+		XMVECTOR n = XMVectorScale(sep, 1.0f / dist);
+		return XMVectorAdd(XMVectorAdd(c, closest), XMVectorScale(n, radius + kSkin));
+	}
+
+	// Center is inside the box: leave through the nearest face.
+	XMFLOAT3 dd, ee;
+	XMStoreFloat3(&dd, d);
+	XMStoreFloat3(&ee, e);
+
+	float offset[3] = { dd.x, dd.y, dd.z };
+	const float extent[3] = { ee.x, ee.y, ee.z };
+
+	int axis = 0;
+	for(int i = 1; i < 3; ++i)
+	{
+		if(extent[i] - fabsf(offset[i]) < extent[axis] - fabsf(offset[axis]))
+			axis = i;
+	}
+
+	offset[axis] = (offset[axis] < 0.0f ? -1.0f : 1.0f) * (extent[axis] + radius + kSkin);
+
+	return XMVectorAdd(c, XMVectorSet(offset[0], offset[1], offset[2], 0.0f));
+}
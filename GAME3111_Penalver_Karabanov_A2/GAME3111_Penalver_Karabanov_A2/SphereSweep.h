@@ -0,0 +1,63 @@
+//***************************************************************************************
+// SphereSweep.h
+//
+// Swept-sphere vs. axis-aligned box collision with a sliding response, used to move the
+// camera through the maze.  Candidate boxes are packed four to a group in
+// structure-of-arrays form (centers and extents per axis), so every DirectXMath vector
+// operation in the overlap test works on four boxes at once.
+//***************************************************************************************
+
+#ifndef SPHERESWEEP_H
+#define SPHERESWEEP_H
+
+#include <vector>
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class SphereSweep
+{
+public:
+	SphereSweep() = default;
+	SphereSweep(const SphereSweep& rhs) = delete;
+	SphereSweep& operator=(const SphereSweep& rhs) = delete;
+
+	// Removes all candidate boxes but keeps the storage for the next frame.
+	void Clear();
+	void AddBox(const DirectX::BoundingBox& box);
+
+	std::uint32_t BoxCount()const;
+
+	// Moves a sphere of the given radius from start by delta and returns where it ends.
+	// The move is split into substeps no longer than half the radius so thin walls
+	// cannot be skipped, however long the move; after each substep the sphere is pushed
+	// out of any box it overlaps, which removes only the motion into the box and lets it
+	// slide along it.
+	DirectX::XMVECTOR XM_CALLCONV Move(DirectX::FXMVECTOR start, DirectX::FXMVECTOR delta,
+		float radius)const;
+
+private:
+	// Finds the box the sphere penetrates deepest.  Returns false if it touches none.
+	bool XM_CALLCONV FindDeepest(DirectX::FXMVECTOR center, float radius, std::uint32_t& box)const;
+
+	DirectX::XMVECTOR XM_CALLCONV PushOut(DirectX::FXMVECTOR center, float radius, std::uint32_t box)const;
+
+private:
+	// Four boxes; unused lanes hold a box far outside the world.
+	struct BoxGroup
+	{
+		DirectX::XMVECTOR CenterX;
+		DirectX::XMVECTOR CenterY;
+		DirectX::XMVECTOR CenterZ;
+		DirectX::XMVECTOR ExtentX;
+		DirectX::XMVECTOR ExtentY;
+		DirectX::XMVECTOR ExtentZ;
+	};
+
+	std::vector<BoxGroup> mGroups;
+
+	// Same boxes in their original form, for the scalar push-out of the chosen box.
+	std::vector<DirectX::BoundingBox> mBoxes;
+};
+
+#endif // SPHERESWEEP_H
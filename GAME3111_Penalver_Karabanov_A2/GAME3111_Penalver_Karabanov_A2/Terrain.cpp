@@ -0,0 +1,117 @@
+//***************************************************************************************
+// Terrain.cpp
+//***************************************************************************************
+
+#include "Terrain.h"
+
+using Microsoft::WRL::ComPtr;
+
+Terrain::Terrain(ID3D12Device* device, UINT size, float width, float depth, UINT patchCount)
+{
+	md3dDevice = device;
+
+	mSize = size;
+	mWidth = width;
+	mDepth = depth;
+	mPatchCount = patchCount;
+
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = mSize;
+	texDesc.Height = mSize;
+	texDesc.DepthOrArraySize = 1;
+	texDesc.MipLevels = 1;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+	// Every texel is written by BuildHeightMap, so nothing is uploaded.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		nullptr,
+		IID_PPV_ARGS(&mHeightMap)));
+}
+
+float Terrain::Width()const
+{
+	return mWidth;
+}
+
+float Terrain::Depth()const
+{
+	return mDepth;
+}
+
+UINT Terrain::PatchCount()const
+{
+	return mPatchCount;
+}
+
+float Terrain::TexelSpacing()const
+{
+	return mWidth / mSize;
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE Terrain::HeightMap()const
+{
+	return mHeightMapSrv;
+}
+
+UINT Terrain::DescriptorCount()const
+{
+	return 2;
+}
+
+void Terrain::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	uavDesc.Texture2D.MipSlice = 0;
+
+	md3dDevice->CreateShaderResourceView(mHeightMap.Get(), &srvDesc, hCpuDescriptor);
+	md3dDevice->CreateUnorderedAccessView(mHeightMap.Get(), nullptr, &uavDesc, hCpuDescriptor.Offset(1, descriptorSize));
+
+	mHeightMapSrv = hGpuDescriptor;
+	mHeightMapUav = hGpuDescriptor.Offset(1, descriptorSize);
+}
+
+void Terrain::BuildHeightMap(
+	ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso)
+{
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(rootSig);
+
+	// Must match cbTerrainSettings in TerrainHeight.hlsl.
+	const float extents[2] = { mWidth, mDepth };
+	cmdList->SetComputeRoot32BitConstants(0, 2, extents, 0);
+	cmdList->SetComputeRoot32BitConstants(0, 1, &mSize, 2);
+
+	cmdList->SetComputeRootDescriptorTable(1, mHeightMapUav);
+
+	UINT numGroups = (mSize + 15) / 16;
+	cmdList->Dispatch(numGroups, numGroups, 1);
+
+	// From here on the heightmap is only read, by the domain shader.
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mHeightMap.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+}
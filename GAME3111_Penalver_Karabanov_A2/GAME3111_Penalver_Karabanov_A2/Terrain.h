@@ -0,0 +1,69 @@
+//***************************************************************************************
+// Terrain.h
+//
+// A heightfield generated on the GPU and drawn as a coarse grid of quad patches that the
+// hull and domain shaders in Terrain.hlsl tessellate and displace.  The heightmap is an
+// R32_FLOAT texture written once at startup by TerrainHeight.hlsl, so no terrain vertex
+// is evaluated on the CPU; the patches are subdivided by their distance to the camera,
+// so detail goes where it is seen.
+//
+// The heightmap covers [-Width/2, Width/2] x [-Depth/2, Depth/2] in world space, with
+// tex-coord (0,0) at the (-x, +z) corner like GeometryGenerator::CreateGrid.
+//***************************************************************************************
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "../../Common/d3dUtil.h"
+
+class Terrain
+{
+public:
+	// The heightmap is dispatched in 16x16 thread groups, so size need not be a multiple
+	// of 16.  patchCount patches run along each side.
+	Terrain(ID3D12Device* device, UINT size, float width, float depth, UINT patchCount);
+	Terrain(const Terrain& rhs) = delete;
+	Terrain& operator=(const Terrain& rhs) = delete;
+	~Terrain() = default;
+
+	float Width()const;
+	float Depth()const;
+	UINT PatchCount()const;
+
+	// World distance between heightmap texels, for the domain shader's normals.
+	float TexelSpacing()const;
+
+	// SRV of the heightmap, for the domain shader.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE HeightMap()const;
+
+	// An SRV followed by a UAV.
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Records the heightmap's generation and leaves it in NON_PIXEL_SHADER_RESOURCE.  The
+	// root signature is the wave simulation's: six root constants and a UAV table in
+	// slot 1.  The caller must have set the heap that holds the descriptors.
+	void BuildHeightMap(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso);
+
+private:
+	UINT mSize = 0;
+	float mWidth = 0.0f;
+	float mDepth = 0.0f;
+	UINT mPatchCount = 0;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mHeightMapSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mHeightMapUav;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mHeightMap = nullptr;
+};
+
+#endif // TERRAIN_H
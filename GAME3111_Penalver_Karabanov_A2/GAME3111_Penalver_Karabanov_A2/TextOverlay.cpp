@@ -0,0 +1,53 @@
+//***************************************************************************************
+// TextOverlay.cpp
+//***************************************************************************************
+
+#include "TextOverlay.h"
+
+using namespace DirectX;
+
+void TextOverlay::Clear()
+{
+	mGlyphs.clear();
+}
+
+void TextOverlay::Box(float x, float y, float width, float height, const XMFLOAT4& color)
+{
+	Add(x, y, width, height, SolidGlyph, color);
+}
+
+float TextOverlay::Text(float x, float y, const char* text, const XMFLOAT4& color)
+{
+	for(const char* c = text; *c != '\0'; ++c)
+	{
+		int code = (unsigned char)*c;
+		if(code >= 'a' && code <= 'z')
+			code -= 'a' - 'A';
+
+		// Spaces and characters outside the font only advance.
+		if(code > ' ' && code <= '_')
+			Add(x, y, 5.0f * Scale, 7.0f * Scale, (unsigned int)(code - ' '), color);
+
+		x += CharAdvance;
+	}
+
+	return x;
+}
+
+const std::vector<OverlayGlyph>& TextOverlay::Glyphs()const
+{
+	return mGlyphs;
+}
+
+void TextOverlay::Add(float x, float y, float width, float height, unsigned int glyph, const XMFLOAT4& color)
+{
+	if(mGlyphs.size() >= MaxOverlayGlyphs)
+		return;
+
+	OverlayGlyph g;
+	g.PosPx = XMFLOAT2(x, y);
+	g.SizePx = XMFLOAT2(width, height);
+	g.Color = color;
+	g.Glyph = glyph;
+	mGlyphs.push_back(g);
+}
@@ -0,0 +1,61 @@
+//***************************************************************************************
+// TextOverlay.h
+//
+// Screen-space text and boxes for debug readouts.  They are laid out on the CPU as a
+// list of quads in pixels, which Shaders\TextOverlay.hlsl expands from SV_VertexID and
+// draws in a single instanced call.  The font is built into the shader: 5x7 pixels,
+// ASCII 32 to 95, with lower case drawn as upper case.
+//***************************************************************************************
+
+#ifndef TEXTOVERLAY_H
+#define TEXTOVERLAY_H
+
+#include <vector>
+#include <DirectXMath.h>
+
+// Quads the per-frame overlay buffer holds; the rest of a longer layout is dropped.
+#define MaxOverlayGlyphs 4096
+
+// One quad of the overlay.  Glyph is a character's offset from ASCII 32, or
+// TextOverlay::SolidGlyph for a filled box.
+struct OverlayGlyph
+{
+	DirectX::XMFLOAT2 PosPx = { 0.0f, 0.0f };
+	DirectX::XMFLOAT2 SizePx = { 0.0f, 0.0f };
+	DirectX::XMFLOAT4 Color = { 1.0f, 1.0f, 1.0f, 1.0f };
+	unsigned int Glyph = 0;
+	unsigned int GlyphPad0 = 0;
+	unsigned int GlyphPad1 = 0;
+	unsigned int GlyphPad2 = 0;
+};
+
+class TextOverlay
+{
+public:
+	static const unsigned int SolidGlyph = 0xffffffff;
+
+	// Screen pixels per font pixel, and the character and line advances that follow.
+	static const int Scale = 2;
+	static const int CharAdvance = 6 * Scale;
+	static const int LineAdvance = 9 * Scale;
+
+	TextOverlay() = default;
+	TextOverlay(const TextOverlay& rhs) = delete;
+	TextOverlay& operator=(const TextOverlay& rhs) = delete;
+
+	void Clear();
+
+	void Box(float x, float y, float width, float height, const DirectX::XMFLOAT4& color);
+
+	// Draws text with its top-left corner at (x, y) and returns the x it ends at.
+	float Text(float x, float y, const char* text, const DirectX::XMFLOAT4& color);
+
+	const std::vector<OverlayGlyph>& Glyphs()const;
+
+private:
+	void Add(float x, float y, float width, float height, unsigned int glyph, const DirectX::XMFLOAT4& color);
+
+	std::vector<OverlayGlyph> mGlyphs;
+};
+
+#endif // TEXTOVERLAY_H
@@ -0,0 +1,339 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	// Read-only view of a whole file; the pages are read in as the parser touches them.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::wstring& filename)
+		{
+			mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if(mFile == INVALID_HANDLE_VALUE)
+			{
+				Result = HRESULT_FROM_WIN32(GetLastError());
+				return;
+			}
+
+			LARGE_INTEGER size = {};
+			if(!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+			{
+				Result = E_FAIL;
+				return;
+			}
+
+			mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if(mMapping == nullptr)
+			{
+				Result = HRESULT_FROM_WIN32(GetLastError());
+				return;
+			}
+
+			Data = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+			if(Data == nullptr)
+			{
+				Result = HRESULT_FROM_WIN32(GetLastError());
+				return;
+			}
+
+			Size = (size_t)size.QuadPart;
+			Result = S_OK;
+		}
+
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+
+		~MappedFile()
+		{
+			if(Data != nullptr)
+				UnmapViewOfFile(Data);
+			if(mMapping != nullptr)
+				CloseHandle(mMapping);
+			if(mFile != INVALID_HANDLE_VALUE)
+				CloseHandle(mFile);
+		}
+
+		HRESULT Result = E_FAIL;
+		const uint8_t* Data = nullptr;
+		size_t Size = 0;
+
+	private:
+		HANDLE mFile = INVALID_HANDLE_VALUE;
+		HANDLE mMapping = nullptr;
+	};
+}
+
+TextureStreamer::TextureStreamer(ID3D12Device* device)
+{
+	md3dDevice = device;
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ComPtr<ID3D12CommandAllocator> alloc;
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(alloc.GetAddressOf())));
+	mAllocators.push_back(std::make_pair(alloc, 0ull));
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+		alloc.Get(), nullptr, IID_PPV_ARGS(mCopyList.GetAddressOf())));
+	ThrowIfFailed(mCopyList->Close());
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mCopyFence)));
+	mCopyFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+
+	// Mid grey and opaque, so geometry still reads as lit surfaces while it waits.
+	mPlaceholder = std::make_unique<Entry>();
+	mPlaceholder->Filename = L"placeholder";
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mPlaceholder->Resource)));
+
+	const std::uint32_t texel = 0xff808080;
+	D3D12_SUBRESOURCE_DATA texelData = {};
+	texelData.pData = &texel;
+	texelData.RowPitch = sizeof(texel);
+	texelData.SlicePitch = sizeof(texel);
+	ThrowIfFailed(StageEntry(mPlaceholder.get(), &texelData, 1));
+
+	BeginCopies();
+	RecordCopies(mPlaceholder.get());
+	WaitForCopyFence(EndCopies());
+
+	mPlaceholder->UploadHeap = nullptr;
+	mPlaceholder->State = EntryState::Resident;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// The workers write into the entries and the queue reads their upload heaps.
+	mWorkers.wait();
+	if(mCopyFence != nullptr)
+		WaitForCopyFence(mCopyFenceValue);
+
+	if(mCopyFenceEvent != nullptr)
+		CloseHandle(mCopyFenceEvent);
+}
+
+UINT TextureStreamer::Request(const std::wstring& filename)
+{
+	auto it = mCache.find(filename);
+	if(it != mCache.end())
+		return it->second;
+
+	UINT id = (UINT)mEntries.size();
+	mEntries.push_back(std::make_unique<Entry>());
+	mCache[filename] = id;
+	++mPendingCount;
+
+	Entry* entry = mEntries.back().get();
+	entry->Filename = filename;
+	mWorkers.run([this, entry]() { LoadEntry(entry); });
+
+	return id;
+}
+
+bool TextureStreamer::Update()
+{
+	const UINT64 completed = mCopyFence->GetCompletedValue();
+	bool becameResident = false;
+	bool recording = false;
+
+	for(auto& e : mEntries)
+	{
+		switch(e->State.load())
+		{
+		case EntryState::Copying:
+			if(e->CopyFence <= completed)
+			{
+				e->UploadHeap = nullptr;
+				std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>().swap(e->Layouts);
+				e->State = EntryState::Resident;
+				--mPendingCount;
+				becameResident = true;
+			}
+			break;
+
+		case EntryState::Staged:
+			if(!recording)
+			{
+				BeginCopies();
+				recording = true;
+			}
+			RecordCopies(e.get());
+			e->CopyFence = mCopyFenceValue + 1;
+			e->State = EntryState::Copying;
+			break;
+
+		case EntryState::Failed:
+			throw DxException(e->Result, L"LoadDDSTextureFromMemory12 " + e->Filename,
+				AnsiToWString(__FILE__), __LINE__);
+
+		default:
+			break;
+		}
+	}
+
+	if(recording)
+		EndCopies();
+
+	return becameResident;
+}
+
+void TextureStreamer::Flush()
+{
+	mWorkers.wait();
+	Update();
+	WaitForCopyFence(mCopyFenceValue);
+	Update();
+}
+
+ID3D12Resource* TextureStreamer::Resource(UINT id)const
+{
+	const Entry* entry = mEntries[id].get();
+	return (entry->State.load() == EntryState::Resident) ? entry->Resource.Get() : nullptr;
+}
+
+ID3D12Resource* TextureStreamer::Placeholder()const
+{
+	return mPlaceholder->Resource.Get();
+}
+
+UINT TextureStreamer::PendingCount()const
+{
+	return mPendingCount;
+}
+
+void TextureStreamer::LoadEntry(Entry* entry)
+{
+	HRESULT hr = S_OK;
+	{
+		MappedFile file(entry->Filename);
+		hr = file.Result;
+
+		// The subresources point into the mapping, so they are staged before it closes.
+		std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+		if(SUCCEEDED(hr))
+			hr = DirectX::LoadDDSTextureFromMemory12(md3dDevice, file.Data, file.Size,
+				entry->Resource, subresources);
+		if(SUCCEEDED(hr))
+			hr = StageEntry(entry, subresources.data(), (UINT)subresources.size());
+	}
+
+	entry->Result = hr;
+	entry->State = SUCCEEDED(hr) ? EntryState::Staged : EntryState::Failed;
+}
+
+HRESULT TextureStreamer::StageEntry(Entry* entry, const D3D12_SUBRESOURCE_DATA* subresources, UINT count)
+{
+	D3D12_RESOURCE_DESC desc = entry->Resource->GetDesc();
+
+	entry->Layouts.resize(count);
+	std::vector<UINT> numRows(count);
+	std::vector<UINT64> rowSizes(count);
+	UINT64 uploadSize = 0;
+	md3dDevice->GetCopyableFootprints(&desc, 0, count, 0,
+		entry->Layouts.data(), numRows.data(), rowSizes.data(), &uploadSize);
+
+	HRESULT hr = md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&entry->UploadHeap));
+	if(FAILED(hr))
+		return hr;
+
+	BYTE* mapped = nullptr;
+	hr = entry->UploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mapped));
+	if(FAILED(hr))
+		return hr;
+
+	for(UINT i = 0; i < count; ++i)
+	{
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = entry->Layouts[i];
+		D3D12_MEMCPY_DEST dest = { mapped + layout.Offset, layout.Footprint.RowPitch,
+			(SIZE_T)layout.Footprint.RowPitch * numRows[i] };
+		MemcpySubresource(&dest, &subresources[i], (SIZE_T)rowSizes[i], numRows[i], layout.Footprint.Depth);
+	}
+
+	entry->UploadHeap->Unmap(0, nullptr);
+	gUploadBytes += uploadSize;
+	return S_OK;
+}
+
+void TextureStreamer::BeginCopies()
+{
+	// Reuse the oldest allocator if the queue has finished with it, else add one.
+	const UINT64 completed = mCopyFence->GetCompletedValue();
+
+	mCurrAllocator = mAllocators.size();
+	for(size_t i = 0; i < mAllocators.size(); ++i)
+	{
+		if(mAllocators[i].second <= completed)
+		{
+			mCurrAllocator = i;
+			break;
+		}
+	}
+
+	if(mCurrAllocator == mAllocators.size())
+	{
+		ComPtr<ID3D12CommandAllocator> alloc;
+		ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+			IID_PPV_ARGS(alloc.GetAddressOf())));
+		mAllocators.push_back(std::make_pair(alloc, 0ull));
+	}
+
+	auto alloc = mAllocators[mCurrAllocator].first.Get();
+	ThrowIfFailed(alloc->Reset());
+	ThrowIfFailed(mCopyList->Reset(alloc, nullptr));
+}
+
+void TextureStreamer::RecordCopies(Entry* entry)
+{
+	// No barriers: the texture is promoted from COMMON to COPY_DEST by the copy.
+	for(UINT i = 0; i < (UINT)entry->Layouts.size(); ++i)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION dst(entry->Resource.Get(), i);
+		CD3DX12_TEXTURE_COPY_LOCATION src(entry->UploadHeap.Get(), entry->Layouts[i]);
+		mCopyList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	}
+}
+
+UINT64 TextureStreamer::EndCopies()
+{
+	ThrowIfFailed(mCopyList->Close());
+
+	ID3D12CommandList* cmdsLists[] = { mCopyList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	ThrowIfFailed(mCopyQueue->Signal(mCopyFence.Get(), ++mCopyFenceValue));
+	mAllocators[mCurrAllocator].second = mCopyFenceValue;
+
+	return mCopyFenceValue;
+}
+
+void TextureStreamer::WaitForCopyFence(UINT64 value)
+{
+	if(mCopyFence->GetCompletedValue() < value)
+	{
+		ThrowIfFailed(mCopyFence->SetEventOnCompletion(value, mCopyFenceEvent));
+		WaitForSingleObject(mCopyFenceEvent, INFINITE);
+	}
+}
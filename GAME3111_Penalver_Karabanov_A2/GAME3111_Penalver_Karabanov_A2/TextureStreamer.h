@@ -0,0 +1,111 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures in the background.  Each requested file is memory-mapped and parsed
+// on a PPL worker, which also creates the texture and fills an upload heap with its
+// subresources; Update then records the copies on a copy queue of its own, so neither
+// the main command list nor Initialize waits on disk.  Requests are cached by filename,
+// so a texture that is asked for twice is loaded once.
+//
+// Textures are created in the COMMON state and never transitioned explicitly: the copy
+// queue promotes them to COPY_DEST, they decay back to COMMON when the copy completes,
+// and the direct queue promotes them to PIXEL_SHADER_RESOURCE on first use.
+//
+// Until a texture is resident its users sample Placeholder, a 1x1 texture that is
+// uploaded by the constructor.
+//***************************************************************************************
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "../../Common/d3dUtil.h"
+#include <atomic>
+#include <ppl.h>
+
+class TextureStreamer
+{
+public:
+	explicit TextureStreamer(ID3D12Device* device);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Id of filename's cache entry.  The first request starts loading it.
+	UINT Request(const std::wstring& filename);
+
+	// Once a frame, on the thread that owns the streamer: submits the copies of the
+	// textures the workers have staged and frees the upload heaps of those the copy
+	// queue has finished.  Returns true if any texture became resident.  Throws a
+	// DxException for a file that failed to load.
+	bool Update();
+
+	// Blocks until every request so far is resident.
+	void Flush();
+
+	// The texture, or nullptr until it is resident.
+	ID3D12Resource* Resource(UINT id)const;
+	ID3D12Resource* Placeholder()const;
+
+	UINT PendingCount()const;
+
+private:
+	enum class EntryState : int
+	{
+		Loading = 0,
+		Staged,
+		Copying,
+		Resident,
+		Failed
+	};
+
+	struct Entry
+	{
+		std::wstring Filename;
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+
+		// Written by the worker before State becomes Staged or Failed.
+		HRESULT Result = S_OK;
+		std::atomic<EntryState> State{ EntryState::Loading };
+
+		// Copy queue fence value that marks the texture resident.
+		UINT64 CopyFence = 0;
+	};
+
+	// Worker side: reads the file and fills the upload heap.
+	void LoadEntry(Entry* entry);
+	HRESULT StageEntry(Entry* entry, const D3D12_SUBRESOURCE_DATA* subresources, UINT count);
+
+	// Copy queue side, on the owning thread.  BeginCopies resets mCopyList on an
+	// allocator the queue is done with; EndCopies submits it and returns the fence value
+	// that marks its copies complete.
+	void BeginCopies();
+	void RecordCopies(Entry* entry);
+	UINT64 EndCopies();
+	void WaitForCopyFence(UINT64 value);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCopyList = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mCopyFence = nullptr;
+	UINT64 mCopyFenceValue = 0;
+	HANDLE mCopyFenceEvent = nullptr;
+
+	// Allocators with the fence value of the last submission recorded from them.
+	std::vector<std::pair<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>, UINT64>> mAllocators;
+	size_t mCurrAllocator = 0;
+
+	// Entries are boxed so the workers can hold on to them while new ones are added.
+	std::vector<std::unique_ptr<Entry>> mEntries;
+	std::unordered_map<std::wstring, UINT> mCache;
+	std::unique_ptr<Entry> mPlaceholder;
+	UINT mPendingCount = 0;
+
+	concurrency::task_group mWorkers;
+};
+
+#endif // TEXTURESTREAMER_H
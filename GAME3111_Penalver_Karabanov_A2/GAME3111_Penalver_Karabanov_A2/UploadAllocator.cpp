@@ -0,0 +1,89 @@
+//***************************************************************************************
+// UploadAllocator.cpp
+//***************************************************************************************
+
+#include "UploadAllocator.h"
+
+UploadAllocator::UploadAllocator(ID3D12Device* device, UINT64 pageSize)
+{
+	mDevice = device;
+	mPageSize = pageSize;
+}
+
+UploadAllocator::~UploadAllocator()
+{
+	for(Page& p : mPages)
+		p.Resource->Unmap(0, nullptr);
+}
+
+UploadAllocator::Allocation UploadAllocator::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	for(;;)
+	{
+		if(mCurrPage == mPages.size())
+			AddPage(std::max<UINT64>(mPageSize, byteSize));
+
+		// Pages start 64 KB aligned, so aligning the offset aligns the address.
+		Page& page = mPages[mCurrPage];
+		UINT64 offset = (mOffset + alignment - 1) & ~(alignment - 1);
+		if(offset + byteSize <= page.Size)
+		{
+			mOffset = offset + byteSize;
+			mBytesAllocated += byteSize;
+
+			Allocation a;
+			a.CPU = page.CPU + offset;
+			a.GPU = page.GPU + offset;
+			a.Resource = page.Resource.Get();
+			a.Offset = offset;
+			return a;
+		}
+
+		// The rest of this page goes unused until the next reset.  An allocation larger
+		// than the later pages skips them all and gets a page of its own.
+		++mCurrPage;
+		mOffset = 0;
+	}
+}
+
+void UploadAllocator::Reset()
+{
+	mCurrPage = 0;
+	mOffset = 0;
+	mBytesAllocated = 0;
+}
+
+UINT64 UploadAllocator::BytesAllocated()const
+{
+	return mBytesAllocated;
+}
+
+UINT64 UploadAllocator::Capacity()const
+{
+	UINT64 capacity = 0;
+	for(const Page& p : mPages)
+		capacity += p.Size;
+	return capacity;
+}
+
+void UploadAllocator::AddPage(UINT64 size)
+{
+	Page page;
+	page.Size = size;
+
+	ThrowIfFailed(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&page.Resource)));
+
+	// Upload heaps stay mapped for their whole life.
+	ThrowIfFailed(page.Resource->Map(0, nullptr, reinterpret_cast<void**>(&page.CPU)));
+	page.GPU = page.Resource->GetGPUVirtualAddress();
+
+	mPages.push_back(page);
+}
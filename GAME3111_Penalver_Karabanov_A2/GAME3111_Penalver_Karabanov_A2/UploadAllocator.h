@@ -0,0 +1,78 @@
+//***************************************************************************************
+// UploadAllocator.h
+//
+// Linear allocator over upload heap pages, for constant data written anew every frame.
+// Each frame resource owns one: allocations bump an offset through its pages, and the
+// whole allocator is reset once the frame resource's fence has passed.  Pages are
+// added on demand and kept across resets, so the space settles at what the busiest
+// frame needed and never has to be sized for the worst case up front.
+//
+// Not thread-safe; allocate on the thread that updates the frame.
+//***************************************************************************************
+
+#ifndef UPLOADALLOCATOR_H
+#define UPLOADALLOCATOR_H
+
+#include "../../Common/d3dUtil.h"
+
+class UploadAllocator
+{
+public:
+	static const UINT64 DefaultPageSize = 64 * 1024;
+
+	// The resource and offset are for copies out of the allocation.
+	struct Allocation
+	{
+		BYTE* CPU = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+		ID3D12Resource* Resource = nullptr;
+		UINT64 Offset = 0;
+	};
+
+	UploadAllocator(ID3D12Device* device, UINT64 pageSize = DefaultPageSize);
+	UploadAllocator(const UploadAllocator& rhs) = delete;
+	UploadAllocator& operator=(const UploadAllocator& rhs) = delete;
+	~UploadAllocator();
+
+	// byteSize bytes at a multiple of alignment, a power of two.  The default suits
+	// constant buffer views.
+	Allocation Allocate(UINT64 byteSize, UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+	// Copies data into a new constant buffer and returns its address for a root CBV.
+	template<typename T>
+	D3D12_GPU_VIRTUAL_ADDRESS AllocateConstants(const T& data)
+	{
+		Allocation a = Allocate(d3dUtil::CalcConstantBufferByteSize(sizeof(T)));
+		memcpy(a.CPU, &data, sizeof(T));
+		gUploadBytes += sizeof(T);
+		return a.GPU;
+	}
+
+	// Frees every allocation.  The GPU must be done with all of them.
+	void Reset();
+
+	UINT64 BytesAllocated()const;
+	UINT64 Capacity()const;
+
+private:
+	struct Page
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		BYTE* CPU = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GPU = 0;
+		UINT64 Size = 0;
+	};
+
+	void AddPage(UINT64 size);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	UINT64 mPageSize = 0;
+
+	std::vector<Page> mPages;
+	size_t mCurrPage = 0;
+	UINT64 mOffset = 0;
+	UINT64 mBytesAllocated = 0;
+};
+
+#endif // UPLOADALLOCATOR_H
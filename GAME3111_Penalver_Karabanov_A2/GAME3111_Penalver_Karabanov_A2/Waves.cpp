@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -27,28 +28,15 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
-
-    // Generate grid vertices in system memory.
-
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
-    for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
-
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+    mHalfWidth = (n - 1)*dx*0.5f;
+    mHalfDepth = (m - 1)*dx*0.5f;
+
+    // The grid starts flat.
+    mPrevHeight.assign(m*n, 0.0f);
+    mCurrHeight.assign(m*n, 0.0f);
+    mNormalX.assign(m*n, 0.0f);
+    mNormalY.assign(m*n, 1.0f);
+    mNormalZ.assign(m*n, 0.0f);
 }
 
 Waves::~Waves()
@@ -85,7 +73,33 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+XMFLOAT3 Waves::Position(int i)const
+{
+	int row = i / mNumCols;
+	int col = i % mNumCols;
+	return XMFLOAT3(-mHalfWidth + col*mSpatialStep, mCurrHeight[i], mHalfDepth - row*mSpatialStep);
+}
+
+XMFLOAT3 Waves::Normal(int i)const
+{
+	return XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]);
+}
+
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	int col = i % mNumCols;
+	if(col == 0 || col == mNumCols - 1 || i < mNumCols || i >= mVertexCount - mNumCols)
+		return XMFLOAT3(1.0f, 0.0f, 0.0f);
+
+	float l = mCurrHeight[i-1];
+	float r = mCurrHeight[i+1];
+
+	XMFLOAT3 t;
+	XMStoreFloat3(&t, XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r-l, 0.0f, 0.0f)));
+	return t;
+}
+
+bool Waves::Update(float dt, WaveVertex* out)
 {
 	static float t = 0;
 
@@ -93,64 +107,144 @@ void Waves::Update(float dt)
 	t += dt;
 
 	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	if( t < mTimeStep )
+		return false;
+
+	const int n = mNumCols;
+
+	// Interior columns [1, n-2]; the vector loops cover whole groups of four and a
+	// scalar loop finishes the row.
+	const int lastCol = n - 2;
+	const int vectorEnd = 1 + ((lastCol >= 1 ? lastCol : 0) / 4) * 4;
+
+	const XMVECTOR k1 = XMVectorReplicate(mK1);
+	const XMVECTOR k2 = XMVectorReplicate(mK2);
+	const XMVECTOR k3 = XMVectorReplicate(mK3);
+
+	// Only update interior points; we use zero boundary conditions.
+	concurrency::parallel_for(1, mNumRows - 1, [&](int i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element)
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to
+		// keep consistent with our row indices going down.
+		float* prev = &mPrevHeight[i*n];
+		const float* curr = &mCurrHeight[i*n];
+		const float* up = curr - n;
+		const float* down = curr + n;
+
+		int j = 1;
+		for(; j < vectorEnd; j += 4)
+		{
+			XMVECTOR p = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(prev + j));
+			XMVECTOR c = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j));
+			XMVECTOR sum = XMVectorAdd(
+				XMVectorAdd(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(down + j)),
+				            XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(up + j))),
+				XMVectorAdd(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j + 1)),
+				            XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j - 1))));
+
+			p = XMVectorMultiplyAdd(k1, p, XMVectorMultiplyAdd(k2, c, XMVectorMultiply(k3, sum)));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(prev + j), p);
+		}
+
+		for(; j <= lastCol; ++j)
+		{
+			prev[j] = mK1*prev[j] + mK2*curr[j] +
+				mK3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
+		}
+	});
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevHeight, mCurrHeight);
+
+	t = 0.0f; // reset time
+
+	//
+	// Compute normals using finite difference scheme:
+	// n = normalize(l - r, 2dx, b - t).
+	//
+	const XMVECTOR twoDx = XMVectorReplicate(2.0f*mSpatialStep);
+	const XMVECTOR twoDxSq = XMVectorMultiply(twoDx, twoDx);
+
+	concurrency::parallel_for(1, mNumRows - 1, [&](int i)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		const float* curr = &mCurrHeight[i*n];
+		const float* up = curr - n;
+		const float* down = curr + n;
+		float* nx = &mNormalX[i*n];
+		float* ny = &mNormalY[i*n];
+		float* nz = &mNormalZ[i*n];
+
+		int j = 1;
+		for(; j < vectorEnd; j += 4)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
-		});
-
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
-
-		t = 0.0f; // reset time
-
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+			XMVECTOR l = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j - 1));
+			XMVECTOR r = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(curr + j + 1));
+			XMVECTOR top = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(up + j));
+			XMVECTOR bottom = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(down + j));
+
+			XMVECTOR x = XMVectorSubtract(l, r);
+			XMVECTOR z = XMVectorSubtract(bottom, top);
+			XMVECTOR invLength = XMVectorReciprocalSqrt(
+				XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(z, z, twoDxSq)));
+
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(nx + j), XMVectorMultiply(x, invLength));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(ny + j), XMVectorMultiply(twoDx, invLength));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(nz + j), XMVectorMultiply(z, invLength));
+		}
+
+		for(; j <= lastCol; ++j)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
-		});
+			float x = curr[j-1] - curr[j+1];
+			float y = 2.0f*mSpatialStep;
+			float z = down[j] - up[j];
+			float invLength = 1.0f / sqrtf(x*x + y*y + z*z);
+
+			nx[j] = x*invLength;
+			ny[j] = y*invLength;
+			nz[j] = z*invLength;
+		}
+
+		// Write the whole row, boundary columns included, while it is in cache.
+		if(out != nullptr)
+			WriteRow(i, out);
+	});
+
+	if(out != nullptr)
+	{
+		// The boundary rows never change, but out may be a fresh buffer.
+		WriteRow(0, out);
+		WriteRow(mNumRows - 1, out);
+	}
+
+	return out != nullptr;
+}
+
+void Waves::WriteVertices(WaveVertex* out)const
+{
+	concurrency::parallel_for(0, mNumRows, [this, out](int i)
+	{
+		WriteRow(i, out);
+	});
+}
+
+void Waves::WriteRow(int i, WaveVertex* out)const
+{
+	const int n = mNumCols;
+	const float z = mHalfDepth - i*mSpatialStep;
+
+	for(int j = 0; j < n; ++j)
+	{
+		WaveVertex& v = out[i*n + j];
+		v.Pos = XMFLOAT3(-mHalfWidth + j*mSpatialStep, mCurrHeight[i*n + j], z);
+		v.Normal = XMFLOAT3(mNormalX[i*n + j], mNormalY[i*n + j], mNormalZ[i*n + j]);
 	}
 }
 
@@ -163,10 +257,10 @@ void Waves::Disturb(int i, int j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeight[i*mNumCols+j]     += magnitude;
+	mCurrHeight[i*mNumCols+j+1]   += halfMag;
+	mCurrHeight[i*mNumCols+j-1]   += halfMag;
+	mCurrHeight[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeight[(i-1)*mNumCols+j] += halfMag;
 }
 	
@@ -4,6 +4,10 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// Storage is structure-of-arrays: only heights and normal components are kept, and the
+// x/z of a grid point follow from its row and column.  The height update and the normal
+// pass run four points at a time with DirectXMath vectors.
 //***************************************************************************************
 
 #ifndef WAVES_H
@@ -12,6 +16,14 @@
 #include <vector>
 #include <DirectXMath.h>
 
+// Dynamic stream of the waves vertex buffer.  Tex-coords never change, so they live in
+// a separate static stream.
+struct WaveVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+};
+
 class Waves
 {
 public:
@@ -28,17 +40,28 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+    DirectX::XMFLOAT3 Position(int i)const;
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    DirectX::XMFLOAT3 Normal(int i)const;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	// Nothing reads it per frame, so it is derived from the heights on request.
+    DirectX::XMFLOAT3 TangentX(int i)const;
 
-	void Update(float dt);
+	// Advances the simulation once dt has accumulated to a time step.  If out is given
+	// and a step was taken, every grid point is also written to out from the same
+	// parallel loop that computes the normals.  Returns whether out was written.
+	bool Update(float dt, WaveVertex* out = nullptr);
 	void Disturb(int i, int j, float magnitude);
 
+	// Writes the whole current solution to out (VertexCount() vertices).
+	void WriteVertices(WaveVertex* out)const;
+
+private:
+	// Writes row i of the current solution to out.
+	void WriteRow(int i, WaveVertex* out)const;
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +77,16 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Grid point (i, j) is at local (-w/2 + j*dx, height, d/2 - i*dx).
+    float mHalfWidth = 0.0f;
+    float mHalfDepth = 0.0f;
+
+    std::vector<float> mPrevHeight;
+    std::vector<float> mCurrHeight;
+
+    std::vector<float> mNormalX;
+    std::vector<float> mNormalY;
+    std::vector<float> mNormalZ;
 };
 
 #endif // WAVES_H
\ No newline at end of file